@@ -17,24 +17,18 @@
 #include "bitmap.h"
 #include "nls.h"
 #include "shell.h"
-/**
- * Program Name, version, author.
- * displayed when 'usage' and 'version'
- */
-#define PROGRAM_NAME     "debugfatfs"
-#define PROGRAM_VERSION  "0.4.0"
-#define PROGRAM_AUTHOR   "LeavaTail"
-#define COPYRIGHT_YEAR   "2021"
-
+#include "uring.h"
+#include "trace.h"
+#include "zimage.h"
+#include "partition.h"
+#include "overlay.h"
+#include "journal.h"
+#include "volume.h"
+#include "serve.h"
 /**
  * Debug code
  */
-extern unsigned int print_level;
-extern FILE *output;
-#define PRINT_ERR      1
-#define PRINT_WARNING  2
-#define PRINT_INFO     3
-#define PRINT_DEBUG    4
+extern __thread FILE *output;
 
 #define print(level, fmt, ...) \
 	do { \
@@ -108,7 +102,6 @@ extern FILE *output;
 #define VOLUME_LABEL_MAX  11
 #define LONGNAME_MAX      13
 #define ENTRY_NAME_MAX    15
-#define MAX_NAME_LENGTH   255
 
 enum FStype
 {
@@ -119,6 +112,129 @@ enum FStype
 	UNKNOWN,
 };
 
+/*
+ * Sector cache definition
+ */
+#define CACHE_SIZE       (4 * 1024 * 1024)
+#define CACHE_BYPASS     4
+#define CACHE_RUN_MAX    64
+#define CHAIN_EXTENT_MAX (64 * 1024 * 1024)
+/* Directories read in one batch while traversing all directories */
+#define DIRECTORY_BATCH_MAX (16 * 1024 * 1024)
+
+/*
+ * Metadata capture definition
+ */
+#define CAPTURE_CHUNK    (1024 * 1024)
+/* Region which isn't captured is filled with this pattern */
+#define CAPTURE_FILL     "--NOT-CAPTURED--"
+
+/*
+ * Access pattern definition
+ */
+#define ACCESS_SEQUENTIAL 0
+#define ACCESS_RANDOM     1
+#define ACCESS_ONCE       2
+#define ACCESS_DROP_MIN   (64 * 1024)
+
+struct cache_block {
+	off_t offset;
+	bool dirty;
+	unsigned char *data;
+	struct cache_block *hash;
+	struct cache_block *prev;
+	struct cache_block *next;
+};
+
+struct sector_cache {
+	size_t block_size;
+	size_t count;
+	size_t max_count;
+	size_t dirty_count;
+	size_t hash_size;
+	struct cache_block **hash;
+	struct cache_block *head;
+	struct cache_block *tail;
+};
+
+/*
+ * Buffer pool definition
+ */
+#define POOL_MAX         16
+
+struct buffer_pool {
+	size_t align;
+	size_t sector_num;
+	size_t cluster_num;
+	void *sector[POOL_MAX];
+	void *cluster[POOL_MAX];
+};
+
+/*
+ * I/O accounting definition
+ */
+#define IOSTAT_SESSION   0
+#define IOSTAT_COMMAND   1
+#define IOSTAT_NUM       2
+
+struct io_extent {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct io_counter {
+	size_t calls;
+	size_t syscalls;
+	uint64_t bytes;
+	uint64_t nsec;
+	uint64_t sectors;
+	struct io_extent *touched;
+	size_t touched_num;
+	size_t touched_size;
+};
+
+struct io_stat {
+	struct io_counter read;
+	struct io_counter write;
+	size_t syncs;
+};
+
+/*
+ * Hole map definition
+ */
+struct hole {
+	off_t start;
+	off_t end;
+};
+
+/*
+ * Discard batch definition
+ */
+#define DISCARD_BATCH    64
+
+struct discard_batch {
+	struct hole extent[DISCARD_BATCH];
+	size_t num;
+	size_t bytes;
+	bool blkdev;
+};
+
+/*
+ * Cluster stream definition
+ */
+#define STREAM_DEPTH     8
+#define STREAM_AHEAD     4
+
+struct cluster_stream {
+	uint32_t *chain;
+	size_t num;
+	size_t head;
+	size_t tail;
+	struct uring *uring;
+	void *buf[STREAM_DEPTH];
+	bool ready[STREAM_DEPTH];
+};
+
 struct device_info {
 	char name[255];
 	int fd;
@@ -126,11 +242,11 @@ struct device_info {
 	size_t total_size;
 	size_t sector_size;
 	size_t cluster_size;
-	uint16_t cluster_count;
+	uint32_t cluster_count;
 	enum FStype fstype;
 	uint8_t flags;
 	uint32_t fat_offset;
-	uint32_t fat_length;
+	size_t fat_length;
 	uint32_t heap_offset;
 	uint32_t root_offset;
 	uint32_t root_length;
@@ -142,29 +258,27 @@ struct device_info {
 	uint8_t vol_length;
 	node2_t **root;
 	size_t root_size;
+	struct sector_cache *cache;
+	struct buffer_pool pool;
+	unsigned char *map;
+	struct uring *uring;
+	struct io_stat stat[IOSTAT_NUM];
+	struct trace *trace;
+	struct hole *holes;
+	size_t hole_num;
+	struct zimage *zimage;
+	off_t volume_offset;
+	struct overlay *overlay;
+	bool capture;
+	struct journal *journal;
+	int durability;
+	bool unsynced;
+	char *snapshot;
+	uint32_t bad_cluster;
+	uint32_t last_cluster;
 	const struct operations *ops;
 };
 
-#define OPTION_ALL          (1 << 0)
-#define OPTION_CLUSTER      (1 << 1)
-#define OPTION_INTERACTIVE  (1 << 2)
-#define OPTION_OUTPUT       (1 << 3)
-#define OPTION_SECTOR       (1 << 4)
-#define OPTION_UPPER        (1 << 5)
-#define OPTION_READONLY     (1 << 6)
-#define OPTION_FATENT       (1 << 7)
-
-struct directory {
-	unsigned char *name;
-	size_t namelen;
-	size_t datalen;
-	uint16_t attr;
-	struct tm ctime;
-	struct tm atime;
-	struct tm mtime;
-	uint16_t hash;
-};
-
 #define DIRECTORY_FILES  1024
 
 struct fat_fileinfo {
@@ -268,7 +382,7 @@ struct exfat_bootsec {
 	uint32_t FatOffset;
 	uint32_t FatLength;
 	uint32_t ClusterHeapOffset;
-	uint16_t ClusterCount;
+	uint32_t ClusterCount;
 	uint32_t FirstClusterOfRootDirectory;
 	uint32_t VolumeSerialNumber;
 	uint16_t FileSystemRevision;
@@ -396,6 +510,9 @@ struct exfat_dentry {
 	} __attribute__((packed)) dentry;
 } __attribute__ ((packed));
 
+/* Add clusters in a row to list */
+typedef int (*metadata_add_t)(uint32_t, size_t);
+
 struct operations {
 	int (*statfs)(void);
 	int (*info)(void);
@@ -417,17 +534,13 @@ struct operations {
 	int (*fill)(uint32_t, uint32_t);
 	int (*contents)(const char *, uint32_t);
 	int (*stat)(const char *, uint32_t);
+	int (*freerun)(uint32_t *, uint32_t *);
+	int (*metadata)(metadata_add_t);
 };
 
 #define TAIL_COUNT           10
 
-/* FAT/exFAT File Attributes */
-#define ATTR_READ_ONLY       0x01
-#define ATTR_HIDDEN          0x02
-#define ATTR_SYSTEM          0x04
-#define ATTR_VOLUME_ID       0x08
-#define ATTR_DIRECTORY       0x10
-#define ATTR_ARCHIVE         0x20
+/* FAT long file name entry (other attributes are in volume.h) */
 #define ATTR_LONG_FILE_NAME  (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID)
 /* FAT dentry type */
 #define LAST_LONG_ENTRY      0x40
@@ -509,16 +622,43 @@ static inline size_t strwlen(const uint16_t *str)
 	return len;
 }
 
-extern struct device_info info;
+extern __thread struct device_info *info;
 
 /* General function */
 int get_sector(void *, off_t, size_t);
 int get_cluster(void *, off_t);
 int get_clusters(void *, off_t, size_t);
+int get_cluster_chain(void *, uint32_t *, size_t);
+void *get_cluster_chains(uint32_t **, size_t *, size_t);
 int set_sector(void *, off_t, size_t);
 int set_cluster(void *, off_t);
 int set_clusters(void *, off_t, size_t);
+int set_cluster_chain(void *, uint32_t *, size_t);
+int open_cluster_stream(struct cluster_stream *, uint32_t *, size_t);
+void *read_cluster_stream(struct cluster_stream *, size_t);
+void close_cluster_stream(struct cluster_stream *);
+int flush_cache(void);
+int sync_volume(int);
+void *alloc_sector(void);
+void *alloc_cluster(void);
+void free_sector(void *);
+void free_cluster(void *);
+void *map_sector(off_t, size_t);
+bool is_hole(off_t, size_t);
+off_t find_data(off_t);
+int advise_access(off_t, size_t, int);
+void reset_iostat(int);
+void print_iostat(int);
+int print_sector(off_t);
 int print_cluster(uint32_t);
+int reload_filesystem(void);
+int rollback_journal(void);
+int take_snapshot(const char *);
+int restore_snapshot(const char *);
+int discard_free(uint32_t *);
+int sparsify_image(bool, uint32_t *);
+int capture_metadata(const char *, size_t *);
+int expand_capture(const char *);
 void hexdump(void *, size_t);
 void gen_rand(char *, size_t);
 
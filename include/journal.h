@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Undo journal format
+ *
+ * struct journal_header is followed by struct journal_record.
+ * Each record is followed by @length bytes of data before the session.
+ */
+#define JOURNAL_MAGIC    "DFSUNDO"
+#define JOURNAL_VERSION  1
+#define JOURNAL_UNIT     512
+
+struct journal_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t unit;
+	uint64_t size;
+} __attribute__((packed));
+
+struct journal_record {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct journal;
+
+/* Read/Write any bytes in volume */
+typedef int (*journal_read_t)(void *, off_t, size_t);
+typedef int (*journal_write_t)(void *, off_t, size_t);
+
+struct journal *journal_open(const char *, size_t, bool);
+void journal_close(struct journal *);
+int journal_record(struct journal *, off_t, size_t, journal_read_t);
+int journal_sync(struct journal *);
+int journal_rollback(struct journal *, journal_write_t);
+int journal_reset(struct journal *);
+
+#endif /*_JOURNAL_H */
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _OVERLAY_H
+#define _OVERLAY_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Overlay file format
+ *
+ * struct overlay_header is followed by block index (bitmap).
+ * Written block is stored at @data_offset + offset in volume,
+ * so unwritten region remains hole in sparse file.
+ */
+#define OVERLAY_MAGIC       "DFSOVLAY"
+#define OVERLAY_VERSION     1
+#define OVERLAY_BLOCK_SIZE  4096
+
+struct overlay_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t block_size;
+	uint64_t size;
+	uint64_t data_offset;
+} __attribute__((packed));
+
+struct overlay;
+
+/* Read/Write any bytes in base volume */
+typedef int (*overlay_read_t)(void *, off_t, size_t);
+typedef int (*overlay_write_t)(void *, off_t, size_t);
+
+bool overlay_probe(int, size_t *);
+struct overlay *overlay_open(const char *, size_t, bool);
+void overlay_close(struct overlay *);
+int overlay_sync(struct overlay *);
+int overlay_datasync(struct overlay *);
+int overlay_reset(struct overlay *);
+int overlay_merge(struct overlay *, overlay_write_t);
+int overlay_read(struct overlay *, void *, off_t, size_t, overlay_read_t);
+int overlay_write(struct overlay *, const void *, off_t, size_t, overlay_read_t);
+
+#endif /*_OVERLAY_H */
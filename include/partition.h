@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _PARTITION_H
+#define _PARTITION_H
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Partition table
+ *
+ * MBR has four primary entries at the end of LBA 0. Logical partitions
+ * (number 5 or more) are linked from extended partition by EBR.
+ * GPT header is placed at LBA 1, and protected by MBR entry of 0xEE.
+ */
+#define MBR_SIGNATURE      0xAA55
+#define MBR_ENTRY_OFFSET   446
+#define MBR_ENTRIES        4
+#define MBR_LOGICAL_MAX    128
+#define MBR_TYPE_EMPTY     0x00
+#define MBR_TYPE_GPT       0xEE
+
+#define GPT_SIGNATURE      "EFI PART"
+#define GPT_ENTRY_MIN      128
+#define GPT_ENTRIES_MAX    1024
+
+struct mbr_entry {
+	uint8_t  BootIndicator;
+	uint8_t  StartingCHS[3];
+	uint8_t  PartitionType;
+	uint8_t  EndingCHS[3];
+	uint32_t StartingLBA;
+	uint32_t SizeInLBA;
+} __attribute__((packed));
+
+struct gpt_header {
+	char     Signature[8];
+	uint32_t Revision;
+	uint32_t HeaderSize;
+	uint32_t HeaderCRC32;
+	uint32_t Reserved;
+	uint64_t MyLBA;
+	uint64_t AlternateLBA;
+	uint64_t FirstUsableLBA;
+	uint64_t LastUsableLBA;
+	uint8_t  DiskGUID[16];
+	uint64_t PartitionEntryLBA;
+	uint32_t NumberOfPartitionEntries;
+	uint32_t SizeOfPartitionEntry;
+	uint32_t PartitionEntryArrayCRC32;
+} __attribute__((packed));
+
+struct gpt_entry {
+	uint8_t  PartitionTypeGUID[16];
+	uint8_t  UniquePartitionGUID[16];
+	uint64_t StartingLBA;
+	uint64_t EndingLBA;
+	uint64_t Attributes;
+} __attribute__((packed));
+
+struct partition {
+	off_t offset;
+	off_t length;
+};
+
+/* Read any bytes from whole device */
+typedef int (*partition_read_t)(void *, off_t, size_t);
+
+int get_partition(partition_read_t, unsigned int, struct partition *);
+
+#endif /*_PARTITION_H */
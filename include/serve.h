@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _SERVE_H
+#define _SERVE_H
+#include <stdint.h>
+
+/*
+ * Server protocol
+ *
+ * Request and response are struct serve_header followed by @length bytes.
+ * Request is one command line of interactive mode, and response is its output.
+ * Fields are in network byte order.
+ */
+#define SERVE_MAX_CLIENTS  64
+
+#define SERVE_OK           0
+#define SERVE_CLOSED       1  /* Session is closed by "exit" */
+
+struct serve_header {
+	uint32_t length;
+	uint32_t status;
+} __attribute__((packed));
+
+int serve(const char *);
+
+#endif /*_SERVE_H */
@@ -16,6 +16,12 @@ struct command {
 	int (*func)(int, char **, char **);
 };
 
+/* State of one shell (e.g. current directory) */
+struct shell_session;
+
+struct shell_session *shell_open(void);
+int shell_execute(struct shell_session *, char *);
+void shell_close(struct shell_session *);
 int shell(void);
 
 #endif /*_SHELL_H */
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Trace file format
+ *
+ * struct trace_header is followed by struct trace_record.
+ * TRACE_OPNAME record is followed by @length bytes of operation name.
+ */
+#define TRACE_MAGIC    "DFSTRACE"
+#define TRACE_VERSION  1
+#define TRACE_OP_MAX   256
+
+#define TRACE_READ     0
+#define TRACE_WRITE    1
+#define TRACE_OPNAME   2  /* @op is named */
+#define TRACE_LAYOUT   3  /* @offset is start of data region, @length is sector size */
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct trace_record {
+	uint64_t time;
+	uint64_t offset;
+	uint32_t length;
+	uint8_t type;
+	uint8_t op;
+	uint16_t reserved;
+} __attribute__((packed));
+
+struct trace;
+
+struct trace *trace_open(const char *);
+void trace_close(struct trace *);
+void trace_op(struct trace *, const char *);
+void trace_layout(struct trace *, off_t, size_t);
+void trace_access(struct trace *, int, off_t, size_t);
+
+#endif /*_TRACE_H */
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _URING_H
+#define _URING_H
+#include <stdint.h>
+#include <sys/types.h>
+
+#define URING_ENTRIES  64
+
+struct uring;
+
+struct uring *uring_init(unsigned int);
+void uring_exit(struct uring *);
+int uring_prep_read(struct uring *, int, void *, size_t, off_t, uint64_t);
+int uring_submit(struct uring *);
+int uring_wait(struct uring *, uint64_t *, ssize_t *);
+unsigned int uring_inflight(struct uring *);
+
+#endif /*_URING_H */
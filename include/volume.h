@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _VOLUME_H
+#define _VOLUME_H
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/*
+ * Volume handle
+ *
+ * Volume carries its own device, geometry, caches and filesystem operations,
+ * so that several volumes can be opened in one process.
+ * Functions in libdebugfatfs access the volume selected by the calling thread,
+ * and one volume must not be selected by several threads at the same time.
+ */
+struct volume;
+
+/**
+ * Program Name, version, author.
+ * displayed when 'usage' and 'version'
+ */
+#define PROGRAM_NAME     "debugfatfs"
+#define PROGRAM_VERSION  "0.4.0"
+#define PROGRAM_AUTHOR   "LeavaTail"
+#define COPYRIGHT_YEAR   "2021"
+
+/* How to open the volume (options which are given by command line) */
+#define OPTION_ALL          (1 << 0)
+#define OPTION_CLUSTER      (1 << 1)
+#define OPTION_INTERACTIVE  (1 << 2)
+#define OPTION_OUTPUT       (1 << 3)
+#define OPTION_SECTOR       (1 << 4)
+#define OPTION_UPPER        (1 << 5)
+#define OPTION_READONLY     (1 << 6)
+#define OPTION_FATENT       (1 << 7)
+#define OPTION_DIRECT       (1 << 8)
+#define OPTION_STATS        (1 << 9)
+#define OPTION_TRACE        (1 << 10)
+#define OPTION_PARTITION    (1 << 11)
+#define OPTION_OFFSET       (1 << 12)
+#define OPTION_OVERLAY      (1 << 13)
+#define OPTION_JOURNAL      (1 << 14)
+#define OPTION_ROLLBACK     (1 << 15)
+#define OPTION_SNAPSHOT     (1 << 16)
+#define OPTION_RESTORE      (1 << 17)
+#define OPTION_DISCARD      (1 << 18)
+#define OPTION_SPARSIFY     (1 << 19)
+#define OPTION_CAPTURE      (1 << 20)
+#define OPTION_EXPAND       (1 << 21)
+#define OPTION_DURABILITY   (1 << 22)
+#define OPTION_BATCH        (1 << 23)
+#define OPTION_SERVE        (1 << 24)
+
+/* Options which only change how to access the device */
+#define OPTION_MODIFIER     (OPTION_DIRECT | OPTION_STATS | OPTION_TRACE | \
+		OPTION_PARTITION | OPTION_OFFSET | OPTION_OVERLAY | OPTION_JOURNAL | \
+		OPTION_SNAPSHOT | OPTION_DURABILITY | OPTION_BATCH)
+/* Options which use one file for the session can't be shared by workers */
+#define OPTION_BATCH_EXCLUSIVE  (OPTION_INTERACTIVE | OPTION_TRACE | OPTION_OVERLAY | \
+		OPTION_JOURNAL | OPTION_ROLLBACK | OPTION_SNAPSHOT | OPTION_RESTORE | \
+		OPTION_CAPTURE | OPTION_EXPAND | OPTION_SERVE)
+
+/*
+ * Durability policy definition
+ * (Policy syncs at its boundary and all less frequent boundaries)
+ */
+#define DURABILITY_NONE     0
+#define DURABILITY_SESSION  1
+#define DURABILITY_COMMAND  2
+#define DURABILITY_WRITE    3
+
+/* How to access the device (options which are given by command line) */
+struct volume_options {
+	unsigned int partition;
+	off_t offset;
+	const char *overlay;
+	const char *journal;
+	const char *trace;
+	int durability;
+	FILE *output;
+};
+
+/* FAT/exFAT File Attributes */
+#define ATTR_READ_ONLY       0x01
+#define ATTR_HIDDEN          0x02
+#define ATTR_SYSTEM          0x04
+#define ATTR_VOLUME_ID       0x08
+#define ATTR_DIRECTORY       0x10
+#define ATTR_ARCHIVE         0x20
+
+/* Max length of file name (in bytes of UTF-8) */
+#define MAX_NAME_LENGTH   255
+
+/* Directory entry which is returned by volume_readdir() */
+struct directory {
+	unsigned char *name;
+	size_t namelen;
+	size_t datalen;
+	uint16_t attr;
+	struct tm ctime;
+	struct tm atime;
+	struct tm mtime;
+	uint16_t hash;
+};
+
+/*
+ * Message level
+ *
+ * Unlike volume, message level is process-global,
+ * so it is shared by all volumes and threads.
+ */
+#define PRINT_ERR      1
+#define PRINT_WARNING  2
+#define PRINT_INFO     3
+#define PRINT_DEBUG    4
+
+extern unsigned int print_level;
+
+/*
+ * Batch analysis
+ *
+ * Each image in list is analyzed by worker process which has its own device.
+ * Output of worker is written to per-image file in directory,
+ * or merged into one stream in the order of list.
+ */
+#define BATCH_HEADER  "==> %s <==\n"
+#define BATCH_FAILED  "==> %s: failed <==\n"
+
+struct batch;
+
+struct batch *batch_open(const char *, unsigned int, const char *, FILE *);
+const char *batch_next(struct batch *, FILE **);
+int batch_close(struct batch *);
+
+struct volume *volume_open(const char *, uint32_t, const struct volume_options *);
+int volume_load(struct volume *);
+struct volume *volume_select(struct volume *);
+void volume_close(struct volume *);
+
+/* Operations of loaded volume (volume is selected by the calling thread) */
+uint32_t volume_root(struct volume *);
+int volume_statfs(struct volume *);
+int volume_info(struct volume *);
+int volume_lookup(struct volume *, uint32_t, char *);
+int volume_readdir(struct volume *, struct directory *, size_t, uint32_t);
+int volume_stat(struct volume *, const char *, uint32_t);
+int volume_print_cluster(struct volume *, uint32_t);
+int volume_print_sector(struct volume *, off_t);
+int volume_getfat(struct volume *, uint32_t, uint32_t *);
+int volume_convert(struct volume *, const char *, size_t, char *);
+int volume_shell(struct volume *);
+int volume_serve(struct volume *, const char *);
+
+/* Operations of whole device (filesystem may not be loaded) */
+int volume_rollback(struct volume *);
+int volume_snapshot(struct volume *, const char *);
+int volume_restore(struct volume *, const char *);
+int volume_expand(struct volume *, const char *);
+int volume_discard(struct volume *, uint32_t *);
+int volume_sparsify(struct volume *, int, uint32_t *);
+int volume_capture(struct volume *, const char *, size_t *);
+void volume_trace(struct volume *, const char *);
+
+#endif /*_VOLUME_H */
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifndef _ZIMAGE_H
+#define _ZIMAGE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Seekable zstd format
+ *
+ * Image is split into independent zstd frames, and seek table is
+ * appended as skippable frame. Footer is placed at the end of file.
+ */
+#define ZIMAGE_SKIPPABLE_MAGIC  0x184D2A5E
+#define ZIMAGE_SEEKABLE_MAGIC   0x8F92EAB1
+#define ZIMAGE_FOOTER_SIZE      9
+#define ZIMAGE_CHECKSUM_FLAG    0x80
+#define ZIMAGE_CACHE_FRAMES     8
+
+struct zimage;
+
+bool zimage_probe(int, off_t);
+struct zimage *zimage_open(int, off_t);
+void zimage_close(struct zimage *);
+size_t zimage_size(struct zimage *);
+int zimage_read(struct zimage *, void *, off_t, size_t);
+
+#endif /*_ZIMAGE_H */
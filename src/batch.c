@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "volume.h"
+
+struct batch_job {
+	char *image;
+	FILE *out;
+	pid_t pid;
+	bool done;
+	bool failed;
+};
+
+struct batch {
+	struct batch_job *jobs;
+	size_t num;
+	size_t next;
+	size_t done;
+	unsigned int workers;
+	unsigned int running;
+	char *dir;
+	FILE *merged;
+	int failed;
+};
+
+/**
+ * batch_load - Read image list
+ * @b:          batch
+ * @list:       list file path ("-" is stdin)
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ *
+ * NOTE: One image per line, and empty line or line starting with '#' is skipped.
+ */
+static int batch_load(struct batch *b, const char *list)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t len = 0, size = 0;
+	ssize_t count;
+	struct batch_job *tmp;
+	int ret = 0;
+
+	if (!(fp = strcmp(list, "-") ? fopen(list, "r") : stdin))
+		return -1;
+
+	while ((count = getline(&line, &len, fp)) >= 0) {
+		while (count && (line[count - 1] == '\n' || line[count - 1] == '\r'))
+			line[--count] = '\0';
+		if (!count || line[0] == '#')
+			continue;
+
+		if (b->num == size) {
+			size = size ? size * 2 : 64;
+			if (!(tmp = realloc(b->jobs, size * sizeof(struct batch_job)))) {
+				ret = -1;
+				break;
+			}
+			b->jobs = tmp;
+		}
+		memset(&b->jobs[b->num], 0, sizeof(struct batch_job));
+		if (!(b->jobs[b->num].image = strdup(line))) {
+			ret = -1;
+			break;
+		}
+		b->num++;
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return ret;
+}
+
+/**
+ * batch_open - Prepare batch analysis
+ * @list:       list file path of images ("-" is stdin)
+ * @workers:    max number of worker processes
+ * @dir:        directory for per-image output (NULL: merged stream)
+ * @merged:     merged stream (or list of failed images with @dir)
+ *
+ * @return      batch
+ *              NULL (failed to read list)
+ */
+struct batch *batch_open(const char *list, unsigned int workers, const char *dir, FILE *merged)
+{
+	struct batch *b;
+	size_t i;
+
+	if (!(b = calloc(1, sizeof(struct batch))))
+		return NULL;
+
+	b->workers = workers ? workers : 1;
+	b->merged = merged;
+	if ((dir && !(b->dir = strdup(dir))) || batch_load(b, list)) {
+		for (i = 0; i < b->num; i++)
+			free(b->jobs[i].image);
+		free(b->jobs);
+		free(b->dir);
+		free(b);
+		return NULL;
+	}
+	return b;
+}
+
+/**
+ * batch_output - Open output of worker
+ * @b:            batch
+ * @index:        job index
+ *
+ * @return        output stream
+ *                NULL (failed to open)
+ *
+ * NOTE: Per-image file is named "<index>-<basename>.txt",
+ *       so that images which have the same name don't conflict.
+ */
+static FILE *batch_output(struct batch *b, size_t index)
+{
+	FILE *fp;
+	char path[PATH_MAX], *name;
+
+	if (!b->dir)
+		return tmpfile();
+
+	if (!(name = strdup(b->jobs[index].image)))
+		return NULL;
+	snprintf(path, sizeof(path), "%s/%zu-%s.txt", b->dir, index, basename(name));
+	fp = fopen(path, "w+");
+	free(name);
+	return fp;
+}
+
+/**
+ * batch_merge - Copy finished outputs to merged stream in the order of list
+ * @b:           batch
+ */
+static void batch_merge(struct batch *b)
+{
+	struct batch_job *j;
+	char buf[BUFSIZ];
+	size_t len;
+
+	for (; b->done < b->next && b->jobs[b->done].done; b->done++) {
+		j = &b->jobs[b->done];
+		if (!b->dir || j->failed)
+			fprintf(b->merged, j->failed ? BATCH_FAILED : BATCH_HEADER, j->image);
+		if (!j->out)
+			continue;
+
+		if (!b->dir) {
+			rewind(j->out);
+			while ((len = fread(buf, 1, sizeof(buf), j->out)) > 0)
+				fwrite(buf, 1, len, b->merged);
+		}
+		fclose(j->out);
+		j->out = NULL;
+	}
+}
+
+/**
+ * batch_wait - Wait for one worker to exit
+ * @b:          batch
+ *
+ * @return       0 (success)
+ *              -1 (no worker)
+ */
+static int batch_wait(struct batch *b)
+{
+	size_t i;
+	int status;
+	pid_t pid;
+
+	while ((pid = wait(&status)) < 0 && errno == EINTR)
+		;
+	if (pid < 0)
+		return -1;
+
+	for (i = b->done; i < b->next; i++) {
+		if (b->jobs[i].pid != pid || b->jobs[i].done)
+			continue;
+
+		b->jobs[i].done = true;
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			b->jobs[i].failed = true;
+			b->failed++;
+		}
+		b->running--;
+		break;
+	}
+	batch_merge(b);
+	return 0;
+}
+
+/**
+ * batch_next - Start workers, until all images are analyzed
+ * @b:          batch
+ * @out:        output of worker (Output)
+ *
+ * @return      image which worker has to analyze (only in worker)
+ *              NULL (all workers are started, in parent)
+ *
+ * NOTE: Worker returns from this function, and parent never does until
+ *       the last worker is started.
+ *       Stdio buffers must be flushed before, so that worker doesn't repeat them.
+ */
+const char *batch_next(struct batch *b, FILE **out)
+{
+	struct batch_job *j;
+
+	while (b->next < b->num) {
+		/* Worker pool is full */
+		if (b->running >= b->workers && batch_wait(b))
+			break;
+
+		j = &b->jobs[b->next++];
+		if (!(j->out = batch_output(b, b->next - 1))) {
+			fprintf(stderr, "%s: %s\n", j->image, strerror(errno));
+			j->done = j->failed = true;
+			b->failed++;
+			continue;
+		}
+
+		fflush(NULL);
+		if ((j->pid = fork()) < 0) {
+			fprintf(stderr, "fork: %s\n", strerror(errno));
+			j->done = j->failed = true;
+			b->failed++;
+			continue;
+		}
+
+		if (!j->pid) {
+			*out = j->out;
+			return j->image;
+		}
+		b->running++;
+	}
+	return NULL;
+}
+
+/**
+ * batch_close - Wait for all workers, and release batch
+ * @b:           batch
+ *
+ * @return       The number of images which failed to analyze
+ */
+int batch_close(struct batch *b)
+{
+	int failed;
+	size_t i;
+
+	while (b->running && !batch_wait(b))
+		;
+	batch_merge(b);
+
+	for (i = 0; i < b->num; i++) {
+		if (b->jobs[i].out)
+			fclose(b->jobs[i].out);
+		free(b->jobs[i].image);
+	}
+	failed = b->failed;
+	free(b->jobs);
+	free(b->dir);
+	free(b);
+	return failed;
+}
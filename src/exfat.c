@@ -31,6 +31,8 @@ static int exfat_get_last_cluster(struct exfat_fileinfo *, uint32_t);
 static int exfat_alloc_clusters(struct exfat_fileinfo *, uint32_t, size_t);
 static int exfat_free_clusters(struct exfat_fileinfo *, uint32_t, size_t);
 static int exfat_new_clusters(size_t);
+static size_t exfat_resolve_chain(uint32_t, size_t, uint32_t *);
+static size_t exfat_get_chain(struct exfat_fileinfo *, uint32_t, uint32_t **);
 static uint32_t exfat_concat_cluster(struct exfat_fileinfo *, uint32_t, void **);
 static uint32_t exfat_set_cluster(struct exfat_fileinfo *, uint32_t, void *);
 
@@ -39,6 +41,7 @@ static int exfat_check_dchain(uint32_t);
 static int exfat_get_index(uint32_t);
 static int exfat_load_extra_entry(void);
 static int exfat_traverse_directory(uint32_t);
+static size_t exfat_traverse_directories(size_t);
 static int exfat_clean_dchain(uint32_t);
 static struct exfat_fileinfo *exfat_search_fileinfo(node2_t *, const char *);
 static void exfat_create_fileinfo(node2_t *,
@@ -89,6 +92,8 @@ int exfat_trim(uint32_t);
 int exfat_fill(uint32_t, uint32_t);
 int exfat_contents(const char *, uint32_t);
 int exfat_stat(const char *, uint32_t);
+int exfat_free_run(uint32_t *, uint32_t *);
+int exfat_metadata(metadata_add_t);
 
 static const struct operations exfat_ops = {
 	.statfs = exfat_print_bootsec,
@@ -111,6 +116,8 @@ static const struct operations exfat_ops = {
 	.fill = exfat_fill,
 	.contents = exfat_contents,
 	.stat = exfat_stat,
+	.freerun = exfat_free_run,
+	.metadata = exfat_metadata,
 };
 
 /*************************************************************************************************/
@@ -134,28 +141,28 @@ int exfat_check_filesystem(struct pseudo_bootsec *boot)
 
 	b = (struct exfat_bootsec *)boot;
 	if (!strncmp((char *)boot->FileSystemName, "EXFAT   ", 8)) {
-		info.fstype = EXFAT_FILESYSTEM;
-
-		info.fat_offset = b->FatOffset;
-		info.heap_offset = b->ClusterHeapOffset;
-		info.root_offset = b->FirstClusterOfRootDirectory;
-		info.sector_size  = 1 << b->BytesPerSectorShift;
-		info.cluster_size = (1 << b->SectorsPerClusterShift) * info.sector_size;
-		info.cluster_count = b->ClusterCount;
-		info.fat_length = b->NumberOfFats * b->FatLength * info.sector_size;
-		f = malloc(sizeof(struct exfat_fileinfo));
+		info->fstype = EXFAT_FILESYSTEM;
+
+		info->fat_offset = b->FatOffset;
+		info->heap_offset = b->ClusterHeapOffset;
+		info->root_offset = b->FirstClusterOfRootDirectory;
+		info->sector_size  = 1 << b->BytesPerSectorShift;
+		info->cluster_size = (1 << b->SectorsPerClusterShift) * info->sector_size;
+		info->cluster_count = b->ClusterCount;
+		info->fat_length = info->sector_size * b->FatLength * b->NumberOfFats;
+		f = calloc(1, sizeof(struct exfat_fileinfo));
 		f->name = malloc(sizeof(unsigned char *) * (strlen("/") + 1));
 		strncpy((char *)f->name, "/", strlen("/") + 1);
 		f->namelen = 1;
-		f->datalen = info.cluster_count * info.cluster_size;
+		f->datalen = info->cluster_count * info->cluster_size;
 		f->attr = ATTR_DIRECTORY;
 		f->hash = 0;
-		f->clu = info.root_offset;
+		f->clu = info->root_offset;
 		f->dir = NULL;
-		info.root[0] = init_node2(info.root_offset, f);
+		info->root[0] = init_node2(info->root_offset, f);
 		exfat_load_extra_entry();
 
-		info.ops = &exfat_ops;
+		info->ops = &exfat_ops;
 		ret = 1;
 	}
 
@@ -187,7 +194,7 @@ static void exfat_print_upcase(void)
 {
 	int byte, offset;
 	size_t uni_count = 0x10 / sizeof(uint16_t);
-	size_t length = info.upcase_size;
+	size_t length = info->upcase_size;
 
 	/* Output table header */
 	pr_msg("Offset  ");
@@ -199,7 +206,7 @@ static void exfat_print_upcase(void)
 	for (offset = 0; offset < length / uni_count; offset++) {
 		pr_msg("%04zxh:  ", offset * 0x10 / sizeof(uint16_t));
 		for (byte = 0; byte < uni_count; byte++) {
-			pr_msg("%04x ", info.upcase_table[offset * uni_count + byte]);
+			pr_msg("%04x ", info->upcase_table[offset * uni_count + byte]);
 		}
 		pr_msg("\n");
 	}
@@ -213,9 +220,9 @@ static void exfat_print_label(void)
 	unsigned char *name;
 
 	pr_msg("volume Label: ");
-	name = malloc(info.vol_length * sizeof(uint16_t) + 1);
-	memset(name, '\0', info.vol_length * sizeof(uint16_t) + 1);
-	utf16s_to_utf8s(info.vol_label, info.vol_length, name);
+	name = malloc(info->vol_length * sizeof(uint16_t) + 1);
+	memset(name, '\0', info->vol_length * sizeof(uint16_t) + 1);
+	utf16s_to_utf8s(info->vol_label, info->vol_length, name);
 	pr_msg("%s\n", name);
 	free(name);
 }
@@ -227,16 +234,17 @@ static void exfat_print_fat(void)
 {
 	uint32_t i, j;
 	uint32_t *fat;
-	size_t sector_num = (info.fat_length + (info.sector_size - 1)) / info.sector_size;
+	size_t sector_num = (info->fat_length + (info->sector_size - 1)) / info->sector_size;
 	uint32_t offset = 0;
 	bitmap_t b;
 
-	init_bitmap(&b, info.cluster_count);
+	init_bitmap(&b, info->cluster_count);
+	advise_access(info->fat_offset * info->sector_size, info->fat_length, ACCESS_SEQUENTIAL);
 
-	fat = malloc(info.sector_size * sector_num);
-	get_sector(fat, info.fat_offset * info.sector_size, sector_num);
+	fat = malloc(info->sector_size * sector_num);
+	get_sector(fat, info->fat_offset * info->sector_size, sector_num);
 
-	for (i = EXFAT_FIRST_CLUSTER; i < info.cluster_count; i++) {
+	for (i = EXFAT_FIRST_CLUSTER; i < info->cluster_count; i++) {
 		if (!exfat_load_bitmap(i)) {
 			set_bitmap(&b, i);
 			continue;
@@ -246,7 +254,7 @@ static void exfat_print_fat(void)
 			continue;
 
 		offset = fat[i];
-		if (offset >= EXFAT_FIRST_CLUSTER && offset < info.cluster_count) {
+		if (offset >= EXFAT_FIRST_CLUSTER && offset < info->cluster_count) {
 			set_bitmap(&b, offset);
 			unset_bitmap(&b, i);
 		} else {
@@ -255,7 +263,7 @@ static void exfat_print_fat(void)
 	}
 
 	pr_msg("FAT:\n");
-	for (i = EXFAT_FIRST_CLUSTER; i < info.cluster_count; i++) {
+	for (i = EXFAT_FIRST_CLUSTER; i < info->cluster_count; i++) {
 		if (get_bitmap(&b, i))
 			continue;
 
@@ -273,6 +281,7 @@ static void exfat_print_fat(void)
 		pr_msg("\n");
 	}
 
+	advise_access(info->fat_offset * info->sector_size, info->fat_length, ACCESS_RANDOM);
 	free_bitmap(&b);
 	free(fat);
 }
@@ -291,11 +300,11 @@ static void exfat_print_bitmap(void)
 	/* Allocation bitmap consider first cluster is 2 */
 	pr_msg("%08x  - - ", 0);
 
-	for (clu = EXFAT_FIRST_CLUSTER; clu < info.cluster_size; clu++) {
+	for (clu = EXFAT_FIRST_CLUSTER; clu < info->cluster_size; clu++) {
 
 		byte = (clu - EXFAT_FIRST_CLUSTER) / CHAR_BIT;
 		offset = (clu - EXFAT_FIRST_CLUSTER) % CHAR_BIT;
-		entry = info.alloc_table[byte];
+		entry = info->alloc_table[byte];
 
 		switch (clu % 0x10) {
 			case 0x0:
@@ -327,14 +336,14 @@ static int exfat_load_bitmap(uint32_t clu)
 	int offset, byte;
 	uint8_t entry;
 
-	if (clu < EXFAT_FIRST_CLUSTER || clu > info.cluster_count + 1)
+	if (clu < EXFAT_FIRST_CLUSTER || clu > info->cluster_count + 1)
 		return -1;
 
 	clu -= EXFAT_FIRST_CLUSTER;
 	byte = clu / CHAR_BIT;
 	offset = clu % CHAR_BIT;
 
-	entry = info.alloc_table[byte];
+	entry = info->alloc_table[byte];
 	return (entry >> offset) & 0x01;
 }
 
@@ -352,7 +361,7 @@ static int exfat_save_bitmap(uint32_t clu, uint32_t value)
 	uint8_t mask = 0x01;
 	uint8_t *raw_bitmap;
 
-	if (clu < EXFAT_FIRST_CLUSTER || clu > info.cluster_count + 1) {
+	if (clu < EXFAT_FIRST_CLUSTER || clu > info->cluster_count + 1) {
 		pr_err("cluster: %u is invalid.\n", clu);
 		return -1;
 	}
@@ -361,22 +370,25 @@ static int exfat_save_bitmap(uint32_t clu, uint32_t value)
 	byte = clu / CHAR_BIT;
 	offset = clu % CHAR_BIT;
 
-	pr_debug("index %u: allocation bitmap is 0x%x ->", clu, info.alloc_table[byte]);
+	pr_debug("index %u: allocation bitmap is 0x%x ->", clu, info->alloc_table[byte]);
 	mask <<= offset;
 	if (value)
-		info.alloc_table[byte] |= mask;
+		info->alloc_table[byte] |= mask;
 	else
-		info.alloc_table[byte] &= ~mask;
-
-	pr_debug("0x%x\n", info.alloc_table[byte]);
-	raw_bitmap = malloc(info.cluster_size);
-	get_cluster(raw_bitmap, info.alloc_cluster);
+		info->alloc_table[byte] &= ~mask;
+
+	pr_debug("0x%x\n", info->alloc_table[byte]);
+	/* Allocation bitmap may be larger than one cluster */
+	clu = info->alloc_cluster + byte / info->cluster_size;
+	byte %= info->cluster_size;
+	raw_bitmap = alloc_cluster();
+	get_cluster(raw_bitmap, clu);
 	if (value)
 		raw_bitmap[byte] |= mask;
 	else
 		raw_bitmap[byte] &= ~mask;
-	set_cluster(raw_bitmap, info.alloc_cluster);
-	free(raw_bitmap);
+	set_cluster(raw_bitmap, clu);
+	free_cluster(raw_bitmap);
 	return 0;
 }
 
@@ -389,15 +401,18 @@ static int exfat_save_bitmap(uint32_t clu, uint32_t value)
  */
 static int exfat_load_bitmap_cluster(struct exfat_dentry d)
 {
-	if (info.alloc_cluster)
+	uint64_t len;
+
+	if (info->alloc_cluster)
 		return -1;
 
 	pr_debug("Get: allocation table: cluster 0x%x, size: 0x%" PRIx64 "\n",
 			d.dentry.bitmap.FirstCluster,
 			d.dentry.bitmap.DataLength);
-	info.alloc_cluster = d.dentry.bitmap.FirstCluster;
-	info.alloc_table = malloc(info.cluster_size);
-	get_cluster(info.alloc_table, d.dentry.bitmap.FirstCluster);
+	len = MAX(ROUNDUP(d.dentry.bitmap.DataLength, info->cluster_size), 1);
+	info->alloc_cluster = d.dentry.bitmap.FirstCluster;
+	info->alloc_table = malloc(info->cluster_size * len);
+	get_clusters(info->alloc_table, d.dentry.bitmap.FirstCluster, len);
 	pr_info("Allocation Bitmap (#%u):\n", d.dentry.bitmap.FirstCluster);
 
 	return 0;
@@ -415,17 +430,17 @@ static int exfat_load_upcase_cluster(struct exfat_dentry d)
 	uint32_t checksum = 0;
 	uint64_t len;
 
-	if (info.upcase_size)
+	if (info->upcase_size)
 		return -1;
 
-	info.upcase_size = d.dentry.upcase.DataLength;
-	len = (info.upcase_size + info.cluster_size - 1) / info.cluster_size;
-	info.upcase_table = malloc(info.cluster_size * len);
+	info->upcase_size = d.dentry.upcase.DataLength;
+	len = (info->upcase_size + info->cluster_size - 1) / info->cluster_size;
+	info->upcase_table = malloc(info->cluster_size * len);
 	pr_debug("Get: Up-case table: cluster 0x%x, size: 0x%x\n",
 			d.dentry.upcase.FirstCluster,
 			d.dentry.upcase.DataLength);
-	get_clusters(info.upcase_table, d.dentry.upcase.FirstCluster, len);
-	checksum = exfat_calculate_tablechecksum((unsigned char *)info.upcase_table, info.upcase_size);
+	get_clusters(info->upcase_table, d.dentry.upcase.FirstCluster, len);
+	checksum = exfat_calculate_tablechecksum((unsigned char *)info->upcase_table, info->upcase_size);
 	if (checksum != d.dentry.upcase.TableCheckSum)
 		pr_warn("Up-case table checksum is difference. (dentry: %x, calculate: %x)\n",
 				d.dentry.upcase.TableCheckSum,
@@ -443,16 +458,16 @@ static int exfat_load_upcase_cluster(struct exfat_dentry d)
  */
 static int exfat_load_volume_label(struct exfat_dentry d)
 {
-	if (info.vol_length)
+	if (info->vol_length)
 		return -1;
 
-	info.vol_length = d.dentry.vol.CharacterCount;
-	if (info.vol_length) {
-		info.vol_label = malloc(sizeof(uint16_t) * info.vol_length);
+	info->vol_length = d.dentry.vol.CharacterCount;
+	if (info->vol_length) {
+		info->vol_label = malloc(sizeof(uint16_t) * info->vol_length);
 		pr_debug("Get: Volume label: size: 0x%x\n",
 				d.dentry.vol.CharacterCount);
-		memcpy(info.vol_label, d.dentry.vol.VolumeLabel,
-				sizeof(uint16_t) * info.vol_length);
+		memcpy(info->vol_label, d.dentry.vol.VolumeLabel,
+				sizeof(uint16_t) * info->vol_length);
 	}
 
 	return 0;
@@ -473,7 +488,7 @@ static int exfat_load_volume_label(struct exfat_dentry d)
  */
 static int exfat_create_fat_chain(struct exfat_fileinfo *f, uint32_t clu)
 {
-	size_t cluster_num = ROUNDUP(f->datalen, info.cluster_size);
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
 
 	while (--cluster_num) {
 		exfat_set_fat_entry(clu, clu + 1);
@@ -500,7 +515,7 @@ static int exfat_get_last_cluster(struct exfat_fileinfo *f, uint32_t clu)
 {
 	int i;
 	uint32_t next_clu;
-	size_t cluster_num = ROUNDUP(f->datalen, info.cluster_size);
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
 
 	/* NO_FAT_CHAIN */
 	if (f->flags & ALLOC_NOFATCHAIN)
@@ -534,7 +549,7 @@ static int exfat_alloc_clusters(struct exfat_fileinfo *f, uint32_t clu, size_t n
 
 	clu = next_clu = last_clu = exfat_get_last_cluster(f, clu);
 	for (next_clu = last_clu + 1; next_clu != last_clu; next_clu++) {
-		if (next_clu > info.cluster_count - 1)
+		if (next_clu > info->cluster_count - 1)
 			next_clu = EXFAT_FIRST_CLUSTER;
 
 		if (exfat_load_bitmap(next_clu))
@@ -554,7 +569,7 @@ static int exfat_alloc_clusters(struct exfat_fileinfo *f, uint32_t clu, size_t n
 		f->flags &= ~ALLOC_NOFATCHAIN;
 		exfat_create_fat_chain(f, tmp);
 	}
-	f->datalen += num_alloc * info.cluster_size;
+	f->datalen += num_alloc * info->cluster_size;
 	exfat_update_filesize(f, tmp);
 	return total_alloc;
 }
@@ -572,7 +587,7 @@ static int exfat_free_clusters(struct exfat_fileinfo *f, uint32_t clu, size_t nu
 	int i;
 	uint32_t fst_clu = clu;
 	uint32_t next_clu;
-	size_t cluster_num = ROUNDUP(f->datalen, info.cluster_size);
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
 
 	/* NO_FAT_CHAIN */
 	if (f->flags & ALLOC_NOFATCHAIN) {
@@ -597,8 +612,8 @@ static int exfat_free_clusters(struct exfat_fileinfo *f, uint32_t clu, size_t nu
 		clu = next_clu;
 	}
 
-	if (f->datalen > num_alloc * info.cluster_size)
-		f->datalen -= num_alloc * info.cluster_size;
+	if (f->datalen > num_alloc * info->cluster_size)
+		f->datalen -= num_alloc * info->cluster_size;
 	else
 		f->datalen = 0;
 
@@ -617,7 +632,7 @@ static int exfat_new_clusters(size_t num_alloc)
 	uint32_t next_clu, clu;
 	uint32_t fst_clu = 0;
 
-	for (next_clu = EXFAT_FIRST_CLUSTER; next_clu < info.cluster_count; next_clu++) {
+	for (next_clu = EXFAT_FIRST_CLUSTER; next_clu < info->cluster_count; next_clu++) {
 		if (exfat_load_bitmap(next_clu))
 			continue;
 
@@ -639,6 +654,105 @@ static int exfat_new_clusters(size_t num_alloc)
 	return fst_clu;
 }
 
+/**
+ * exfat_resolve_chain - Get cluster index list of cluster chain
+ * @clu:                 first cluster
+ * @cluster_num:         The maximum number of clusters
+ * @chain:               cluster index list (Output)
+ *
+ * @return               The number of clusters in the chain
+ *                       0 (failed to allocate, or chain is corrupted)
+ *
+ * NOTE: Need to allocate @chain for @cluster_num clusters before call it.
+ *       FAT sector is read only once while the chain stays in it,
+ *       so a continuous run costs one read per FAT sector.
+ */
+static size_t exfat_resolve_chain(uint32_t clu, size_t cluster_num, uint32_t *chain)
+{
+	size_t entry_per_sector = info->sector_size / sizeof(uint32_t);
+	off_t fat_index = -1, index;
+	uint32_t next_clu;
+	uint32_t *fat;
+	size_t num;
+
+	if (!(fat = alloc_sector()))
+		return 0;
+
+	chain[0] = clu;
+	for (num = 1; num < cluster_num; num++) {
+		index = (info->fat_offset + clu / entry_per_sector) * info->sector_size;
+		if (index != fat_index) {
+			get_sector(fat, index, 1);
+			fat_index = index;
+		}
+		next_clu = fat[clu % entry_per_sector];
+		if (!exfat_validate_fat_entry(next_clu)) {
+			pr_warn("Invalid FAT entry[%u]: 0x%x.\n", clu, next_clu);
+			break;
+		}
+		if (next_clu == EXFAT_LASTCLUSTER)
+			break;
+		/* Corrupted FAT may have a loop */
+		if (num >= info->cluster_count) {
+			pr_warn("Invalid cluster chain from %u.\n", chain[0]);
+			num = 0;
+			break;
+		}
+		clu = next_clu;
+		chain[num] = clu;
+	}
+
+	free_sector(fat);
+	return num;
+}
+
+/**
+ * exfat_get_chain - Get cluster index list of the file
+ * @f:               file information pointer
+ * @clu:             first cluster
+ * @chain:           cluster index list (Output)
+ *
+ * @return           The number of clusters
+ *                   0 (empty file, or failed to allocate)
+ *
+ * NOTE: @chain must be released by caller.
+ */
+static size_t exfat_get_chain(struct exfat_fileinfo *f, uint32_t clu, uint32_t **chain)
+{
+	size_t i;
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
+
+	if (!cluster_num || !(*chain = malloc(sizeof(uint32_t) * cluster_num))) {
+		*chain = NULL;
+		return 0;
+	}
+
+	if (cluster_num == 1) {
+		(*chain)[0] = clu;
+		return cluster_num;
+	}
+
+	/* NO_FAT_CHAIN */
+	if (f->flags & ALLOC_NOFATCHAIN) {
+		for (i = 1; i < cluster_num; i++) {
+			if (exfat_load_bitmap(clu + i) != 1) {
+				pr_warn("cluster %u isn't allocated cluster.\n", (uint32_t)(clu + i));
+				break;
+			}
+		}
+		for (i = 0; i < cluster_num; i++)
+			(*chain)[i] = clu + i;
+		return cluster_num;
+	}
+
+	/* FAT_CHAIN */
+	if (!(cluster_num = exfat_resolve_chain(clu, cluster_num, *chain))) {
+		free(*chain);
+		*chain = NULL;
+	}
+	return cluster_num;
+}
+
 /**
  * exfat_concat_cluster - Contatenate cluster @data with next_cluster
  * @f:                    file information pointer
@@ -652,17 +766,16 @@ static uint32_t exfat_concat_cluster(struct exfat_fileinfo *f, uint32_t clu, voi
 {
 	int i;
 	void *tmp;
-	uint32_t next_clu = 0;
-	uint32_t fst_clu = clu;
+	uint32_t *chain;
 	size_t allocated = 1;
-	size_t cluster_num = ROUNDUP(f->datalen, info.cluster_size);
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
 
 	if (cluster_num <= 1)
 		return cluster_num;
 
 	/* NO_FAT_CHAIN */
 	if (f->flags & ALLOC_NOFATCHAIN) {
-		if (!(tmp = realloc(*data, info.cluster_size * cluster_num)))
+		if (!(tmp = realloc(*data, info->cluster_size * cluster_num)))
 			return 0;
 		*data = tmp;
 		for (i = 1; i < cluster_num; i++) {
@@ -671,31 +784,27 @@ static uint32_t exfat_concat_cluster(struct exfat_fileinfo *f, uint32_t clu, voi
 				break;
 			}
 		}
-		get_clusters(*data + info.cluster_size, clu + 1, cluster_num - 1);
+		get_clusters(*data + info->cluster_size, clu + 1, cluster_num - 1);
 		return cluster_num;
 	}
 
 	/* FAT_CHAIN */
-	for (allocated = 1; allocated < cluster_num; allocated++) { 
-		if (exfat_get_fat_entry(clu, &next_clu)) {
-			pr_warn("Invalid FAT entry[%u]: 0x%x.\n", clu, next_clu);
-			break;
-		}
-		if (next_clu == EXFAT_LASTCLUSTER)
-			break;
-		clu = next_clu;
+	if (!(chain = malloc(sizeof(uint32_t) * cluster_num)))
+		return 0;
+
+	if (!(allocated = exfat_resolve_chain(clu, cluster_num, chain))) {
+		free(chain);
+		return 0;
 	}
 
-	if (!(tmp = realloc(*data, info.cluster_size * allocated)))
+	if (!(tmp = realloc(*data, info->cluster_size * allocated))) {
+		free(chain);
 		return 0;
+	}
 	*data = tmp;
 
-	clu = fst_clu;
-	for (i = 0; i < allocated; i++) {
-		exfat_get_fat_entry(clu, &next_clu);
-		get_cluster(*data + info.cluster_size * i, clu);
-		clu = next_clu;
-	}
+	get_cluster_chain(*data, chain, allocated);
+	free(chain);
 
 	return allocated;
 }
@@ -711,9 +820,9 @@ static uint32_t exfat_concat_cluster(struct exfat_fileinfo *f, uint32_t clu, voi
  */
 static uint32_t exfat_set_cluster(struct exfat_fileinfo *f, uint32_t clu, void *data)
 {
-	uint32_t next_clu = 0;
+	uint32_t *chain;
 	size_t allocated = 0;
-	size_t cluster_num = ROUNDUP(f->datalen, info.cluster_size);
+	size_t cluster_num = ROUNDUP(f->datalen, info->cluster_size);
 
 	if (cluster_num <= 1) {
 		set_cluster(data, clu);
@@ -726,16 +835,14 @@ static uint32_t exfat_set_cluster(struct exfat_fileinfo *f, uint32_t clu, void *
 	}
 
 	/* FAT_CHAIN */
-	for (allocated = 0; allocated < cluster_num; allocated++) {
-		set_cluster(data + info.cluster_size * allocated, clu);
-		if (exfat_get_fat_entry(clu, &next_clu)) {
-			pr_warn("Invalid FAT entry[%u]: 0x%x.\n", clu, next_clu);
-			break;
-		}
-		clu = next_clu;
-	}
+	if (!(chain = malloc(sizeof(uint32_t) * cluster_num)))
+		return 0;
 
-	return allocated + 1;
+	allocated = exfat_resolve_chain(clu, cluster_num, chain);
+	set_cluster_chain(data, chain, allocated);
+	free(chain);
+
+	return allocated;
 }
 
 /*************************************************************************************************/
@@ -754,9 +861,9 @@ static void exfat_print_dchain(void)
 	node2_t *tmp;
 	struct exfat_fileinfo *f;
 
-	for (i = 0; i < info.root_size && info.root[i]; i++) {
-		tmp = info.root[i];
-		f = (struct exfat_fileinfo *)info.root[i]->data;
+	for (i = 0; i < info->root_size && info->root[i]; i++) {
+		tmp = info->root[i];
+		f = (struct exfat_fileinfo *)info->root[i]->data;
 		pr_msg("%-16s(%u) | ", f->name, tmp->index);
 		while (tmp->next != NULL) {
 			tmp = tmp->next;
@@ -779,8 +886,8 @@ static int exfat_check_dchain(uint32_t clu)
 {
 	int i;
 
-	for (i = 0; info.root[i] && i < info.root_size; i++) {
-		if (info.root[i]->index == clu)
+	for (i = 0; info->root[i] && i < info->root_size; i++) {
+		if (info->root[i]->index == clu)
 			return 1;
 	}
 	return 0;
@@ -797,19 +904,19 @@ static int exfat_get_index(uint32_t clu)
 {
 	int i;
 
-	for (i = 0; i < info.root_size && info.root[i]; i++) {
-		if (info.root[i]->index == clu)
+	for (i = 0; i < info->root_size && info->root[i]; i++) {
+		if (info->root[i]->index == clu)
 			return i;
 	}
 
-	info.root_size += DENTRY_LISTSIZE;
-	node2_t **tmp = realloc(info.root, sizeof(node2_t *) * info.root_size);
+	info->root_size += DENTRY_LISTSIZE;
+	node2_t **tmp = realloc(info->root, sizeof(node2_t *) * info->root_size);
 	if (tmp) {
-		info.root = tmp;
-		info.root[i] = NULL;
+		info->root = tmp;
+		info->root[i] = NULL;
 	} else {
 		pr_warn("Can't expand directory chain, so delete last chain.\n");
-		delete_node2(info.root[--i]);
+		delete_node2(info->root[--i]);
 	}
 
 	return i;
@@ -824,8 +931,8 @@ static int exfat_get_index(uint32_t clu)
 static int exfat_load_extra_entry(void)
 {
 	int i;
-	size_t index = exfat_get_index(info.root_offset);
-	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info.root[index]->data;
+	size_t index = exfat_get_index(info->root_offset);
+	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info->root[index]->data;
 	void *data;
 	struct exfat_dentry d;
 
@@ -834,10 +941,10 @@ static int exfat_load_extra_entry(void)
 		return 1;
 	}
 
-	data = malloc(info.cluster_size);
-	get_cluster(data, info.root_offset);
+	data = alloc_cluster();
+	get_cluster(data, info->root_offset);
 
-	for (i = 0; i < (info.cluster_size / sizeof(struct exfat_dentry)); i++) {
+	for (i = 0; i < (info->cluster_size / sizeof(struct exfat_dentry)); i++) {
 		d = ((struct exfat_dentry *)data)[i];
 		switch (d.EntryType) {
 			case DENTRY_BITMAP:
@@ -860,42 +967,56 @@ static int exfat_load_extra_entry(void)
 		}
 	}
 out:
-	free(data);
+	free_cluster(data);
 	return 0;
 }
 
 /**
- * exfat_traverse_directory - function to traverse one directory
- * @clu:                      index of the cluster want to check
+ * exfat_get_dentry - Get directory entry in directory being traversed
+ * @s:                cluster stream of the directory (NULL if @data is used)
+ * @data:             raw data of the directory
+ * @entries:          The number of entries in the directory
+ * @i:                index of the directory entry
  *
- * @return                     0 (success)
- *                            -1 (failed to read)
+ * @return            directory entry (valid until next call)
+ *                    empty entry (@i is out of the directory)
  */
-static int exfat_traverse_directory(uint32_t clu)
+static struct exfat_dentry *exfat_get_dentry(struct cluster_stream *s, void *data, size_t entries, size_t i)
+{
+	static struct exfat_dentry empty;
+	struct exfat_dentry *d;
+
+	if (i >= entries)
+		return &empty;
+
+	if (s)
+		d = read_cluster_stream(s, i * sizeof(struct exfat_dentry));
+	else
+		d = (struct exfat_dentry *)data + i;
+
+	return d ? d : &empty;
+}
+
+/**
+ * exfat_parse_directory - function to load directory entries of one directory
+ * @clu:                   index of the directory
+ * @s:                     cluster stream of the directory (NULL if @data is used)
+ * @data:                  raw data of the directory
+ * @entries:               The number of entries in the directory
+ *
+ * @return                  0 (success)
+ *                         -1 (directory is broken)
+ */
+static int exfat_parse_directory(uint32_t clu, struct cluster_stream *s, void *data, size_t entries)
 {
 	int i, j, name_len;
 	uint8_t remaining;
 	uint16_t uniname[MAX_NAME_LENGTH] = {0};
 	size_t index = exfat_get_index(clu);
-	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info.root[index]->data;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
-	size_t cluster_num = 1;
-	void *data;
 	struct exfat_dentry d, next, name;
 
-	if (f->cached) {
-		pr_debug("Directory %s was already traversed.\n", f->name);
-		return 0;
-	}
-
-	data = malloc(info.cluster_size);
-	get_cluster(data, clu);
-
-	cluster_num = exfat_concat_cluster(f, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
-
 	for (i = 0; i < entries; i++) {
-		d = ((struct exfat_dentry *)data)[i];
+		d = *exfat_get_dentry(s, data, entries, i);
 
 		switch (d.EntryType) {
 			case DENTRY_UNUSED:
@@ -912,20 +1033,20 @@ static int exfat_traverse_directory(uint32_t clu)
 			case DENTRY_FILE:
 				remaining = d.dentry.file.SecondaryCount;
 				/* Stream entry */
-				next = ((struct exfat_dentry *)data)[i + 1];
+				next = *exfat_get_dentry(s, data, entries, i + 1);
 				while ((!(next.EntryType & EXFAT_INUSE)) && (next.EntryType != DENTRY_UNUSED)) {
 					pr_debug("This entry was deleted (0x%x).\n", next.EntryType);
-					next = ((struct exfat_dentry *)data)[++i + 1];
+					next = *exfat_get_dentry(s, data, entries, ++i + 1);
 				}
 				if (next.EntryType != DENTRY_STREAM) {
 					pr_info("File should have stream entry, but This don't have.\n");
 					continue;
 				}
 				/* Filename entry */
-				name = ((struct exfat_dentry *)data)[i + 2];
+				name = *exfat_get_dentry(s, data, entries, i + 2);
 				while ((!(name.EntryType & EXFAT_INUSE)) && (name.EntryType != DENTRY_UNUSED)) {
 					pr_debug("This entry was deleted (0x%x).\n", name.EntryType);
-					name = ((struct exfat_dentry *)data)[++i + 2];
+					name = *exfat_get_dentry(s, data, entries, ++i + 2);
 				}
 				if (name.EntryType != DENTRY_NAME) {
 					pr_info("File should have name entry, but This don't have.\n");
@@ -936,23 +1057,148 @@ static int exfat_traverse_directory(uint32_t clu)
 					name_len = MIN(ENTRY_NAME_MAX,
 							next.dentry.stream.NameLength - j * ENTRY_NAME_MAX);
 					memcpy(uniname + j * ENTRY_NAME_MAX,
-							(((struct exfat_dentry *)data)[i + 2 + j]).dentry.name.FileName,
+							exfat_get_dentry(s, data, entries, i + 2 + j)->dentry.name.FileName,
 							name_len * sizeof(uint16_t));
 				}
 
-				exfat_create_fileinfo(info.root[index], clu,
+				exfat_create_fileinfo(info->root[index], clu,
 						&d, &next, uniname);
 				i += remaining;
 				break;
 		}
 	}
-	free(data);
 
 	exfat_print_dchain();
 
 	return 0;
 }
 
+/**
+ * exfat_traverse_directory - function to traverse one directory
+ * @clu:                      index of the cluster want to check
+ *
+ * @return                     0 (success)
+ *                            -1 (failed to read)
+ */
+static int exfat_traverse_directory(uint32_t clu)
+{
+	int ret;
+	size_t index = exfat_get_index(clu);
+	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info->root[index]->data;
+	size_t cluster_num;
+	uint32_t *chain;
+	struct cluster_stream s;
+
+	if (f->cached) {
+		pr_debug("Directory %s was already traversed.\n", f->name);
+		return 0;
+	}
+
+	cluster_num = exfat_get_chain(f, clu, &chain);
+	if (open_cluster_stream(&s, chain, cluster_num)) {
+		free(chain);
+		return -1;
+	}
+
+	ret = exfat_parse_directory(clu, &s, NULL,
+			(cluster_num * info->cluster_size) / sizeof(struct exfat_dentry));
+	close_cluster_stream(&s);
+	free(chain);
+
+	return ret;
+}
+
+/**
+ * exfat_load_directories - function to read several directories in one batch
+ * @clu:                    index list of the directories
+ * @chain:                  cluster index list of each directory
+ * @num:                    The number of clusters in each directory
+ * @count:                  The number of directories
+ */
+static void exfat_load_directories(uint32_t *clu, uint32_t **chain, size_t *num, size_t count)
+{
+	size_t i, offset = 0;
+	void *data;
+
+	if (!(data = get_cluster_chains(chain, num, count))) {
+		for (i = 0; i < count; i++)
+			exfat_traverse_directory(clu[i]);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		exfat_parse_directory(clu[i], NULL, data + offset,
+				(num[i] * info->cluster_size) / sizeof(struct exfat_dentry));
+		offset += num[i] * info->cluster_size;
+	}
+	free(data);
+}
+
+/**
+ * exfat_traverse_directories - function to traverse directories in directory chain
+ * @start:                      first index in directory chain
+ *
+ * @return                      index after the last directory (directories found are from here)
+ *
+ * NOTE: Clusters of directories which aren't traversed yet are read in one batch
+ *       up to DIRECTORY_BATCH_MAX bytes, instead of one directory after another.
+ */
+static size_t exfat_traverse_directories(size_t start)
+{
+	size_t i, j, end, count = 0, total = 0;
+	size_t *num = NULL;
+	uint32_t *clu = NULL, **chain = NULL;
+	struct exfat_fileinfo *f;
+
+	for (end = start; end < info->root_size && info->root[end]; end++)
+		;
+
+	if (!(clu = malloc(sizeof(uint32_t) * (end - start))) ||
+			!(chain = malloc(sizeof(uint32_t *) * (end - start))) ||
+			!(num = malloc(sizeof(size_t) * (end - start)))) {
+		for (i = start; i < end; i++)
+			exfat_traverse_directory(info->root[i]->index);
+		goto out;
+	}
+
+	for (i = start; i < end; i++) {
+		clu[count] = info->root[i]->index;
+		f = (struct exfat_fileinfo *)info->root[i]->data;
+		if (f->cached)
+			continue;
+
+		if (!(num[count] = exfat_get_chain(f, clu[count], &chain[count])))
+			continue;
+		if (num[count] * info->cluster_size > DIRECTORY_BATCH_MAX) {
+			free(chain[count]);
+			exfat_traverse_directory(clu[count]);
+			continue;
+		}
+
+		/* Batch is full, so read it before this directory */
+		if ((total + num[count]) * info->cluster_size > DIRECTORY_BATCH_MAX) {
+			exfat_load_directories(clu, chain, num, count);
+			for (j = 0; j < count; j++)
+				free(chain[j]);
+			clu[0] = clu[count];
+			chain[0] = chain[count];
+			num[0] = num[count];
+			count = total = 0;
+		}
+		total += num[count++];
+	}
+	if (count)
+		exfat_load_directories(clu, chain, num, count);
+	for (j = 0; j < count; j++)
+		free(chain[j]);
+
+out:
+	free(num);
+	free(chain);
+	free(clu);
+	return end;
+}
+
 /**
  * exfat_clean_dchain - function to clean opeartions
  * @index:              directory chain index
@@ -965,12 +1211,12 @@ static int exfat_clean_dchain(uint32_t index)
 	node2_t *tmp;
 	struct exfat_fileinfo *f;
 
-	if ((!info.root[index])) {
+	if ((!info->root[index])) {
 		pr_warn("index %d was already released.\n", index);
 		return -1;
 	}
 
-	tmp = info.root[index];
+	tmp = info->root[index];
 
 	while (tmp->next != NULL) {
 		tmp = tmp->next;
@@ -978,7 +1224,7 @@ static int exfat_clean_dchain(uint32_t index)
 		free(f->name);
 		f->name = NULL;
 	}
-	free_list2(info.root[index]);
+	free_list2(info->root[index]);
 	return 0;
 }
 
@@ -1020,7 +1266,8 @@ static struct exfat_fileinfo *exfat_search_fileinfo(node2_t *node, const char *n
 static void exfat_create_fileinfo(node2_t *head, uint32_t clu,
 		struct exfat_dentry *file, struct exfat_dentry *stream, uint16_t *uniname)
 {
-	int index, next_index = stream->dentry.stream.FirstCluster;
+	int index;
+	uint32_t next_index = stream->dentry.stream.FirstCluster;
 	struct exfat_fileinfo *f;
 	size_t namelen = stream->dentry.stream.NameLength;
 
@@ -1064,7 +1311,7 @@ static void exfat_create_fileinfo(node2_t *head, uint32_t clu,
 		d->dir = head->data;
 
 		index = exfat_get_index(next_index);
-		info.root[index] = init_node2(next_index, d);
+		info->root[index] = init_node2(next_index, d);
 	}
 }
 
@@ -1227,15 +1474,15 @@ static int exfat_check_dir_empty(struct exfat_fileinfo *f, uint32_t clu)
 	int ret = 0;
 	int i;
 	void *data;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
+	size_t entries = info->cluster_size / sizeof(struct exfat_dentry);
 	size_t cluster_num = 1;
 	struct exfat_dentry *d;
 
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, clu);
 
 	cluster_num = exfat_concat_cluster(f, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+	entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 
 	for (i = 0; i < entries; i++) {
 		d = ((struct exfat_dentry *)data) + i;
@@ -1271,8 +1518,8 @@ int exfat_add_entry(const char *name, uint32_t clu, uint8_t type)
 	uint8_t len;
 	uint8_t count;
 	size_t index = exfat_get_index(clu);
-	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info.root[index]->data;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
+	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info->root[index]->data;
+	size_t entries = info->cluster_size / sizeof(struct exfat_dentry);
 	size_t cluster_num = 1;
 	size_t new_cluster_num = 1;
 	size_t name_len;
@@ -1284,17 +1531,17 @@ int exfat_add_entry(const char *name, uint32_t clu, uint8_t type)
 	count = ROUNDUP(len, ENTRY_NAME_MAX) + 1;
 
 	/* Prohibit duplicate filename */
-	if (exfat_search_fileinfo(info.root[index], name)) {
+	if (exfat_search_fileinfo(info->root[index], name)) {
 		pr_err("cannot create %s: File exists\n", name);
 		return -1;
 	}
 
 	/* Lookup last entry */
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, clu);
 
 	cluster_num = exfat_concat_cluster(f, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+	entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 
 	for (i = 0; i < entries; i++) {
 		d = ((struct exfat_dentry *)data) + i;
@@ -1302,11 +1549,11 @@ int exfat_add_entry(const char *name, uint32_t clu, uint8_t type)
 			break;
 	}
 
-	new_cluster_num = ROUNDUP(((i + count + 2) * sizeof(struct exfat_dentry)), info.cluster_size);
+	new_cluster_num = ROUNDUP(((i + count + 2) * sizeof(struct exfat_dentry)), info->cluster_size);
 	if (new_cluster_num > cluster_num) {
 		exfat_alloc_clusters(f, clu, new_cluster_num - cluster_num);
 		cluster_num = exfat_concat_cluster(f, clu, &data);
-		entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+		entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 		d = ((struct exfat_dentry *)data) + i;
 	}
 
@@ -1355,13 +1602,13 @@ int exfat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 	uint16_t namehash = 0;
 	uint8_t remaining;
 	size_t index = exfat_get_index(clu);
-	struct exfat_fileinfo *dir = (struct exfat_fileinfo *)info.root[index]->data;
+	struct exfat_fileinfo *dir = (struct exfat_fileinfo *)info->root[index]->data;
 	struct exfat_fileinfo *file;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
+	size_t entries = info->cluster_size / sizeof(struct exfat_dentry);
 	size_t cluster_num = 1;
 	struct exfat_dentry *d, *s, *n;
 
-	if ((file = exfat_search_fileinfo(info.root[exfat_get_index(clu)], name)) == NULL) {
+	if ((file = exfat_search_fileinfo(info->root[exfat_get_index(clu)], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
@@ -1383,11 +1630,11 @@ int exfat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 	namehash = exfat_calculate_namehash(uppername, name_len);
 
 	/* Lookup last entry */
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, clu);
 
 	cluster_num = exfat_concat_cluster(dir, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+	entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 
 	for (i = 0; i < entries; i++) {
 		d = ((struct exfat_dentry *)data) + i;
@@ -1445,7 +1692,7 @@ int exfat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 		}
 	}
 out:
-	exfat_free_clusters(file, file->clu, ROUNDUP(file->datalen, info.cluster_size));
+	exfat_free_clusters(file, file->clu, ROUNDUP(file->datalen, info->cluster_size));
 	exfat_clean_dchain(clu);
 	exfat_set_cluster(dir, clu, data);
 	free(data);
@@ -1469,7 +1716,7 @@ static int exfat_update_filesize(struct exfat_fileinfo *f, uint32_t clu)
 	struct exfat_dentry *d;
 	void *data;
 
-	if (clu == info.root_offset)
+	if (clu == info->root_offset)
 		return 0;
 
 	if (!f->dir) {
@@ -1480,12 +1727,12 @@ static int exfat_update_filesize(struct exfat_fileinfo *f, uint32_t clu)
 	dir = f->dir;
 	parent_clu = dir->clu;
 
-	cluster_num = ROUNDUP(dir->datalen, info.cluster_size);
-	data = malloc(info.cluster_size);
+	cluster_num = ROUNDUP(dir->datalen, info->cluster_size);
+	data = alloc_cluster();
 
 	for (i = 0; i < cluster_num; i++) {
 		get_cluster(data, parent_clu);
-		for (j = 0; j < (info.cluster_size / sizeof(struct exfat_dentry)); j++) {
+		for (j = 0; j < (info->cluster_size / sizeof(struct exfat_dentry)); j++) {
 			d = ((struct exfat_dentry *)data) + j;
 			if (d->EntryType == DENTRY_STREAM && d->dentry.stream.FirstCluster == clu) {
 				d->dentry.stream.DataLength = f->datalen;
@@ -1505,7 +1752,7 @@ static int exfat_update_filesize(struct exfat_fileinfo *f, uint32_t clu)
 	parent_clu = 0;
 out:
 	set_cluster(data, parent_clu);
-	free(data);
+	free_cluster(data);
 	return 0;
 }
 
@@ -1660,7 +1907,7 @@ static void exfat_convert_uniname(uint16_t *uniname, uint64_t name_len, unsigned
  */
 static uint16_t exfat_convert_upper(uint16_t c)
 {
-	return info.upcase_table[c] ? info.upcase_table[c] : c;
+	return info->upcase_table[c] ? info->upcase_table[c] : c;
 }
 
 /**
@@ -1673,7 +1920,7 @@ static void exfat_convert_upper_character(uint16_t *src, size_t len, uint16_t *d
 {
 	int i;
 
-	if (!info.upcase_table || (info.upcase_size == 0))
+	if (!info->upcase_table || (info->upcase_size == 0))
 		exfat_load_extra_entry();
 
 	for (i = 0; i < len; i++)
@@ -1696,15 +1943,15 @@ int exfat_print_bootsec(void)
 	struct exfat_bootsec *b = malloc(sizeof(struct exfat_bootsec));
 
 	exfat_load_bootsec(b);
-	pr_msg("Sector size:     \t%zu\n", info.sector_size);
-	pr_msg("Cluster size:    \t%zu\n", info.cluster_size);
+	pr_msg("Sector size:     \t%zu\n", info->sector_size);
+	pr_msg("Cluster size:    \t%zu\n", info->cluster_size);
 	pr_msg("FAT offset:      \t%u\n", b->FatOffset);
-	pr_msg("FAT size:        \t%zu\n", b->FatLength * info.sector_size);
+	pr_msg("FAT size:        \t%zu\n", b->FatLength * info->sector_size);
 	pr_msg("FAT count:       \t%u\n", b->NumberOfFats);
 
-	pr_msg("Partition offset:\t%" PRIu64 "\n", b->PartitionOffset * info.sector_size);
-	pr_msg("Volume size:     \t%" PRIu64 "\n", b->VolumeLength * info.sector_size);
-	pr_msg("Cluster offset:  \t%zu\n", b->ClusterHeapOffset * info.sector_size);
+	pr_msg("Partition offset:\t%" PRIu64 "\n", b->PartitionOffset * info->sector_size);
+	pr_msg("Volume size:     \t%" PRIu64 "\n", b->VolumeLength * info->sector_size);
+	pr_msg("Cluster offset:  \t%zu\n", b->ClusterHeapOffset * info->sector_size);
 	pr_msg("Cluster count:   \t%u\n", b->ClusterCount);
 	pr_msg("First cluster:   \t%u\n", b->FirstClusterOfRootDirectory);
 	pr_msg("Volume serial:   \t0x%x\n", b->VolumeSerialNumber);
@@ -1729,6 +1976,9 @@ int exfat_print_fsinfo(void)
 	exfat_print_label();
 	exfat_print_fat();
 	exfat_print_bitmap();
+
+	/* Whole FAT has been read only for this dump */
+	advise_access(info->fat_offset * info->sector_size, info->fat_length, ACCESS_ONCE);
 	return 0;
 }
 
@@ -1758,8 +2008,8 @@ int exfat_lookup(uint32_t clu, char *name)
 	/* Absolute path */
 	if (name[0] == '/') {
 		pr_debug("\"%s\" is Absolute path, so change current directory(%u) to root(%u)\n",
-				name, clu, info.root_offset);
-		clu = info.root_offset;
+				name, clu, info->root_offset);
+		clu = info->root_offset;
 	}
 
 	/* Separate pathname by slash */
@@ -1777,18 +2027,18 @@ int exfat_lookup(uint32_t clu, char *name)
 		pr_debug("Lookup %s to %d\n", path[i], clu);
 		found = false;
 		index = exfat_get_index(clu);
-		f = (struct exfat_fileinfo *)info.root[index]->data;
-		if ((!info.root[index]) || (!(f->cached))) {
+		f = (struct exfat_fileinfo *)info->root[index]->data;
+		if ((!info->root[index]) || (!(f->cached))) {
 			pr_debug("Directory hasn't load yet, or This Directory doesn't exist in filesystem.\n");
 			exfat_traverse_directory(clu);
 			index = exfat_get_index(clu);
-			if (!info.root[index]) {
+			if (!info->root[index]) {
 				pr_warn("This Directory doesn't exist in filesystem.\n");
 				return -1;
 			}
 		}
 
-		tmp = info.root[index];
+		tmp = info->root[index];
 		while (tmp->next != NULL) {
 			tmp = tmp->next;
 			f = (struct exfat_fileinfo *)tmp->data;
@@ -1825,7 +2075,7 @@ int exfat_readdir(struct directory *dir, size_t count, uint32_t clu)
 
 	exfat_traverse_directory(clu);
 	i = exfat_get_index(clu);
-	tmp = info.root[i];
+	tmp = info->root[i];
 
 	for (i = 0; i < count && tmp->next != NULL; i++) {
 		tmp = tmp->next;
@@ -1860,7 +2110,7 @@ int exfat_reload_directory(uint32_t clu)
 	struct exfat_fileinfo *f = NULL;
 
 	exfat_clean_dchain(index);
-	f = ((struct exfat_fileinfo *)(info.root[index])->data);
+	f = ((struct exfat_fileinfo *)(info->root[index])->data);
 	f->cached = 0;
 	return exfat_traverse_directory(clu);
 }
@@ -1881,7 +2131,7 @@ int exfat_convert_character(const char *src, size_t len, char *dist)
 	uint16_t *utf16_src;
 	uint16_t *utf16_upper;
 
-	if (!info.upcase_table || (info.upcase_size == 0)) {
+	if (!info->upcase_table || (info->upcase_size == 0)) {
 		pr_err("This exFAT filesystem doesn't have upcase-table.\n");
 		return -1;
 	}
@@ -1893,10 +2143,10 @@ int exfat_convert_character(const char *src, size_t len, char *dist)
 	/* convert UTF-16 char to UTF-16 only upper letter char */
 	utf16_upper = malloc(sizeof(uint16_t) * utf16_len);
 	for (i = 0; i < utf16_len; i++) {
-		if (utf16_src[i] > info.upcase_size)
+		if (utf16_src[i] > info->upcase_size)
 			utf16_upper[i] = utf16_src[i];
 		else
-			utf16_upper[i] = info.upcase_table[utf16_src[i]];
+			utf16_upper[i] = info->upcase_table[utf16_src[i]];
 	}
 
 	/* convert UTF-16 to convert UTF-8 */
@@ -1920,12 +2170,12 @@ int exfat_clean(uint32_t index)
 	node2_t *tmp;
 	struct exfat_fileinfo *f;
 
-	if ((!info.root[index])) {
+	if ((!info->root[index])) {
 		pr_warn("index %d was already released.\n", index);
 		return -1;
 	}
 
-	tmp = info.root[index];
+	tmp = info->root[index];
 	f = (struct exfat_fileinfo *)tmp->data;
 	free(f->name);
 	f->name = NULL;
@@ -1946,12 +2196,12 @@ int exfat_clean(uint32_t index)
 int exfat_set_fat_entry(uint32_t clu, uint32_t entry)
 {
 	uint32_t ret;
-	size_t entry_per_sector = info.sector_size / sizeof(uint32_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
+	size_t entry_per_sector = info->sector_size / sizeof(uint32_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
 	uint32_t *fat;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
+	fat = alloc_sector();
 	get_sector(fat, fat_index, 1);
 
 	ret = fat[offset];
@@ -1960,7 +2210,7 @@ int exfat_set_fat_entry(uint32_t clu, uint32_t entry)
 	set_sector(fat, fat_index, 1);
 	pr_debug("Rewrite Entry(%u) 0x%x to 0x%x.\n", clu, ret, fat[offset]);
 
-	free(fat);
+	free_sector(fat);
 
 	return 0;
 }
@@ -1975,18 +2225,20 @@ int exfat_set_fat_entry(uint32_t clu, uint32_t entry)
  */
 int exfat_get_fat_entry(uint32_t clu, uint32_t *entry)
 {
-	size_t entry_per_sector = info.sector_size / sizeof(uint32_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
-	uint32_t *fat;
+	size_t entry_per_sector = info->sector_size / sizeof(uint32_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
+	uint32_t *fat, *buf = NULL;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
-	get_sector(fat, fat_index, 1);
+	if (!(fat = map_sector(fat_index, 1))) {
+		fat = buf = alloc_sector();
+		get_sector(fat, fat_index, 1);
+	}
 	/* validate index */
 	*entry = fat[offset];
 	pr_debug("Get FAT entry(%u) 0x%x.\n", clu, fat[offset]);
 
-	free(fat);
+	free_sector(buf);
 
 	return !exfat_validate_fat_entry(*entry);
 }
@@ -2005,7 +2257,7 @@ int exfat_validate_fat_entry(uint32_t clu)
 	if (!exfat_load_bitmap(clu))
 		is_valid = 0;
 
-	if (EXFAT_FIRST_CLUSTER <= clu && clu <= info.cluster_count + 1)
+	if (EXFAT_FIRST_CLUSTER <= clu && clu <= info->cluster_count + 1)
 		is_valid = 1;
 	else if (clu == EXFAT_BADCLUSTER)
 		is_valid = 0;
@@ -2109,18 +2361,18 @@ int exfat_trim(uint32_t clu)
 	uint8_t used = 0;
 	void *data;
 	size_t index = exfat_get_index(clu);
-	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info.root[index]->data;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
+	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info->root[index]->data;
+	size_t entries = info->cluster_size / sizeof(struct exfat_dentry);
 	size_t cluster_num = 1;
 	size_t allocate_cluster = 1;
 	struct exfat_dentry *src, *dist;
 
 	/* Lookup last entry */
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, clu);
 
 	cluster_num = exfat_concat_cluster(f, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+	entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 
 	for (i = 0, j = 0; i < entries; i++) {
 		src = ((struct exfat_dentry *)data) + i;
@@ -2136,7 +2388,7 @@ int exfat_trim(uint32_t clu)
 			memcpy(dist, src, sizeof(struct exfat_dentry));
 	}
 
-	allocate_cluster = ROUNDUP((sizeof(struct exfat_dentry) * j), info.cluster_size);
+	allocate_cluster = ROUNDUP((sizeof(struct exfat_dentry) * j), info->cluster_size);
 	while (j < entries) {
 		dist = ((struct exfat_dentry *)data) + j++;
 		memset(dist, 0, sizeof(struct exfat_dentry));
@@ -2164,8 +2416,8 @@ int exfat_fill(uint32_t clu, uint32_t count)
 	uint16_t uppername[MAX_NAME_LENGTH] = {0};
 	uint8_t len;
 	size_t index = exfat_get_index(clu);
-	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info.root[index]->data;
-	size_t entries = info.cluster_size / sizeof(struct exfat_dentry);
+	struct exfat_fileinfo *f = (struct exfat_fileinfo *)info->root[index]->data;
+	size_t entries = info->cluster_size / sizeof(struct exfat_dentry);
 	size_t cluster_num = 1;
 	size_t new_cluster_num = 1;
 	const size_t minimum_dentries = 3;
@@ -2174,11 +2426,11 @@ int exfat_fill(uint32_t clu, uint32_t count)
 	struct exfat_dentry *d;
 
 	/* Lookup last entry */
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, clu);
 
 	cluster_num = exfat_concat_cluster(f, clu, &data);
-	entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+	entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 
 	for (i = 0; i < entries; i++) {
 		d = ((struct exfat_dentry *)data) + i;
@@ -2193,12 +2445,12 @@ int exfat_fill(uint32_t clu, uint32_t count)
 	}
 
 	need_entries = count - i;
-	new_cluster_num = ((count * sizeof(struct exfat_dentry) + info.cluster_size - 1 )/ info.cluster_size);
+	new_cluster_num = ((count * sizeof(struct exfat_dentry) + info->cluster_size - 1 )/ info->cluster_size);
 
 	if (new_cluster_num > cluster_num) {
 		exfat_alloc_clusters(f, clu, new_cluster_num - cluster_num);
 		cluster_num = exfat_concat_cluster(f, clu, &data);
-		entries = (cluster_num * info.cluster_size) / sizeof(struct exfat_dentry);
+		entries = (cluster_num * info->cluster_size) / sizeof(struct exfat_dentry);
 	}
 
 	for (blank_entries = need_entries % minimum_dentries; blank_entries > 0; blank_entries--) {
@@ -2248,12 +2500,12 @@ int exfat_contents(const char *name, uint32_t clu)
 	struct exfat_fileinfo *f;
 
 	index = exfat_get_index(clu);
-	if ((f = exfat_search_fileinfo(info.root[index], name)) == NULL) {
+	if ((f = exfat_search_fileinfo(info->root[index], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
 
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, f->clu);
 	cluster_num = exfat_concat_cluster(f, f->clu, &data);
 	if (!cluster_num) {
@@ -2296,14 +2548,14 @@ int exfat_stat(const char *name, uint32_t clu)
 	struct exfat_fileinfo *f;
 
 	index = exfat_get_index(clu);
-	if ((f = exfat_search_fileinfo(info.root[index], name)) == NULL) {
+	if ((f = exfat_search_fileinfo(info->root[index], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
 
 	pr_msg("File Name:   %s\n", f->name);
 	pr_msg("File Size:   %zu\n", f->datalen);
-	pr_msg("Clusters:    %zu\n", ROUNDUP(f->datalen, info.cluster_size));
+	pr_msg("Clusters:    %zu\n", ROUNDUP(f->datalen, info->cluster_size));
 	pr_msg("First Clu:   %u\n", f->clu);
 
 	pr_msg("File Attr:   %c%c%c%c%c\n", f->attr & ATTR_READ_ONLY ? 'R' : '-',
@@ -2329,3 +2581,79 @@ int exfat_stat(const char *name, uint32_t clu)
 	return 0;
 }
 
+/**
+ * exfat_free_run - function interface to search free clusters in a row
+ * @clu:            cluster index to start searching (Input/Output)
+ * @len:            number of free clusters (Output)
+ *
+ * @return           0 (Success)
+ *                  -1 (No more free cluster)
+ */
+int exfat_free_run(uint32_t *clu, uint32_t *len)
+{
+	uint32_t i;
+
+	*len = 0;
+	for (i = MAX(*clu, EXFAT_FIRST_CLUSTER); i < info->cluster_count; i++) {
+		if (exfat_load_bitmap(i)) {
+			if (*len)
+				break;
+			continue;
+		}
+
+		if (!(*len)++)
+			*clu = i;
+	}
+
+	return *len ? 0 : -1;
+}
+
+/**
+ * exfat_metadata - function interface to list clusters of filesystem metadata
+ * @add:            function to add clusters to list
+ *
+ * @return           0 (Success)
+ *                  -1 (Failed to add)
+ *
+ * NOTE: Allocation bitmap, Up-case table and all directories reachable
+ *       from root directory are listed.
+ */
+int exfat_metadata(metadata_add_t add)
+{
+	int ret = 0;
+	size_t i, j, num, next = 0;
+	uint32_t clu, *chain;
+	struct exfat_dentry *d;
+	struct exfat_fileinfo *f;
+	void *data;
+
+	/* Allocation bitmap and Up-case table are pointed from root directory */
+	data = alloc_cluster();
+	get_cluster(data, info->root_offset);
+	for (i = 0; i < (info->cluster_size / sizeof(struct exfat_dentry)) && !ret; i++) {
+		d = ((struct exfat_dentry *)data) + i;
+		if (d->EntryType == DENTRY_BITMAP)
+			ret = add(d->dentry.bitmap.FirstCluster,
+					ROUNDUP(d->dentry.bitmap.DataLength, info->cluster_size));
+		else if (d->EntryType == DENTRY_UPCASE)
+			ret = add(d->dentry.upcase.FirstCluster,
+					ROUNDUP(d->dentry.upcase.DataLength, info->cluster_size));
+	}
+	free_cluster(data);
+
+	/* Traversal appends subdirectories to directory chain */
+	for (i = 0; i < info->root_size && info->root[i] && !ret; i++) {
+		/* Directories found by previous traversal are traversed together */
+		if (i == next)
+			next = exfat_traverse_directories(i);
+
+		clu = info->root[i]->index;
+		f = (struct exfat_fileinfo *)info->root[i]->data;
+
+		num = exfat_get_chain(f, clu, &chain);
+		for (j = 0; j < num && !ret; j++)
+			ret = add(chain[j], 1);
+		free(chain);
+	}
+	return ret;
+}
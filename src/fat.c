@@ -22,6 +22,7 @@ static int fat32_print_fsinfo(struct fat32_fsinfo *);
 static int fat12_set_fat_entry(uint32_t, uint32_t);
 static int fat16_set_fat_entry(uint32_t, uint32_t);
 static int fat32_set_fat_entry(uint32_t, uint32_t);
+static off_t fat_entry_offset(uint32_t);
 static uint32_t fat12_get_fat_entry(uint32_t);
 static uint32_t fat16_get_fat_entry(uint32_t);
 static uint32_t fat32_get_fat_entry(uint32_t);
@@ -32,6 +33,7 @@ static int fat_get_last_cluster(struct fat_fileinfo *, uint32_t);
 static int fat_alloc_clusters(struct fat_fileinfo *, uint32_t, size_t);
 static int fat_free_clusters(struct fat_fileinfo *, uint32_t, size_t);
 static int fat_new_clusters(size_t);
+static size_t fat_resolve_chain(uint32_t, uint32_t **);
 static uint32_t fat_concat_cluster(struct fat_fileinfo *, uint32_t, void **);
 static uint32_t fat_set_cluster(struct fat_fileinfo *, uint32_t, void *);
 
@@ -39,6 +41,7 @@ static uint32_t fat_set_cluster(struct fat_fileinfo *, uint32_t, void *);
 static int fat_check_dchain(uint32_t);
 static int fat_get_index(uint32_t);
 static int fat_traverse_directory(uint32_t);
+static size_t fat_traverse_directories(size_t);
 int fat_clean_dchain(uint32_t);
 static struct fat_fileinfo *fat_search_fileinfo(node2_t *, const char *);
 static void fat_create_fileinfo(node2_t *, uint32_t, struct fat_dentry *, uint16_t *, size_t);
@@ -85,6 +88,8 @@ int fat_trim(uint32_t);
 int fat_fill(uint32_t, uint32_t);
 int fat_contents(const char *, uint32_t);
 int fat_stat(const char *, uint32_t);
+int fat_free_run(uint32_t *, uint32_t *);
+int fat_metadata(metadata_add_t);
 
 static const struct operations fat_ops = {
 	.statfs = fat_print_bootsec,
@@ -107,11 +112,10 @@ static const struct operations fat_ops = {
 	.fill = fat_fill,
 	.contents = fat_contents,
 	.stat = fat_stat,
+	.freerun = fat_free_run,
+	.metadata = fat_metadata,
 };
 
-static uint32_t BAD_CLUSTER = 0;
-static uint32_t LAST_CLUSTER = 0;
-
 /*************************************************************************************************/
 /*                                                                                               */
 /* GENERIC FUNCTION                                                                              */
@@ -155,41 +159,41 @@ int fat_check_filesystem(struct pseudo_bootsec *boot)
 	CountofClusters = DataSec / b->BPB_SecPerClus;
 
 	if (CountofClusters < FAT16_CLUSTERS - 1) {
-		info.fstype = FAT12_FILESYSTEM;
-		BAD_CLUSTER = FAT12_BADCLUSTER;
-		LAST_CLUSTER = FAT12_LASTCLUSTER;
+		info->fstype = FAT12_FILESYSTEM;
+		info->bad_cluster = FAT12_BADCLUSTER;
+		info->last_cluster = FAT12_LASTCLUSTER;
 	} else if (CountofClusters < FAT32_CLUSTERS - 1) {
-		info.fstype = FAT16_FILESYSTEM;
-		BAD_CLUSTER = FAT16_BADCLUSTER;
-		LAST_CLUSTER = FAT16_LASTCLUSTER;
+		info->fstype = FAT16_FILESYSTEM;
+		info->bad_cluster = FAT16_BADCLUSTER;
+		info->last_cluster = FAT16_LASTCLUSTER;
 	} else {
-		info.fstype = FAT32_FILESYSTEM;
-		BAD_CLUSTER = FAT32_BADCLUSTER;
-		LAST_CLUSTER = FAT32_LASTCLUSTER;
-	}
-
-	info.sector_size = b->BPB_BytesPerSec;
-	info.cluster_size = b->BPB_SecPerClus * b->BPB_BytesPerSec;
-	info.cluster_count = CountofClusters;
-	info.fat_offset = b->BPB_RevdSecCnt;
-	info.fat_length = b->BPB_NumFATs * FATSz;
-	info.heap_offset = (b->BPB_RevdSecCnt + info.fat_length) + RootDirSectors;
-	if (info.fstype == FAT32_FILESYSTEM) {
-		info.root_offset = b->reserved_info.fat32_reserved_info.BPB_RootClus;
-		info.root_length = info.cluster_size;
+		info->fstype = FAT32_FILESYSTEM;
+		info->bad_cluster = FAT32_BADCLUSTER;
+		info->last_cluster = FAT32_LASTCLUSTER;
+	}
+
+	info->sector_size = b->BPB_BytesPerSec;
+	info->cluster_size = b->BPB_SecPerClus * b->BPB_BytesPerSec;
+	info->cluster_count = CountofClusters;
+	info->fat_offset = b->BPB_RevdSecCnt;
+	info->fat_length = b->BPB_NumFATs * FATSz;
+	info->heap_offset = (b->BPB_RevdSecCnt + info->fat_length) + RootDirSectors;
+	if (info->fstype == FAT32_FILESYSTEM) {
+		info->root_offset = b->reserved_info.fat32_reserved_info.BPB_RootClus;
+		info->root_length = info->cluster_size;
 	} else {
-		info.root_offset = 0;
-		info.root_length = (32 * b->BPB_RootEntCnt + b->BPB_BytesPerSec - 1) / b->BPB_BytesPerSec;
+		info->root_offset = 0;
+		info->root_length = (32 * b->BPB_RootEntCnt + b->BPB_BytesPerSec - 1) / b->BPB_BytesPerSec;
 	}
 
-	f = malloc(sizeof(struct fat_fileinfo));
+	f = calloc(1, sizeof(struct fat_fileinfo));
 	strncpy((char *)f->name, "/", strlen("/") + 1);
 	f->uniname = NULL;
 	f->namelen = 1;
 	f->datalen = 0;
 	f->attr = ATTR_DIRECTORY;
-	info.root[0] = init_node2(info.root_offset, f);
-	info.ops = &fat_ops;
+	info->root[0] = init_node2(info->root_offset, f);
+	info->ops = &fat_ops;
 	return 1;
 }
 
@@ -216,10 +220,34 @@ static int fat_load_bootsec(struct fat_bootsec *b)
 static int fat_print_label(void)
 {
 	pr_msg("volume Label: ");
-	pr_msg("%s\n", (char *)info.vol_label);
+	pr_msg("%s\n", (char *)info->vol_label);
 	return 0;
 }
 
+/**
+ * fat_entry_offset - Get byte offset of FAT entry
+ * @clu:              index of the cluster
+ *
+ * @return            Start bytes of FAT entry in first FAT
+ */
+static off_t fat_entry_offset(uint32_t clu)
+{
+	off_t offset;
+
+	switch (info->fstype) {
+		case FAT12_FILESYSTEM:
+			offset = clu + (clu / 2);
+			break;
+		case FAT16_FILESYSTEM:
+			offset = clu * sizeof(uint16_t);
+			break;
+		default:
+			offset = clu * sizeof(uint32_t);
+			break;
+	}
+	return info->fat_offset * info->sector_size + offset;
+}
+
 /**
  * fat_print_fat - print FAT
  */
@@ -227,22 +255,34 @@ static void fat_print_fat(void)
 {
 	uint32_t i;
 	uint32_t offset;
+	off_t data;
+	size_t entry_size = (info->fstype == FAT32_FILESYSTEM) ? sizeof(uint32_t) : sizeof(uint16_t);
 	bitmap_t b;
 
-	init_bitmap(&b, info.cluster_count);
+	init_bitmap(&b, info->cluster_count);
+	advise_access(info->fat_offset * info->sector_size, info->fat_length * info->sector_size, ACCESS_SEQUENTIAL);
 
 
-	for (i = FAT_FSTCLUSTER; i < info.cluster_count; i++) {
+	for (i = FAT_FSTCLUSTER; i < info->cluster_count; i++) {
 		if (get_bitmap(&b, i))
 			continue;
 
+		/* FAT entries in hole are all free, so they can be skipped */
+		if (is_hole(fat_entry_offset(i), entry_size)) {
+			data = find_data(fat_entry_offset(i));
+			for (; i < info->cluster_count && fat_entry_offset(i) + entry_size <= data; i++)
+				set_bitmap(&b, i);
+			i--;
+			continue;
+		}
+
 		fat_get_fat_entry(i, &offset);
 		if (!offset) {
 			set_bitmap(&b, i);
 			continue;
 		}
 
-		if (offset >= FAT_FSTCLUSTER && offset < info.cluster_count) {
+		if (offset >= FAT_FSTCLUSTER && offset < info->cluster_count) {
 			set_bitmap(&b, offset);
 			unset_bitmap(&b, i);
 		} else {
@@ -251,7 +291,7 @@ static void fat_print_fat(void)
 	}
 
 	pr_msg("FAT:\n");
-	for (i = FAT_FSTCLUSTER; i < info.cluster_count; i++) {
+	for (i = FAT_FSTCLUSTER; i < info->cluster_count; i++) {
 		if (get_bitmap(&b, i))
 			continue;
 
@@ -268,6 +308,7 @@ static void fat_print_fat(void)
 		pr_msg("\n");
 	}
 
+	advise_access(info->fat_offset * info->sector_size, info->fat_length * info->sector_size, ACCESS_RANDOM);
 	free_bitmap(&b);
 }
 
@@ -283,7 +324,7 @@ static void fat_print_bitmap(void)
 	/* Allocation bitmap consider first cluster is 2 */
 	pr_msg("%08x  - - ", 0);
 
-	for (clu = EXFAT_FIRST_CLUSTER; clu < info.cluster_size; clu++) {
+	for (clu = EXFAT_FIRST_CLUSTER; clu < info->cluster_size; clu++) {
 		fat_get_fat_entry(clu, &entry);
 
 		switch (clu % 0x10) {
@@ -441,11 +482,13 @@ static int fat32_print_fsinfo(struct fat32_fsinfo *fsi)
 static int fat12_set_fat_entry(uint32_t clu, uint32_t entry)
 {
 	uint32_t FATOffset = clu + (clu / 2);
-	uint32_t ThisFATEntOffset = FATOffset % info.sector_size;
+	off_t fat_index = (info->fat_offset + FATOffset / info->sector_size) * info->sector_size;
+	uint32_t ThisFATEntOffset = FATOffset % info->sector_size;
 	uint8_t *fat;
 
-	fat = malloc(info.sector_size * info.fat_length);
-	get_sector(fat, info.fat_offset * info.sector_size, 1);
+	/* FAT12 entry may straddle sector boundary */
+	fat = malloc(info->sector_size * 2);
+	get_sector(fat, fat_index, 2);
 	if (clu % 2) {
 		*(fat + ThisFATEntOffset) = (fat[ThisFATEntOffset] & 0x0F) | entry << 4;
 		*(fat + ThisFATEntOffset + 1) = entry >> 4;
@@ -453,7 +496,7 @@ static int fat12_set_fat_entry(uint32_t clu, uint32_t entry)
 		*(fat + ThisFATEntOffset) = entry & 0xff;
 		*(fat + ThisFATEntOffset + 1) = (fat[ThisFATEntOffset + 1] & 0xF0) | (entry >> 8);
 	}
-	set_sector(fat, info.fat_offset * info.sector_size, 1);
+	set_sector(fat, fat_index, 2);
 	free(fat);
 	return 0;
 }
@@ -467,16 +510,16 @@ static int fat12_set_fat_entry(uint32_t clu, uint32_t entry)
  */
 static int fat16_set_fat_entry(uint32_t clu, uint32_t entry)
 {
-	size_t entry_per_sector = info.sector_size / sizeof(uint16_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
+	size_t entry_per_sector = info->sector_size / sizeof(uint16_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
 	uint16_t *fat;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
+	fat = alloc_sector();
 	get_sector(fat, fat_index, 1);
 	fat[offset] = (uint16_t)entry;
 	set_sector(fat, fat_index, 1);
-	free(fat);
+	free_sector(fat);
 	return 0;
 }
 
@@ -489,16 +532,16 @@ static int fat16_set_fat_entry(uint32_t clu, uint32_t entry)
  */
 static int fat32_set_fat_entry(uint32_t clu, uint32_t entry)
 {
-	size_t entry_per_sector = info.sector_size / sizeof(uint32_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
+	size_t entry_per_sector = info->sector_size / sizeof(uint32_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
 	uint32_t *fat;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
+	fat = alloc_sector();
 	get_sector(fat, fat_index, 1);
 	fat[offset] = entry & 0x0FFFFFFF;
 	set_sector(fat, fat_index, 1);
-	free(fat);
+	free_sector(fat);
 	return 0;
 }
 
@@ -513,12 +556,14 @@ static uint32_t fat12_get_fat_entry(uint32_t clu)
 {
 	uint32_t ret = 0;
 	uint32_t FATOffset = clu + (clu / 2);
-	uint32_t ThisFATSecNum = info.fat_offset + (FATOffset / info.sector_size); 
-	uint32_t ThisFATEntOffset = FATOffset % info.sector_size;
-	uint8_t *fat;
+	uint32_t ThisFATSecNum = info->fat_offset + (FATOffset / info->sector_size); 
+	uint32_t ThisFATEntOffset = FATOffset % info->sector_size;
+	uint8_t *fat, *buf = NULL;
 
-	fat = malloc(info.sector_size * info.fat_length);
-	get_sector(fat, ThisFATSecNum * info.sector_size, info.fat_length);
+	if (!(fat = map_sector(ThisFATSecNum * info->sector_size, info->fat_length))) {
+		fat = buf = malloc(info->sector_size * info->fat_length);
+		get_sector(fat, ThisFATSecNum * info->sector_size, info->fat_length);
+	}
 	if (clu % 2) {
 		ret = (fat[ThisFATEntOffset] >> 4)
 			| (fat[ThisFATEntOffset + 1] << 4);
@@ -526,7 +571,7 @@ static uint32_t fat12_get_fat_entry(uint32_t clu)
 		ret = fat[ThisFATEntOffset]
 			| (fat[ThisFATEntOffset + 1] << 8);
 	}
-	free(fat);
+	free(buf);
 	return ret;
 }
 
@@ -540,15 +585,17 @@ static uint32_t fat12_get_fat_entry(uint32_t clu)
 static uint32_t fat16_get_fat_entry(uint32_t clu)
 {
 	uint32_t ret = 0;
-	size_t entry_per_sector = info.sector_size / sizeof(uint16_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
-	uint16_t *fat;
+	size_t entry_per_sector = info->sector_size / sizeof(uint16_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
+	uint16_t *fat, *buf = NULL;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
-	get_sector(fat, fat_index, 1);
+	if (!(fat = map_sector(fat_index, 1))) {
+		fat = buf = alloc_sector();
+		get_sector(fat, fat_index, 1);
+	}
 	ret = fat[offset];
-	free(fat);
+	free_sector(buf);
 
 	return ret;
 }
@@ -563,15 +610,17 @@ static uint32_t fat16_get_fat_entry(uint32_t clu)
 static uint32_t fat32_get_fat_entry(uint32_t clu)
 {
 	uint32_t ret = 0;
-	size_t entry_per_sector = info.sector_size / sizeof(uint32_t);
-	uint32_t fat_index = (info.fat_offset +  clu / entry_per_sector) * info.sector_size;
-	uint32_t *fat;
+	size_t entry_per_sector = info->sector_size / sizeof(uint32_t);
+	off_t fat_index = (info->fat_offset +  clu / entry_per_sector) * info->sector_size;
+	uint32_t *fat, *buf = NULL;
 	uint32_t offset = (clu) % entry_per_sector;
 
-	fat = malloc(info.sector_size);
-	get_sector(fat, fat_index, 1);
+	if (!(fat = map_sector(fat_index, 1))) {
+		fat = buf = alloc_sector();
+		get_sector(fat, fat_index, 1);
+	}
 	ret = fat[offset] & 0x0FFFFFFF;
-	free(fat);
+	free_sector(buf);
 
 	return ret;
 }
@@ -592,7 +641,7 @@ static uint32_t fat32_get_fat_entry(uint32_t clu)
  */
 static int fat_check_last_cluster(uint32_t clu)
 {
-	switch (info.fstype) {
+	switch (info->fstype) {
 		case FAT12_FILESYSTEM:
 			return (clu < FAT_FSTCLUSTER || FAT12_RESERVED <= clu);
 		case FAT16_FILESYSTEM:
@@ -643,7 +692,7 @@ static int fat_alloc_clusters(struct fat_fileinfo *f, uint32_t clu, size_t num_a
 
 	clu = next_clu = last_clu = fat_get_last_cluster(f, clu);
 	for (next_clu = last_clu + 1; next_clu != last_clu; next_clu++) {
-		if (next_clu > info.cluster_count - 1)
+		if (next_clu > info->cluster_count - 1)
 			next_clu = FAT_FSTCLUSTER;
 
 		fat_get_fat_entry(next_clu, &entry);
@@ -706,7 +755,7 @@ static int fat_new_clusters(size_t num_alloc)
 	uint32_t next_clu, clu;
 	uint32_t fst_clu = 0;
 
-	for (clu = FAT_FSTCLUSTER; clu < info.cluster_count; clu++) {
+	for (clu = FAT_FSTCLUSTER; clu < info->cluster_count; clu++) {
 		fat_get_fat_entry(clu, &next_clu);
 		if (!fat_check_last_cluster(next_clu))
 			continue;
@@ -727,6 +776,74 @@ static int fat_new_clusters(size_t num_alloc)
 	return fst_clu;
 }
 
+/**
+ * fat_resolve_chain - Get cluster index list of cluster chain
+ * @clu:               first cluster
+ * @chain:             cluster index list (Output)
+ *
+ * @return             The number of clusters in the chain
+ *                     0 (failed to allocate, or chain is corrupted)
+ *
+ * NOTE: @chain must be released by caller.
+ *       FAT sector is read only once while the chain stays in it,
+ *       so a continuous run costs one read per FAT sector.
+ */
+static size_t fat_resolve_chain(uint32_t clu, uint32_t **chain)
+{
+	uint32_t ret = FAT_FSTCLUSTER, first = clu;
+	uint32_t *tmp;
+	void *fat = NULL;
+	off_t fat_index = -1, index;
+	size_t entry_size = (info->fstype == FAT16_FILESYSTEM) ? sizeof(uint16_t) : sizeof(uint32_t);
+	size_t entry_per_sector = info->sector_size / entry_size;
+	size_t num, size = 0;
+
+	*chain = NULL;
+	if (info->fstype != FAT12_FILESYSTEM && !(fat = alloc_sector()))
+		return 0;
+
+	for (num = 0; fat_check_last_cluster(ret) == 0; num++, clu = ret) {
+		/* Corrupted FAT may have a loop, or point outside of volume */
+		if (num >= info->cluster_count || clu >= info->cluster_count + FAT_FSTCLUSTER) {
+			pr_warn("Invalid cluster chain from %u.\n", first);
+			free(*chain);
+			free_sector(fat);
+			*chain = NULL;
+			return 0;
+		}
+		if (num == size) {
+			size = size ? size * 2 : DENTRY_LISTSIZE;
+			if (!(tmp = realloc(*chain, sizeof(uint32_t) * size))) {
+				free(*chain);
+				free_sector(fat);
+				*chain = NULL;
+				return 0;
+			}
+			*chain = tmp;
+		}
+		(*chain)[num] = clu;
+
+		/* FAT12 entry may straddle sector boundary */
+		if (info->fstype == FAT12_FILESYSTEM) {
+			fat_get_fat_entry(clu, &ret);
+			continue;
+		}
+
+		index = (info->fat_offset + clu / entry_per_sector) * info->sector_size;
+		if (index != fat_index) {
+			get_sector(fat, index, 1);
+			fat_index = index;
+		}
+		if (info->fstype == FAT16_FILESYSTEM)
+			ret = ((uint16_t *)fat)[clu % entry_per_sector];
+		else
+			ret = ((uint32_t *)fat)[clu % entry_per_sector] & 0x0FFFFFFF;
+	}
+
+	free_sector(fat);
+	return num;
+}
+
 /**
  * fat_concat_cluster - Contatenate cluster @data with next_cluster
  * @f:                  file information pointer
@@ -738,24 +855,21 @@ static int fat_new_clusters(size_t num_alloc)
  */
 static uint32_t fat_concat_cluster(struct fat_fileinfo *f, uint32_t clu, void **data)
 {
-	int i;
-	uint32_t ret = FAT_FSTCLUSTER;
-	uint32_t tmp_clu = clu;
+	uint32_t *chain;
 	void *tmp;
-	size_t allocated = 1;
+	size_t allocated;
 
-	for (allocated = 0; fat_check_last_cluster(ret) == 0; allocated++, tmp_clu = ret)
-		fat_get_fat_entry(tmp_clu, &ret);
+	if (!(allocated = fat_resolve_chain(clu, &chain)))
+		return 0;
 
-	if (!(tmp = realloc(*data, info.cluster_size * allocated)))
+	if (!(tmp = realloc(*data, info->cluster_size * allocated))) {
+		free(chain);
 		return 0;
+	}
 	*data = tmp;
 
-	for (i = 0; i < allocated; i++) {
-		fat_get_fat_entry(clu, &ret);
-		get_cluster(*data + info.cluster_size * i, clu);
-		clu = ret;
-	}
+	get_cluster_chain(*data, chain, allocated);
+	free(chain);
 
 	return allocated;
 }
@@ -771,22 +885,14 @@ static uint32_t fat_concat_cluster(struct fat_fileinfo *f, uint32_t clu, void **
  */
 static uint32_t fat_set_cluster(struct fat_fileinfo *f, uint32_t clu, void *data)
 {
-	uint32_t ret = FAT_FSTCLUSTER;
-	uint32_t tmp_clu = clu;
-	size_t allocated = 0;
-	size_t cluster_num = 0;
-
-	for (cluster_num = 0; fat_check_last_cluster(ret) == 0; cluster_num++, tmp_clu = ret)
-		fat_get_fat_entry(tmp_clu, &ret);
+	uint32_t *chain;
+	size_t cluster_num;
 
-	ret = clu;
-	for (allocated = 0; allocated < cluster_num; allocated++) {
-		set_cluster(data + info.cluster_size * allocated, ret);
-		fat_get_fat_entry(clu, &ret);
-		clu = ret;
-	}
+	cluster_num = fat_resolve_chain(clu, &chain);
+	set_cluster_chain(data, chain, cluster_num);
+	free(chain);
 
-	return allocated + 1;
+	return cluster_num + 1;
 }
 
 /*************************************************************************************************/
@@ -805,9 +911,9 @@ static void fat_print_dchain(void)
 	node2_t *tmp;
 	struct fat_fileinfo *f;
 
-	for (i = 0; i < info.root_size && info.root[i]; i++) {
-		tmp = info.root[i];
-		f = (struct fat_fileinfo *)info.root[i]->data;
+	for (i = 0; i < info->root_size && info->root[i]; i++) {
+		tmp = info->root[i];
+		f = (struct fat_fileinfo *)info->root[i]->data;
 		pr_msg("%-16s(%s) [%u] | ", f->name, f->uniname, tmp->index);
 		while (tmp->next != NULL) {
 			tmp = tmp->next;
@@ -831,8 +937,8 @@ static int fat_check_dchain(uint32_t clu)
 {
 	int i;
 
-	for (i = 0; info.root[i] && i < info.root_size; i++) {
-		if (info.root[i]->index == clu)
+	for (i = 0; info->root[i] && i < info->root_size; i++) {
+		if (info->root[i]->index == clu)
 			return 1;
 	}
 	return 0;
@@ -849,63 +955,69 @@ static int fat_get_index(uint32_t clu)
 {
 	int i;
 
-	for (i = 0; i < info.root_size && info.root[i]; i++) {
-		if (info.root[i]->index == clu)
+	for (i = 0; i < info->root_size && info->root[i]; i++) {
+		if (info->root[i]->index == clu)
 			return i;
 	}
 
-	info.root_size += DENTRY_LISTSIZE;
-	node2_t **tmp = realloc(info.root, sizeof(node2_t *) * info.root_size);
+	info->root_size += DENTRY_LISTSIZE;
+	node2_t **tmp = realloc(info->root, sizeof(node2_t *) * info->root_size);
 	if (tmp) {
-		info.root = tmp;
-		info.root[i] = NULL;
+		info->root = tmp;
+		info->root[i] = NULL;
 	} else {
 		pr_warn("Can't expand directory chain, so delete last chain.\n");
-		delete_node2(info.root[--i]);
+		delete_node2(info->root[--i]);
 	}
 
 	return i;
 }
 
 /**
- * fat_traverse_directory - function to traverse one directory
- * @clu:                    index of the cluster want to check
+ * fat_get_dentry - Get directory entry in directory being traversed
+ * @s:              cluster stream of the directory (NULL for root directory)
+ * @data:           root directory region (if @s is NULL)
+ * @entries:        The number of entries in the directory
+ * @i:              index of the directory entry
  *
- * @return                   0 (success)
- *                          -1 (failed to read)
+ * @return          directory entry (valid until next call)
+ *                  empty entry (@i is out of the directory)
  */
-static int fat_traverse_directory(uint32_t clu)
+static struct fat_dentry *fat_get_dentry(struct cluster_stream *s, void *data, size_t entries, size_t i)
+{
+	static struct fat_dentry empty;
+	struct fat_dentry *d = NULL;
+
+	if (i >= entries)
+		return &empty;
+
+	if (s)
+		d = read_cluster_stream(s, i * sizeof(struct fat_dentry));
+	else
+		d = (struct fat_dentry *)data + i;
+
+	return d ? d : &empty;
+}
+
+/**
+ * fat_parse_directory - function to load directory entries of one directory
+ * @clu:                 index of the directory
+ * @s:                   cluster stream of the directory (NULL if @data is used)
+ * @data:                raw data of the directory
+ * @entries:             The number of entries in the directory
+ */
+static void fat_parse_directory(uint32_t clu, struct cluster_stream *s, void *data, size_t entries)
 {
 	int i, j;
 	uint8_t ord = 0, attr = 0;
 	uint16_t uniname[MAX_NAME_LENGTH] = {0};
 	size_t index = fat_get_index(clu);
-	struct fat_fileinfo *f = (struct fat_fileinfo *)info.root[index]->data;
-	size_t entries;
-	size_t cluster_num = 1;
 	size_t namelen = 0;
-	void *data;
-	struct fat_dentry d;
-
-	if (f->cached) {
-		pr_debug("Directory %s was already traversed.\n", f->name);
-		return 0;
-	}
-
-	if (clu) {
-		data = malloc(info.cluster_size);
-		get_cluster(data, clu);
-		cluster_num = fat_concat_cluster(f, clu, &data);
-		entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
-	} else {
-		data = malloc(info.root_length * info.sector_size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
-		entries = (info.root_length * info.sector_size) / sizeof(struct fat_dentry);
-	}
+	struct fat_dentry d, *lfn;
 
 	for (i = 0; i < entries; i++) {
 		namelen = 0;
-		d = ((struct fat_dentry *)data)[i];
+		d = *fat_get_dentry(s, data, entries, i);
 		attr = d.dentry.lfn.LDIR_Attr;
 		ord = d.dentry.lfn.LDIR_Ord;
 		/* Empty entry */
@@ -916,41 +1028,179 @@ static int fat_traverse_directory(uint32_t clu)
 		/* First entry should be checked */
 		switch (attr) {
 			case ATTR_VOLUME_ID:
-				info.vol_length = 11;
-				info.vol_label = calloc(11 + 1, sizeof(unsigned char));
-				memcpy(info.vol_label, d.dentry.dir.DIR_Name,
+				info->vol_length = 11;
+				info->vol_label = calloc(11 + 1, sizeof(unsigned char));
+				memcpy(info->vol_label, d.dentry.dir.DIR_Name,
 						sizeof(unsigned char) * 11);
 				continue;
 			case ATTR_LONG_FILE_NAME:
 				ord &= ~LAST_LONG_ENTRY;
 				for (j = 0; j < ord; j++) {
+					lfn = fat_get_dentry(s, data, entries, i + ord - j - 1);
 					memcpy(uniname + j * LONGNAME_MAX,
-							(((struct fat_dentry *)data)[i + ord - j - 1]).dentry.lfn.LDIR_Name1,
-							5 * sizeof(uint16_t));
+							lfn->dentry.lfn.LDIR_Name1, 5 * sizeof(uint16_t));
 					memcpy(uniname + j * LONGNAME_MAX + 5,
-							(((struct fat_dentry *)data)[i + ord - j - 1]).dentry.lfn.LDIR_Name2,
-							6 * sizeof(uint16_t));
+							lfn->dentry.lfn.LDIR_Name2, 6 * sizeof(uint16_t));
 					memcpy(uniname + j * LONGNAME_MAX + 11,
-							(((struct fat_dentry *)data)[i + ord - j - 1]).dentry.lfn.LDIR_Name3,
-							2 * sizeof(uint16_t));
+							lfn->dentry.lfn.LDIR_Name3, 2 * sizeof(uint16_t));
 					namelen += LONGNAME_MAX;
 				}
-				d = ((struct fat_dentry *)data)[i + ord];
+				d = *fat_get_dentry(s, data, entries, i + ord);
 				i += ord;
 				break;
 			default:
-				d = ((struct fat_dentry *)data)[i];
 				break;
 		}
-		fat_create_fileinfo(info.root[index], clu, &d, uniname, namelen);
+		fat_create_fileinfo(info->root[index], clu, &d, uniname, namelen);
 	}
-	free(data);
 
 	fat_print_dchain();
+}
+
+/**
+ * fat_traverse_directory - function to traverse one directory
+ * @clu:                    index of the cluster want to check
+ *
+ * @return                   0 (success)
+ *                          -1 (failed to read)
+ */
+static int fat_traverse_directory(uint32_t clu)
+{
+	size_t index = fat_get_index(clu);
+	struct fat_fileinfo *f = (struct fat_fileinfo *)info->root[index]->data;
+	size_t entries;
+	size_t cluster_num = 1;
+	void *data = NULL;
+	uint32_t *chain = NULL;
+	struct cluster_stream s;
+
+	if (f->cached) {
+		pr_debug("Directory %s was already traversed.\n", f->name);
+		return 0;
+	}
+
+	if (clu) {
+		cluster_num = fat_resolve_chain(clu, &chain);
+		if (open_cluster_stream(&s, chain, cluster_num)) {
+			free(chain);
+			return -1;
+		}
+		entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
+	} else {
+		data = malloc(info->root_length * info->sector_size);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
+		entries = (info->root_length * info->sector_size) / sizeof(struct fat_dentry);
+	}
+
+	fat_parse_directory(clu, clu ? &s : NULL, data, entries);
+
+	if (clu) {
+		close_cluster_stream(&s);
+		free(chain);
+	}
+	free(data);
 
 	return 0;
 }
 
+/**
+ * fat_load_directories - function to read several directories in one batch
+ * @clu:                  index list of the directories
+ * @chain:                cluster index list of each directory
+ * @num:                  The number of clusters in each directory
+ * @count:                The number of directories
+ */
+static void fat_load_directories(uint32_t *clu, uint32_t **chain, size_t *num, size_t count)
+{
+	size_t i, offset = 0;
+	void *data;
+
+	if (!(data = get_cluster_chains(chain, num, count))) {
+		for (i = 0; i < count; i++)
+			fat_traverse_directory(clu[i]);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		fat_parse_directory(clu[i], NULL, data + offset,
+				(num[i] * info->cluster_size) / sizeof(struct fat_dentry));
+		offset += num[i] * info->cluster_size;
+	}
+	free(data);
+}
+
+/**
+ * fat_traverse_directories - function to traverse directories in directory chain
+ * @start:                    first index in directory chain
+ *
+ * @return                    index after the last directory (directories found are from here)
+ *
+ * NOTE: Clusters of directories which aren't traversed yet are read in one batch
+ *       up to DIRECTORY_BATCH_MAX bytes, instead of one directory after another.
+ */
+static size_t fat_traverse_directories(size_t start)
+{
+	size_t i, j, end, count = 0, total = 0;
+	size_t *num = NULL;
+	uint32_t *clu = NULL, **chain = NULL;
+	struct fat_fileinfo *f;
+
+	for (end = start; end < info->root_size && info->root[end]; end++)
+		;
+
+	if (!(clu = malloc(sizeof(uint32_t) * (end - start))) ||
+			!(chain = malloc(sizeof(uint32_t *) * (end - start))) ||
+			!(num = malloc(sizeof(size_t) * (end - start)))) {
+		for (i = start; i < end; i++)
+			if (info->root[i]->index || info->fstype != FAT32_FILESYSTEM)
+				fat_traverse_directory(info->root[i]->index);
+		goto out;
+	}
+
+	for (i = start; i < end; i++) {
+		clu[count] = info->root[i]->index;
+		f = (struct fat_fileinfo *)info->root[i]->data;
+		/* ".." in FAT32 points to root directory as cluster 0 */
+		if (!clu[count] && info->fstype == FAT32_FILESYSTEM)
+			continue;
+		/* Root directory in FAT12/16 isn't in clusters */
+		if (!clu[count] || f->cached) {
+			fat_traverse_directory(clu[count]);
+			continue;
+		}
+
+		if (!(num[count] = fat_resolve_chain(clu[count], &chain[count])))
+			continue;
+		if (num[count] * info->cluster_size > DIRECTORY_BATCH_MAX) {
+			free(chain[count]);
+			fat_traverse_directory(clu[count]);
+			continue;
+		}
+
+		/* Batch is full, so read it before this directory */
+		if ((total + num[count]) * info->cluster_size > DIRECTORY_BATCH_MAX) {
+			fat_load_directories(clu, chain, num, count);
+			for (j = 0; j < count; j++)
+				free(chain[j]);
+			clu[0] = clu[count];
+			chain[0] = chain[count];
+			num[0] = num[count];
+			count = total = 0;
+		}
+		total += num[count++];
+	}
+	if (count)
+		fat_load_directories(clu, chain, num, count);
+	for (j = 0; j < count; j++)
+		free(chain[j]);
+
+out:
+	free(num);
+	free(chain);
+	free(clu);
+	return end;
+}
+
 /**
  * fat_clean_dchain - function to clean opeartions
  * @index:            directory chain index
@@ -963,12 +1213,12 @@ int fat_clean_dchain(uint32_t index)
 	node2_t *tmp;
 	struct fat_fileinfo *f;
 
-	if ((!info.root[index])) {
+	if ((!info->root[index])) {
 		pr_warn("index %d was already released.\n", index);
 		return -1;
 	}
 
-	tmp = info.root[index];
+	tmp = info->root[index];
 
 	while (tmp->next != NULL) {
 		tmp = tmp->next;
@@ -976,7 +1226,7 @@ int fat_clean_dchain(uint32_t index)
 		free(f->uniname);
 		f->uniname = NULL;
 	}
-	free_list2(info.root[index]);
+	free_list2(info->root[index]);
 	return 0;
 }
 
@@ -1069,7 +1319,7 @@ static void fat_create_fileinfo(node2_t *head, uint32_t clu,
 		d->dir = head->data;
 
 		index = fat_get_index(next_clu);
-		info.root[index] = init_node2(next_clu, d);
+		info->root[index] = init_node2(next_clu, d);
 	}
 }
 
@@ -1242,16 +1492,16 @@ static int fat_check_dir_empty(struct fat_fileinfo *f, uint32_t clu)
 
 	/* Lookup last entry */
 	if (clu) {
-		data = malloc(info.cluster_size);
+		data = malloc(info->cluster_size);
 		get_cluster(data, clu);
 		cluster_num = fat_concat_cluster(f, clu, &data);
-		size = info.cluster_size * cluster_num;
-		entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
+		size = info->cluster_size * cluster_num;
+		entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
 	} else {
-		size = info.root_length * info.sector_size;
+		size = info->root_length * info->sector_size;
 		entries = size / sizeof(struct fat_dentry);
 		data = malloc(size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 
 	for (i = 0; i < entries; i++) {
@@ -1289,7 +1539,7 @@ int fat_add_entry(const char *name, uint32_t clu, uint8_t type)
 	uint8_t ord = LAST_LONG_ENTRY;
 	uint32_t fst_clu = 0;
 	size_t index = fat_get_index(clu);
-	struct fat_fileinfo *f = (struct fat_fileinfo *)info.root[index]->data;
+	struct fat_fileinfo *f = (struct fat_fileinfo *)info->root[index]->data;
 	size_t size;
 	size_t entries;
 	size_t cluster_num = 1;
@@ -1303,16 +1553,16 @@ int fat_add_entry(const char *name, uint32_t clu, uint8_t type)
 
 	/* Lookup last entry */
 	if (clu) {
-		data = malloc(info.cluster_size);
+		data = malloc(info->cluster_size);
 		get_cluster(data, clu);
 		cluster_num = fat_concat_cluster(f, clu, &data);
-		size = info.cluster_size * cluster_num;
-		entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
+		size = info->cluster_size * cluster_num;
+		entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
 	} else {
-		size = info.root_length * info.sector_size;
+		size = info->root_length * info->sector_size;
 		entries = size / sizeof(struct fat_dentry);
 		data = malloc(size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 
 	for (i = 0; i < entries; i++) {
@@ -1322,15 +1572,15 @@ int fat_add_entry(const char *name, uint32_t clu, uint8_t type)
 	}
 
 	if (clu) {
-		new_cluster_num = ROUNDUP((i + count + 1) * sizeof(struct fat_dentry), info.cluster_size);
+		new_cluster_num = ROUNDUP((i + count + 1) * sizeof(struct fat_dentry), info->cluster_size);
 		if (new_cluster_num > cluster_num) {
 			fat_alloc_clusters(f, clu, new_cluster_num - cluster_num);
 			cluster_num = fat_concat_cluster(f, clu, &data);
-			entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
+			entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
 			d = ((struct fat_dentry *)data) + i;
 		}
 	} else {
-		if (((i + count + 1) * info.sector_size) > size) {
+		if (((i + count + 1) * info->sector_size) > size) {
 			pr_err("Can't create file entry in root directory.\n");
 			return -1;
 		}
@@ -1359,7 +1609,7 @@ create_short:
 	if (clu)
 		fat_set_cluster(f, clu, data);
 	else
-		set_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		set_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 
 	free(data);
 	return 0;
@@ -1380,7 +1630,7 @@ int fat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 	char shortname[11] = {0};
 	uint16_t longname[MAX_NAME_LENGTH] = {0};
 	size_t index = fat_get_index(clu);
-	struct fat_fileinfo *dir = (struct fat_fileinfo *)info.root[index]->data;
+	struct fat_fileinfo *dir = (struct fat_fileinfo *)info->root[index]->data;
 	struct fat_fileinfo *file;
 	size_t size;
 	size_t entries;
@@ -1388,7 +1638,7 @@ int fat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 	uint8_t chksum = 0;
 	struct fat_dentry *d;
 
-	if ((file = fat_search_fileinfo(info.root[fat_get_index(clu)], name)) == NULL) {
+	if ((file = fat_search_fileinfo(info->root[fat_get_index(clu)], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
@@ -1410,16 +1660,16 @@ int fat_remove_entry(const char *name, uint32_t clu, uint8_t type)
 
 	/* Lookup last entry */
 	if (clu) {
-		data = malloc(info.cluster_size);
+		data = malloc(info->cluster_size);
 		get_cluster(data, clu);
 		cluster_num = fat_concat_cluster(dir, clu, &data);
-		size = info.cluster_size * cluster_num;
-		entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
+		size = info->cluster_size * cluster_num;
+		entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
 	} else {
-		size = info.root_length * info.sector_size;
+		size = info->root_length * info->sector_size;
 		entries = size / sizeof(struct fat_dentry);
 		data = malloc(size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 
 	for (i = 0; i < entries; i++) {
@@ -1450,7 +1700,7 @@ out:
 	if (clu)
 		fat_set_cluster(dir, clu, data);
 	else
-		set_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		set_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	free(data);
 	return 0;
 }
@@ -1617,16 +1867,16 @@ int fat_print_bootsec(void)
 	struct fat_bootsec *b = malloc(sizeof(struct fat_bootsec));
 
 	fat_load_bootsec(b);
-	pr_msg("Sector size:     \t%zu\n", info.sector_size);
-	pr_msg("Cluster size:    \t%zu\n", info.cluster_size);
+	pr_msg("Sector size:     \t%zu\n", info->sector_size);
+	pr_msg("Cluster size:    \t%zu\n", info->cluster_size);
 	pr_msg("FAT offset:      \t%u\n", b->BPB_RevdSecCnt);
-	pr_msg("FAT size:        \t%zu\n", b->BPB_FATSz16 * info.sector_size);
+	pr_msg("FAT size:        \t%zu\n", b->BPB_FATSz16 * info->sector_size);
 	pr_msg("FAT count:       \t%u\n", b->BPB_NumFATs);
 
 	pr_msg("Dentry count:    \t%u\n", b->BPB_RootEntCnt);
 	pr_msg("Sector count:    \t%u\n", b->BPB_TotSec16);
 
-	switch (info.fstype) {
+	switch (info->fstype) {
 		case FAT12_FILESYSTEM:
 			/* FALLTHROUGH */
 		case FAT16_FILESYSTEM:
@@ -1635,12 +1885,12 @@ int fat_print_bootsec(void)
 		case FAT32_FILESYSTEM:
 			{
 				void *fsinfo;
-				fsinfo = malloc(info.sector_size);
+				fsinfo = alloc_sector();
 				fat32_print_bootsec(b);
 				get_sector(fsinfo,
-						b->reserved_info.fat32_reserved_info.BPB_FSInfo * info.sector_size, 1);
+						b->reserved_info.fat32_reserved_info.BPB_FSInfo * info->sector_size, 1);
 				fat32_print_fsinfo(fsinfo);
-				free(fsinfo);
+				free_sector(fsinfo);
 				break;
 			}
 		default:
@@ -1663,6 +1913,9 @@ int fat_print_fsinfo(void)
 	fat_print_label();
 	fat_print_fat();
 	fat_print_bitmap();
+
+	/* Whole FAT has been read only for this dump */
+	advise_access(info->fat_offset * info->sector_size, info->fat_length * info->sector_size, ACCESS_ONCE);
 	return 0;
 }
 
@@ -1692,8 +1945,8 @@ int fat_lookup(uint32_t clu, char *name)
 	/* Absolute path */
 	if (name[0] == '/') {
 		pr_debug("\"%s\" is Absolute path, so change current directory(%u) to root(%u)\n",
-				name, clu, info.root_offset);
-		clu = info.root_offset;
+				name, clu, info->root_offset);
+		clu = info->root_offset;
 	}
 
 	/* Separate pathname by slash */
@@ -1711,18 +1964,18 @@ int fat_lookup(uint32_t clu, char *name)
 		pr_debug("Lookup %s to %d\n", path[i], clu);
 		found = false;
 		index = fat_get_index(clu);
-		f = (struct fat_fileinfo *)info.root[index]->data;
-		if ((!info.root[index]) || (!(f->cached))) {
+		f = (struct fat_fileinfo *)info->root[index]->data;
+		if ((!info->root[index]) || (!(f->cached))) {
 			pr_debug("Directory hasn't load yet, or This Directory doesn't exist in filesystem.\n");
 			fat_traverse_directory(clu);
 			index = fat_get_index(clu);
-			if (!info.root[index]) {
+			if (!info->root[index]) {
 				pr_warn("This Directory doesn't exist in filesystem.\n");
 				return -1;
 			}
 		}
 
-		tmp = info.root[index];
+		tmp = info->root[index];
 		while (tmp->next != NULL) {
 			tmp = tmp->next;
 			f = (struct fat_fileinfo *)tmp->data;
@@ -1767,7 +2020,7 @@ int fat_readdir(struct directory *dir, size_t count, uint32_t clu)
 
 	fat_traverse_directory(clu);
 	i = fat_get_index(clu);
-	tmp = info.root[i];
+	tmp = info->root[i];
 
 	for (i = 0; i < count && tmp->next != NULL; i++) {
 		tmp = tmp->next;
@@ -1808,7 +2061,7 @@ int fat_reload_directory(uint32_t clu)
 	struct fat_fileinfo *f = NULL;
 
 	fat_clean_dchain(index);
-	f = ((struct fat_fileinfo *)(info.root[index])->data);
+	f = ((struct fat_fileinfo *)(info->root[index])->data);
 	f->cached = 0;
 	return fat_traverse_directory(clu);
 }
@@ -1840,12 +2093,12 @@ int fat_clean(uint32_t index)
 	node2_t *tmp;
 	struct fat_fileinfo *f;
 
-	if ((!info.root[index])) {
+	if ((!info->root[index])) {
 		pr_warn("index %d was already released.\n", index);
 		return -1;
 	}
 
-	tmp = info.root[index];
+	tmp = info->root[index];
 	f = (struct fat_fileinfo *)tmp->data;
 	free(f->uniname);
 	f->uniname = NULL;
@@ -1866,7 +2119,7 @@ int fat_clean(uint32_t index)
  */
 int fat_set_fat_entry(uint32_t clu, uint32_t entry)
 {
-	switch (info.fstype) {
+	switch (info->fstype) {
 		case FAT12_FILESYSTEM:
 			fat12_set_fat_entry(clu, entry);
 			break;
@@ -1892,7 +2145,7 @@ int fat_set_fat_entry(uint32_t clu, uint32_t entry)
  */
 int fat_get_fat_entry(uint32_t clu, uint32_t *entry)
 {
-	switch (info.fstype) {
+	switch (info->fstype) {
 		case FAT12_FILESYSTEM:
 			*entry = fat12_get_fat_entry(clu);
 			break;
@@ -1919,11 +2172,11 @@ int fat_validate_fat_entry(uint32_t clu)
 {
 	int is_valid = 0;
 
-	if (FAT_FSTCLUSTER <= clu && clu <= info.cluster_count)
+	if (FAT_FSTCLUSTER <= clu && clu <= info->cluster_count)
 		is_valid = 1;
-	if (clu == BAD_CLUSTER)
+	if (clu == info->bad_cluster)
 		is_valid = 0;
-	if (clu == LAST_CLUSTER)
+	if (clu == info->last_cluster)
 		is_valid = 1;
 
 	return is_valid;
@@ -1946,7 +2199,7 @@ int fat_set_bogus_entry(uint32_t clu)
 		return 0;
 	}
 
-	switch (info.fstype) {
+	switch (info->fstype) {
 		case FAT12_FILESYSTEM:
 			fat12_set_fat_entry(clu, 0xFFF);
 			break;
@@ -2043,7 +2296,7 @@ int fat_trim(uint32_t clu)
 	int i, j;
 	void *data;
 	size_t index = fat_get_index(clu);
-	struct fat_fileinfo *f = (struct fat_fileinfo *)info.root[index]->data;
+	struct fat_fileinfo *f = (struct fat_fileinfo *)info->root[index]->data;
 	size_t size;
 	size_t entries;
 	size_t cluster_num = 1;
@@ -2052,16 +2305,16 @@ int fat_trim(uint32_t clu)
 
 	/* Lookup last entry */
 	if (clu) {
-		data = malloc(info.cluster_size);
+		data = malloc(info->cluster_size);
 		get_cluster(data, clu);
 		cluster_num = fat_concat_cluster(f, clu, &data);
-		size = info.cluster_size * cluster_num;
-		entries = (cluster_num * info.cluster_size) / sizeof(struct fat_dentry);
+		size = info->cluster_size * cluster_num;
+		entries = (cluster_num * info->cluster_size) / sizeof(struct fat_dentry);
 	} else {
-		size = info.root_length * info.sector_size;
+		size = info->root_length * info->sector_size;
 		entries = size / sizeof(struct fat_dentry);
 		data = malloc(size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 
 	for (i = 0, j = 0; i < entries; i++) {
@@ -2077,7 +2330,7 @@ int fat_trim(uint32_t clu)
 			memcpy(dist, src, sizeof(struct fat_dentry));
 	}
 
-	allocate_cluster = ROUNDUP((sizeof(struct fat_dentry) * j), info.cluster_size);
+	allocate_cluster = ROUNDUP((sizeof(struct fat_dentry) * j), info->cluster_size);
 	while (j < entries) {
 		dist = ((struct fat_dentry *)data) + j++;
 		memset(dist, 0, sizeof(struct fat_dentry));
@@ -2087,7 +2340,7 @@ int fat_trim(uint32_t clu)
 		fat_set_cluster(f, clu, data);
 		fat_free_clusters(f, clu, cluster_num - allocate_cluster);
 	} else {
-		set_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		set_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 	free(data);
 	return 0;
@@ -2106,21 +2359,21 @@ int fat_fill(uint32_t clu, uint32_t count)
 	void *data;
 	char shortname[11] = {0};
 	size_t index = fat_get_index(clu);
-	struct fat_fileinfo *f = (struct fat_fileinfo *)info.root[index]->data;
-	size_t entries = info.cluster_size / sizeof(struct fat_dentry);
+	struct fat_fileinfo *f = (struct fat_fileinfo *)info->root[index]->data;
+	size_t entries = info->cluster_size / sizeof(struct fat_dentry);
 	size_t size;
 	size_t need_entries = 0;
 	struct fat_dentry *d;
 
 	/* Lookup last entry */
 	if (clu) {
-		data = malloc(info.cluster_size);
+		data = malloc(info->cluster_size);
 		get_cluster(data, clu);
 	} else {
-		size = info.root_length * info.sector_size;
+		size = info->root_length * info->sector_size;
 		entries = size / sizeof(struct fat_dentry);
 		data = malloc(size);
-		get_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		get_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 	}
 
 	if (count > entries) {
@@ -2150,7 +2403,7 @@ int fat_fill(uint32_t clu, uint32_t count)
 	if (clu)
 		fat_set_cluster(f, clu, data);
 	else
-		set_sector(data, (info.fat_offset + info.fat_length) * info.sector_size, info.root_length);
+		set_sector(data, (info->fat_offset + info->fat_length) * info->sector_size, info->root_length);
 
 out:
 	free(data);
@@ -2176,12 +2429,12 @@ int fat_contents(const char *name, uint32_t clu)
 	struct fat_fileinfo *f;
 
 	index = fat_get_index(clu);
-	if ((f = fat_search_fileinfo(info.root[index], name)) == NULL) {
+	if ((f = fat_search_fileinfo(info->root[index], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
 
-	data = malloc(info.cluster_size);
+	data = malloc(info->cluster_size);
 	get_cluster(data, f->clu);
 	cluster_num = fat_concat_cluster(f, f->clu, &data);
 	if (!cluster_num) {
@@ -2224,7 +2477,7 @@ int fat_stat(const char *name, uint32_t clu)
 	struct fat_fileinfo *f;
 
 	index = fat_get_index(clu);
-	if ((f = fat_search_fileinfo(info.root[index], name)) == NULL) {
+	if ((f = fat_search_fileinfo(info->root[index], name)) == NULL) {
 		pr_err("File is not found.\n");
 		return -1;
 	}
@@ -2232,7 +2485,7 @@ int fat_stat(const char *name, uint32_t clu)
 	pr_msg("Short Name:  %s\n", f->name);
 	pr_msg("Long Name:   %s\n", f->uniname);
 	pr_msg("File Size:   %zu\n", f->datalen);
-	pr_msg("Clusters:    %zu\n", ROUNDUP(f->datalen, info.cluster_size));
+	pr_msg("Clusters:    %zu\n", ROUNDUP(f->datalen, info->cluster_size));
 	pr_msg("First Clu:   %u\n", f->clu);
 
 	pr_msg("File Attr:   %c%c%c%c%c\n", f->attr & ATTR_READ_ONLY ? 'R' : '-',
@@ -2255,3 +2508,89 @@ int fat_stat(const char *name, uint32_t clu)
 	return 0;
 }
 
+/**
+ * fat_free_run - function interface to search free clusters in a row
+ * @clu:          cluster index to start searching (Input/Output)
+ * @len:          number of free clusters (Output)
+ *
+ * @return         0 (Success)
+ *                -1 (No more free cluster)
+ */
+int fat_free_run(uint32_t *clu, uint32_t *len)
+{
+	size_t entry_size = (info->fstype == FAT32_FILESYSTEM) ? sizeof(uint32_t) : sizeof(uint16_t);
+	size_t entry_per_sector = info->sector_size / entry_size;
+	off_t fat_index = -1, index;
+	uint32_t i, entry;
+	void *fat;
+
+	if (!(fat = alloc_sector()))
+		return -1;
+
+	*len = 0;
+	for (i = MAX(*clu, FAT_FSTCLUSTER); i < info->cluster_count; i++) {
+		/* FAT12 entry may straddle sector boundary */
+		if (info->fstype == FAT12_FILESYSTEM) {
+			fat_get_fat_entry(i, &entry);
+		} else {
+			index = (info->fat_offset + i / entry_per_sector) * info->sector_size;
+			if (index != fat_index) {
+				get_sector(fat, index, 1);
+				fat_index = index;
+			}
+			if (info->fstype == FAT16_FILESYSTEM)
+				entry = ((uint16_t *)fat)[i % entry_per_sector];
+			else
+				entry = ((uint32_t *)fat)[i % entry_per_sector] & 0x0FFFFFFF;
+		}
+
+		if (entry) {
+			if (*len)
+				break;
+			continue;
+		}
+
+		if (!(*len)++)
+			*clu = i;
+	}
+
+	free_sector(fat);
+	return *len ? 0 : -1;
+}
+
+/**
+ * fat_metadata - function interface to list clusters of filesystem metadata
+ * @add:          function to add clusters to list
+ *
+ * @return         0 (Success)
+ *                -1 (Failed to add)
+ *
+ * NOTE: All directories reachable from root directory are listed.
+ *       Root directory in FAT12/16 isn't listed, because it isn't in clusters.
+ */
+int fat_metadata(metadata_add_t add)
+{
+	size_t i, j, num, next = 0;
+	uint32_t clu, *chain;
+
+	/* Traversal appends subdirectories to directory chain */
+	for (i = 0; i < info->root_size && info->root[i]; i++) {
+		/* Directories found by previous traversal are traversed together */
+		if (i == next)
+			next = fat_traverse_directories(i);
+
+		clu = info->root[i]->index;
+		if (!clu)
+			continue;
+
+		num = fat_resolve_chain(clu, &chain);
+		for (j = 0; j < num; j++) {
+			if (add(chain[j], 1)) {
+				free(chain);
+				return -1;
+			}
+		}
+		free(chain);
+	}
+	return 0;
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "bitmap.h"
+#include "journal.h"
+
+struct journal {
+	int fd;
+	size_t size;
+	off_t end;
+	bool dirty;
+	bitmap_t saved;
+};
+
+/**
+ * journal_open - Open undo journal for volume
+ * @path:         journal file path
+ * @size:         volume size
+ * @create:       start new journal (true), or open existing one (false)
+ *
+ * @return        undo journal
+ *                NULL (failed to open, or journal is for another volume)
+ *
+ * NOTE: New journal discards records of the previous session.
+ */
+struct journal *journal_open(const char *path, size_t size, bool create)
+{
+	struct journal *j;
+	struct journal_header h = {0};
+
+	if (!(j = calloc(1, sizeof(struct journal))))
+		return NULL;
+
+	j->fd = -1;
+	j->size = size;
+	j->end = sizeof(h);
+	init_bitmap(&j->saved, size / JOURNAL_UNIT + 1);
+	if (!j->saved.data) {
+		free(j);
+		return NULL;
+	}
+
+	if ((j->fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644)) < 0)
+		goto err;
+
+	if (create) {
+		memcpy(h.magic, JOURNAL_MAGIC, sizeof(h.magic));
+		h.version = JOURNAL_VERSION;
+		h.unit = JOURNAL_UNIT;
+		h.size = size;
+		if (pwrite(j->fd, &h, sizeof(h), 0) != sizeof(h))
+			goto err;
+		j->dirty = true;
+		return j;
+	}
+
+	/* Existing journal must be recorded for the same volume */
+	if (pread(j->fd, &h, sizeof(h), 0) != sizeof(h) ||
+			memcmp(h.magic, JOURNAL_MAGIC, sizeof(h.magic)) || h.version != JOURNAL_VERSION ||
+			h.unit != JOURNAL_UNIT || h.size != size) {
+		errno = EINVAL;
+		goto err;
+	}
+	j->end = lseek(j->fd, 0, SEEK_END);
+	return j;
+
+err:
+	if (j->fd >= 0)
+		close(j->fd);
+	free_bitmap(&j->saved);
+	free(j);
+	return NULL;
+}
+
+/**
+ * journal_close - Write back and close undo journal
+ * @j:             undo journal
+ */
+void journal_close(struct journal *j)
+{
+	if (!j)
+		return;
+
+	journal_sync(j);
+	close(j->fd);
+	free_bitmap(&j->saved);
+	free(j);
+}
+
+/**
+ * journal_sync - Make records durable
+ * @j:            undo journal
+ *
+ * @return         0 (success)
+ *                -1 (failed to sync)
+ *
+ * NOTE: Records must be durable before the device is modified.
+ */
+int journal_sync(struct journal *j)
+{
+	if (!j || !j->dirty)
+		return 0;
+
+	if (fdatasync(j->fd))
+		return -1;
+
+	j->dirty = false;
+	return 0;
+}
+
+/**
+ * journal_append - Append one record
+ * @j:              undo journal
+ * @offset:         Start bytes
+ * @len:            Length of the region
+ * @read:           read function of volume
+ *
+ * @return           0 (success)
+ *                  -1 (failed to read or write)
+ */
+static int journal_append(struct journal *j, off_t offset, size_t len, journal_read_t read)
+{
+	int ret = -1;
+	struct journal_record r = {0};
+	void *data;
+
+	if (!(data = malloc(len)))
+		return -1;
+
+	if (read(data, offset, len))
+		goto out;
+
+	r.offset = offset;
+	r.length = len;
+	if (pwrite(j->fd, &r, sizeof(r), j->end) != sizeof(r) ||
+			pwrite(j->fd, data, len, j->end + sizeof(r)) != len)
+		goto out;
+
+	j->end += sizeof(r) + len;
+	j->dirty = true;
+	ret = 0;
+out:
+	free(data);
+	return ret;
+}
+
+/**
+ * journal_record - Save data before the region is modified at first
+ * @j:              undo journal
+ * @offset:         Start bytes
+ * @len:            Length of the region
+ * @read:           read function of volume
+ *
+ * @return           0 (success)
+ *                  -1 (failed to save)
+ *
+ * NOTE: Region which was already saved in this session is skipped.
+ */
+int journal_record(struct journal *j, off_t offset, size_t len, journal_read_t read)
+{
+	size_t unit, start, stop;
+	size_t end = (offset + len + JOURNAL_UNIT - 1) / JOURNAL_UNIT;
+
+	if (offset + len > j->size) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	for (unit = offset / JOURNAL_UNIT; unit < end; unit++) {
+		if (get_bitmap(&j->saved, unit))
+			continue;
+
+		/* Unsaved units in a row are saved by one record */
+		for (start = unit; unit < end && !get_bitmap(&j->saved, unit); unit++)
+			;
+		stop = unit * JOURNAL_UNIT < j->size ? unit * JOURNAL_UNIT : j->size;
+		if (journal_append(j, start * JOURNAL_UNIT, stop - start * JOURNAL_UNIT, read))
+			return -1;
+		while (start < unit)
+			set_bitmap(&j->saved, start++);
+	}
+	return 0;
+}
+
+/**
+ * journal_rollback - Restore volume to the state before the session
+ * @j:                undo journal
+ * @write:            write function of volume
+ *
+ * @return             0 (success)
+ *                    -1 (failed to restore)
+ *
+ * NOTE: Broken record at the end (e.g. crashed while appending) is ignored,
+ *       because the region hasn't been modified yet.
+ *       Journal should be reset by journal_reset() after restored data is durable.
+ */
+int journal_rollback(struct journal *j, journal_write_t write)
+{
+	int ret = 0;
+	off_t pos = sizeof(struct journal_header);
+	struct journal_record r;
+	void *data = NULL, *tmp;
+	size_t size = 0;
+
+	while (pos + sizeof(r) <= j->end) {
+		if (pread(j->fd, &r, sizeof(r), pos) != sizeof(r) ||
+				pos + sizeof(r) + r.length > j->end || r.offset + r.length > j->size)
+			break;
+
+		if (r.length > size) {
+			if (!(tmp = realloc(data, r.length))) {
+				ret = -1;
+				goto out;
+			}
+			data = tmp;
+			size = r.length;
+		}
+
+		if (pread(j->fd, data, r.length, pos + sizeof(r)) != r.length ||
+				write(data, r.offset, r.length)) {
+			ret = -1;
+			goto out;
+		}
+		pos += sizeof(r) + r.length;
+	}
+
+out:
+	free(data);
+	return ret;
+}
+
+/**
+ * journal_reset - Discard all records
+ * @j:             undo journal
+ *
+ * @return          0 (success)
+ *                 -1 (failed to truncate)
+ *
+ * NOTE: Following writes are recorded again as the first time.
+ */
+int journal_reset(struct journal *j)
+{
+	if (ftruncate(j->fd, sizeof(struct journal_header)))
+		return -1;
+
+	j->end = sizeof(struct journal_header);
+	memset(j->saved.data, 0, j->saved.size / CHAR_BIT + 1);
+	j->dirty = true;
+	return journal_sync(j);
+}
@@ -2,6 +2,7 @@
 /*
  *  Copyright (C) 2021 LeavaTail
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -10,23 +11,41 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <ctype.h>
-#include <mntent.h>
+#include <time.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#include "debugfatfs.h"
-FILE *output = NULL;
-unsigned int print_level = PRINT_WARNING;
-struct device_info info;
+#include "volume.h"
+
+/* Output stream of messages and volume */
+static FILE *output;
+
 /**
  * Special Option(no short option)
  */
 enum
 {
 	GETOPT_HELP_CHAR = (CHAR_MIN - 2),
-	GETOPT_VERSION_CHAR = (CHAR_MIN - 3)
+	GETOPT_VERSION_CHAR = (CHAR_MIN - 3),
+	GETOPT_DIRECT_CHAR = (CHAR_MIN - 4),
+	GETOPT_STATS_CHAR = (CHAR_MIN - 5),
+	GETOPT_TRACE_CHAR = (CHAR_MIN - 6),
+	GETOPT_PARTITION_CHAR = (CHAR_MIN - 7),
+	GETOPT_OFFSET_CHAR = (CHAR_MIN - 8),
+	GETOPT_OVERLAY_CHAR = (CHAR_MIN - 9),
+	GETOPT_JOURNAL_CHAR = (CHAR_MIN - 10),
+	GETOPT_ROLLBACK_CHAR = (CHAR_MIN - 11),
+	GETOPT_SNAPSHOT_CHAR = (CHAR_MIN - 12),
+	GETOPT_RESTORE_CHAR = (CHAR_MIN - 13),
+	GETOPT_DISCARD_CHAR = (CHAR_MIN - 14),
+	GETOPT_SPARSIFY_CHAR = (CHAR_MIN - 15),
+	GETOPT_CAPTURE_CHAR = (CHAR_MIN - 16),
+	GETOPT_EXPAND_CHAR = (CHAR_MIN - 17),
+	GETOPT_DURABILITY_CHAR = (CHAR_MIN - 18),
+	GETOPT_BATCH_CHAR = (CHAR_MIN - 19),
+	GETOPT_JOBS_CHAR = (CHAR_MIN - 20),
+	GETOPT_SERVE_CHAR = (CHAR_MIN - 21)
 };
 
 /* option data {"long name", needs argument, flags, "short name"} */
@@ -42,6 +61,24 @@ static struct option const longopts[] =
 	{"ro", no_argument, NULL, 'r'},
 	{"upper", required_argument, NULL, 'u'},
 	{"verbose", no_argument, NULL, 'v'},
+	{"direct", no_argument, NULL, GETOPT_DIRECT_CHAR},
+	{"stats", no_argument, NULL, GETOPT_STATS_CHAR},
+	{"trace", required_argument, NULL, GETOPT_TRACE_CHAR},
+	{"partition", required_argument, NULL, GETOPT_PARTITION_CHAR},
+	{"offset", required_argument, NULL, GETOPT_OFFSET_CHAR},
+	{"overlay", required_argument, NULL, GETOPT_OVERLAY_CHAR},
+	{"journal", required_argument, NULL, GETOPT_JOURNAL_CHAR},
+	{"rollback", required_argument, NULL, GETOPT_ROLLBACK_CHAR},
+	{"snapshot", required_argument, NULL, GETOPT_SNAPSHOT_CHAR},
+	{"restore", required_argument, NULL, GETOPT_RESTORE_CHAR},
+	{"discard-free", no_argument, NULL, GETOPT_DISCARD_CHAR},
+	{"sparsify", optional_argument, NULL, GETOPT_SPARSIFY_CHAR},
+	{"capture", required_argument, NULL, GETOPT_CAPTURE_CHAR},
+	{"expand", required_argument, NULL, GETOPT_EXPAND_CHAR},
+	{"durability", required_argument, NULL, GETOPT_DURABILITY_CHAR},
+	{"batch", required_argument, NULL, GETOPT_BATCH_CHAR},
+	{"jobs", required_argument, NULL, GETOPT_JOBS_CHAR},
+	{"serve", required_argument, NULL, GETOPT_SERVE_CHAR},
 	{"help", no_argument, NULL, GETOPT_HELP_CHAR},
 	{"version", no_argument, NULL, GETOPT_VERSION_CHAR},
 	{0,0,0,0}
@@ -53,6 +90,7 @@ static struct option const longopts[] =
 static void usage(void)
 {
 	fprintf(stderr, "Usage: %s [OPTION]... FILE\n", PROGRAM_NAME);
+	fprintf(stderr, "  or:  %s --batch=list [OPTION]... [PATH]\n", PROGRAM_NAME);
 	fprintf(stderr, "dump FAT/exFAT filesystem information.\n");
 	fprintf(stderr, "\n");
 
@@ -66,6 +104,24 @@ static void usage(void)
 	fprintf(stderr, "  -r, --ro\tread only mode. \n");
 	fprintf(stderr, "  -u, --upper\tconvert into uppercase latter by up-case Table.\n");
 	fprintf(stderr, "  -v, --verbose\tVersion mode.\n");
+	fprintf(stderr, "  --direct\tbypass page cache (O_DIRECT) to access device.\n");
+	fprintf(stderr, "  --stats\tprint I/O statistics before exit.\n");
+	fprintf(stderr, "  --trace=file\trecord sector accesses to file.\n");
+	fprintf(stderr, "  --partition=N\topen N-th partition in MBR/GPT of whole disk image.\n");
+	fprintf(stderr, "  --offset=bytes\topen filesystem which starts at any bytes of device.\n");
+	fprintf(stderr, "  --overlay=file\twrite changes to file instead of device.\n");
+	fprintf(stderr, "  --journal=file\tsave data to file before it is changed at first.\n");
+	fprintf(stderr, "  --rollback=file\trestore device by journal, and exit.\n");
+	fprintf(stderr, "  --snapshot=file\tsave image to file by reflink before any operation.\n");
+	fprintf(stderr, "  --restore=file\treplace image with snapshot file, and exit.\n");
+	fprintf(stderr, "  --discard-free\tdiscard free clusters of device.\n");
+	fprintf(stderr, "  --sparsify[=zero]\tpunch holes in free (and zero-filled) clusters of image.\n");
+	fprintf(stderr, "  --capture=file\tsave only filesystem metadata to sparse file.\n");
+	fprintf(stderr, "  --expand=file\texpand capture to sparse image file, and exit.\n");
+	fprintf(stderr, "  --durability=policy\tsync written data at none, command, session or write.\n");
+	fprintf(stderr, "  --batch=list\tanalyze each image in list file in parallel.\n");
+	fprintf(stderr, "  --jobs=N\tanalyze N images at once with --batch (default: CPUs).\n");
+	fprintf(stderr, "  --serve=socket\taccept commands of interactive mode from UNIX domain socket.\n");
 	fprintf(stderr, "  --help\tdisplay this help and exit.\n");
 	fprintf(stderr, "  --version\toutput version information and exit.\n");
 	fprintf(stderr, "\n");
@@ -89,348 +145,6 @@ static void version(const char *command_name, const char *version, const char *a
 	fprintf(stdout, "Written by %s.\n", author);
 }
 
-/**
- * get_sector - Get Raw-Data from any sector
- * @data:       Sector raw data (Output)
- * @index:      Start bytes
- * @count:      The number of sectors
- *
- * @return       0 (success)
- *              -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int get_sector(void *data, off_t index, size_t count)
-{
-	size_t sector_size = info.sector_size;
-
-	pr_debug("Get: Sector from 0x%lx to 0x%lx\n", index , index + (count * sector_size) - 1);
-	if ((pread(info.fd, data, count * sector_size, index)) < 0) {
-		pr_err("read: %s\n", strerror(errno));
-		return -1;
-	}
-	return 0;
-}
-
-/**
- * set_sector - Set Raw-Data from any sector
- * @data:       Sector raw data
- * @index:      Start bytes
- * @count:      The number of sectors
- *
- * @return       0 (success)
- *              -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int set_sector(void *data, off_t index, size_t count)
-{
-	size_t sector_size = info.sector_size;
-
-	pr_debug("Set: Sector from 0x%lx to 0x%lx\n", index, index + (count * sector_size) - 1);
-	if ((pwrite(info.fd, data, count * sector_size, index)) < 0) {
-		pr_err("write: %s\n", strerror(errno));
-		return -1;
-	}
-	return 0;
-}
-
-/**
- * get_cluster - Get Raw-Data from any cluster
- * @data:        cluster raw data (Output)
- * @index:       Start cluster index
- *
- * @return        0 (success)
- *               -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int get_cluster(void *data, off_t index)
-{
-	return get_clusters(data, index, 1);
-}
-
-/**
- * set_cluster - Set Raw-Data from any cluster
- * @data:        cluster raw data
- * @index:       Start cluster index
- *
- * @return        0 (success)
- *               -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int set_cluster(void *data, off_t index)
-{
-	return set_clusters(data, index, 1);
-}
-
-/**
- * get_clusters - Get Raw-Data from any cluster
- * @data:         cluster raw data (Output)
- * @index:        Start cluster index
- * @num:          The number of clusters
- *
- * @return         0 (success)
- *                -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int get_clusters(void *data, off_t index, size_t num)
-{
-	size_t clu_per_sec = info.cluster_size / info.sector_size;
-	off_t heap_start = info.heap_offset * info.sector_size;
-
-	if (index < 2 || index + num > info.cluster_count) {
-		pr_err("invalid cluster index %lu.\n", index);
-		return -1;
-	}
-
-	return get_sector(data,
-			heap_start + ((index - 2) * info.cluster_size),
-			clu_per_sec * num);
-}
-
-/**
- * set_clusters - Set Raw-Data from any cluster
- * @data:         cluster raw data
- * @index:        Start cluster index
- * @num:          The number of clusters
- *
- * @return         0 (success)
- *                -1 (failed to read)
- *
- * NOTE: Need to allocate @data before call it.
- */
-int set_clusters(void *data, off_t index, size_t num)
-{
-	size_t clu_per_sec = info.cluster_size / info.sector_size;
-	off_t heap_start = info.heap_offset * info.sector_size;
-
-	if (index < 2 || index + num > info.cluster_count) {
-		pr_err("invalid cluster index %lu.\n", index);
-		return -1;
-	}
-
-	return set_sector(data,
-			heap_start + ((index - 2) * info.cluster_size),
-			clu_per_sec * num);
-}
-
-/**
- * hexdump - Hex dump of a given data
- * @data:    Input data
- * @size:    Input data size
- */
-void hexdump(void *data, size_t size)
-{
-	size_t skip = 0;
-	size_t line, byte = 0;
-	size_t count = size / 0x10;
-	const char zero[0x10] = {0};
-
-	for (line = 0; line < count; line++) {
-		if ((line != count - 1) && (!memcmp(data + line * 0x10, zero, 0x10))) {
-			switch (skip++) {
-				case 0:
-					break;
-				case 1:
-					pr_msg("*\n");
-					/* FALLTHROUGH */
-				default:
-					continue;
-			}
-		} else {
-			skip = 0;
-		}
-
-		pr_msg("%08zX:  ", line * 0x10);
-		for (byte = 0; byte < 0x10; byte++) {
-			pr_msg("%02X ", ((unsigned char *)data)[line * 0x10 + byte]);
-		}
-		putchar(' ');
-		for (byte = 0; byte < 0x10; byte++) {
-			char ch = ((unsigned char *)data)[line * 0x10 + byte];
-			pr_msg("%c", isprint(ch) ? ch : '.');
-		}
-		pr_msg("\n");
-	}
-}
-
-/**
- * gen_rand - generate random string of any characters
- * @data:     Output data (Output)
- * @len:      data length
- */
-void gen_rand(char *data, size_t len)
-{
-	int i;
-	const char strset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-	for (i = 0; i < len; i++)
-		data[i] = strset[rand() % (sizeof(strset) - 1)];
-	data[i] = '\0';
-}
-
-/**
- * check_mounted_filesystem - check if the image has mounted
- *
- * @return                    0 (not mount)
- *                            1 (already mounted)
- */
-static int check_mounted_filesystem(void)
-{
-	FILE *fstab = setmntent("/etc/mtab", "r");
-	struct mntent *e = NULL;
-
-	while ((e = getmntent(fstab)) != NULL) {
-		if (!strcmp(e->mnt_fsname, info.name))
-			return 1;
-	}
-	return 0;
-}
-
-/**
- * init_device_info - Initialize member in struct device_info
- */
-static void init_device_info(void)
-{
-	info.fd = -1;
-	info.attr = 0;
-	info.total_size = 0;
-	info.sector_size = 0;
-	info.cluster_size = 0;
-	info.cluster_count = 0;
-	info.fstype = 0;
-	info.flags = 0;
-	info.fat_offset = 0;
-	info.fat_length = 0;
-	info.heap_offset = 0;
-	info.root_offset = 0;
-	info.root_length = 0;
-	info.alloc_table = NULL;
-	info.upcase_table = NULL;
-	info.upcase_size = 0;
-	info.vol_label = NULL;
-	info.vol_length = 0;
-	info.root_size = DENTRY_LISTSIZE;
-	info.root = calloc(info.root_size, sizeof(node2_t *));
-}
-
-/**
- * get_device_info - get device name and store in device_info
- * @attr:            command line options
- *
- * @return            0 (success)
- *                   -1 (failed to open)
- */
-static int get_device_info(uint32_t attr)
-{
-	int fd;
-	struct stat s;
-
-	if (check_mounted_filesystem() &&
-			!(attr & OPTION_READONLY)) {
-		pr_err("Error has occurred becasue %s has already mounted.\n", info.name);
-		return -1;
-	}
-
-	if ((fd = open(info.name, attr & OPTION_READONLY ? O_RDONLY : O_RDWR)) < 0) {
-		pr_err("open: %s\n", strerror(errno));
-		return -1;
-	}
-
-	if (fstat(fd, &s) < 0) {
-		pr_err("stat: %s\n", strerror(errno));
-		close(fd);
-		return -1;
-	}
-
-	info.fd = fd;
-	info.total_size = s.st_size;
-	return 0;
-}
-
-/**
- * free_dentry_list - release list2_t
- *
- * @return            Number of lists freed
- */
-static int free_dentry_list(void)
-{
-	int i;
-
-	for(i = 0; i < info.root_size && info.root[i]; i++) {
-		info.ops->clean(i);
-	}
-	free(info.root);
-	return i;
-}
-
-/**
- * pseudo_check_filesystem - virtual function to check filesystem
- * @boot:                    boot sector pointer
- *
- * return:                    0 (succeeded in obtaining filesystem)
- *                           -1 (failed)
- */
-static int pseudo_check_filesystem(struct pseudo_bootsec *boot)
-{
-	size_t count = 0;
-
-	count = pread(info.fd, boot, SECSIZE, 0);
-	if (count < 0) {
-		pr_err("read: %s\n", strerror(errno));
-		return -1;
-	}
-
-	if (exfat_check_filesystem(boot))
-		return 0;
-	if (fat_check_filesystem(boot))
-		return 0;
-
-	pr_err("%s can't support this image.\n", PROGRAM_NAME);
-	return -1;
-}
-
-/**
- * print_sector - print any sector
- * @sector:       sector index to display
- *
- * return:        0 (succeeded in obtaining filesystem)
- */
-static int print_sector(uint32_t sector)
-{
-	void *data;
-
-	data = malloc(info.sector_size);
-	if (!get_sector(data, sector, 1)) {
-		pr_msg("Sector #%u:\n", sector);
-		hexdump(data, info.sector_size);
-	}
-	free(data);
-	return 0;
-}
-
-/**
- * print_cluster - print any cluster
- * @index:         cluster index to display
- *
- * @return        0 (success)
- */
-int print_cluster(uint32_t index)
-{
-	void *data;
-
-	data = malloc(info.cluster_size);
-	if (!get_cluster(data, index)) {
-		pr_msg("Cluster #%u:\n", index);
-		hexdump(data, info.cluster_size);
-	}
-	free(data);
-	return 0;
-}
-
 /**
  * format_path - format pathname
  * @dist:        formatted file path (Output)
@@ -468,6 +182,71 @@ static int format_path(char *dist, size_t len, char *str)
 	return 0;
 }
 
+/**
+ * parse_durability - Convert durability policy name
+ * @name:             policy name
+ *
+ * @return            DURABILITY_* (success)
+ *                    -1 (unknown policy)
+ */
+static int parse_durability(const char *name)
+{
+	int i;
+	const char *policies[] = {
+		[DURABILITY_NONE] = "none",
+		[DURABILITY_SESSION] = "session",
+		[DURABILITY_COMMAND] = "command",
+		[DURABILITY_WRITE] = "write",
+	};
+
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		if (!strcmp(name, policies[i]))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * start_batch - Start workers which analyze each image in list
+ * @list:        list file path of images ("-" is stdin)
+ * @jobs:        max number of workers
+ * @outfile:     merged output file, or directory for per-image output (-o)
+ *
+ * @return       image which worker has to analyze (only in worker)
+ *
+ * NOTE: Parent process exits after all workers exit.
+ */
+static const char *start_batch(const char *list, unsigned int jobs, const char *outfile)
+{
+	int failed;
+	struct stat s;
+	struct batch *b;
+	const char *dir = NULL, *image;
+	FILE *merged = stdout;
+
+	if (outfile && !stat(outfile, &s) && S_ISDIR(s.st_mode))
+		dir = outfile;
+	else if (outfile && !(merged = fopen(outfile, "w"))) {
+		fprintf(output, "open: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (!(b = batch_open(list, jobs, dir, merged))) {
+		fprintf(output, "%s: %s\n", list, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if ((image = batch_next(b, &output)))
+		return image;
+
+	failed = batch_close(b);
+	if (failed)
+		fprintf(output, "%d images failed to analyze.\n", failed);
+	if (merged != stdout)
+		fclose(merged);
+	exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
 /**
  * main   - main function
  * @argc:   argument count
@@ -482,12 +261,23 @@ int main(int argc, char *argv[])
 	uint32_t cluster = 0;
 	uint32_t fatent = 0;
 	uint32_t value = 0;
-	uint32_t sector = 0;
+	uint32_t discarded = 0;
+	bool zero = false;
+	off_t sector = 0;
 	char *filepath = NULL;
 	char *outfile = NULL;
+	char *snapshot = NULL;
+	char *capture = NULL;
+	char *expand = NULL;
+	char *batch = NULL;
+	unsigned int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *image;
+	char *sockpath = NULL;
+	size_t captured = 0;
 	char *input = NULL;
 	char out[MAX_NAME_LENGTH + 1] = {};
-	struct pseudo_bootsec bootsec;
+	struct volume_options options = {0};
+	struct volume *vol;
 
 	while ((opt = getopt_long(argc, argv,
 					"ab:c:f:il:o:qrs:u:v",
@@ -498,7 +288,7 @@ int main(int argc, char *argv[])
 				break;
 			case 'b':
 				attr |= OPTION_SECTOR;
-				sector = strtoul(optarg, NULL, 0);
+				sector = strtoull(optarg, NULL, 0);
 				break;
 			case 'c':
 				attr |= OPTION_CLUSTER;
@@ -528,6 +318,81 @@ int main(int argc, char *argv[])
 			case 'v':
 				print_level = PRINT_INFO;
 				break;
+			case GETOPT_DIRECT_CHAR:
+				attr |= OPTION_DIRECT;
+				break;
+			case GETOPT_STATS_CHAR:
+				attr |= OPTION_STATS;
+				break;
+			case GETOPT_TRACE_CHAR:
+				attr |= OPTION_TRACE;
+				options.trace = optarg;
+				break;
+			case GETOPT_PARTITION_CHAR:
+				attr |= OPTION_PARTITION;
+				options.partition = strtoul(optarg, NULL, 0);
+				break;
+			case GETOPT_OFFSET_CHAR:
+				attr |= OPTION_OFFSET;
+				options.offset = strtoull(optarg, NULL, 0);
+				break;
+			case GETOPT_OVERLAY_CHAR:
+				attr |= OPTION_OVERLAY;
+				options.overlay = optarg;
+				break;
+			case GETOPT_JOURNAL_CHAR:
+				attr |= OPTION_JOURNAL;
+				options.journal = optarg;
+				break;
+			case GETOPT_ROLLBACK_CHAR:
+				attr |= OPTION_ROLLBACK;
+				options.journal = optarg;
+				break;
+			case GETOPT_SNAPSHOT_CHAR:
+				attr |= OPTION_SNAPSHOT;
+				snapshot = optarg;
+				break;
+			case GETOPT_RESTORE_CHAR:
+				attr |= OPTION_RESTORE;
+				snapshot = optarg;
+				break;
+			case GETOPT_DISCARD_CHAR:
+				attr |= OPTION_DISCARD;
+				break;
+			case GETOPT_SPARSIFY_CHAR:
+				attr |= OPTION_SPARSIFY;
+				if (optarg && strcmp(optarg, "zero")) {
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				zero = (optarg != NULL);
+				break;
+			case GETOPT_CAPTURE_CHAR:
+				attr |= OPTION_CAPTURE;
+				capture = optarg;
+				break;
+			case GETOPT_EXPAND_CHAR:
+				attr |= OPTION_EXPAND;
+				expand = optarg;
+				break;
+			case GETOPT_DURABILITY_CHAR:
+				attr |= OPTION_DURABILITY;
+				if ((options.durability = parse_durability(optarg)) < 0) {
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case GETOPT_BATCH_CHAR:
+				attr |= OPTION_BATCH;
+				batch = optarg;
+				break;
+			case GETOPT_JOBS_CHAR:
+				jobs = strtoul(optarg, NULL, 0);
+				break;
+			case GETOPT_SERVE_CHAR:
+				attr |= OPTION_SERVE;
+				sockpath = optarg;
+				break;
 			case GETOPT_HELP_CHAR:
 				usage();
 				exit(EXIT_SUCCESS);
@@ -544,83 +409,171 @@ int main(int argc, char *argv[])
 	print_level = PRINT_DEBUG;
 #endif
 
-	switch (argc - optind) {
-		case 1:
-			break;
-		case 2:
-			filepath = argv[optind + 1];
-			break;
-		default:
-			usage();
+	output = stdout;
+
+	/* Batch Mode: --batch option (FILE is given by list) */
+	if (attr & OPTION_BATCH) {
+		if (argc - optind > 1 || (attr & OPTION_BATCH_EXCLUSIVE)) {
+			fprintf(output, "--batch can't be used with -i, or options which use a file for the session.\n");
 			exit(EXIT_FAILURE);
-			break;
+		}
+		if (argc - optind)
+			filepath = argv[optind];
+		/* Only worker returns, and output is already opened */
+		image = start_batch(batch, jobs, (attr & OPTION_OUTPUT) ? outfile : NULL);
+	} else {
+		switch (argc - optind) {
+			case 1:
+				break;
+			case 2:
+				filepath = argv[optind + 1];
+				break;
+			default:
+				usage();
+				exit(EXIT_FAILURE);
+				break;
+		}
+		image = argv[optind];
 	}
 
-	init_device_info();
-	info.attr = attr;
-
-	output = stdout;
-	if (attr & OPTION_OUTPUT) {
+	if ((attr & OPTION_OUTPUT) && !(attr & OPTION_BATCH)) {
 		if ((output = fopen(outfile, "w")) == NULL) {
-			pr_err("open: %s\n", strerror(errno));
-			goto info_release;
+			fprintf(stdout, "open: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
 		}
 	}
 
-	memcpy(info.name, argv[optind], 255);
-	ret = get_device_info(attr);
-	if (ret < 0)
+	options.output = output;
+	if (!(vol = volume_open(image, attr, &options))) {
+		ret = -1;
 		goto output_close;
+	}
+
+	/* Rollback Mode: --rollback option (Filesystem may be broken) */
+	if (attr & OPTION_ROLLBACK) {
+		volume_trace(vol, "rollback");
+		ret = volume_rollback(vol);
+		goto device_close;
+	}
+
+	/* Snapshot: --snapshot, --restore option */
+	if ((attr & OPTION_SNAPSHOT) && (attr & OPTION_RESTORE)) {
+		fprintf(output, "--snapshot and --restore can't be specified at the same time.\n");
+		ret = -1;
+		goto device_close;
+	}
+
+	if (attr & OPTION_RESTORE) {
+		volume_trace(vol, "restore");
+		ret = volume_restore(vol, snapshot);
+		goto device_close;
+	}
+
+	if (attr & OPTION_SNAPSHOT) {
+		volume_trace(vol, "snapshot");
+		if ((ret = volume_snapshot(vol, snapshot)) < 0)
+			goto device_close;
+	}
+
+	/* Expand Mode: --expand option (Filesystem may be broken) */
+	if (attr & OPTION_EXPAND) {
+		volume_trace(vol, "expand");
+		ret = volume_expand(vol, expand);
+		goto device_close;
+	}
 
-	ret = pseudo_check_filesystem(&bootsec);
+	ret = volume_load(vol);
 	if (ret < 0)
 		goto device_close;
 
+	/* Server Mode: --serve option */
+	if (attr & OPTION_SERVE) {
+		if (attr & OPTION_INTERACTIVE) {
+			fprintf(output, "--serve and -i can't be specified at the same time.\n");
+			ret = -1;
+			goto device_close;
+		}
+		ret = volume_serve(vol, sockpath);
+		goto device_close;
+	}
+
 	/* Interactive Mode: -i option */
 	if (attr & OPTION_INTERACTIVE) {
-		shell();
+		volume_shell(vol);
 		goto device_close;
 	}
 
 	/* Filesystem statistic: default or -a option */
-	if (!attr || (attr & OPTION_ALL)) {
-		ret = info.ops->statfs();
+	if (!(attr & ~OPTION_MODIFIER) || (attr & OPTION_ALL)) {
+		volume_trace(vol, "statfs");
+		ret = volume_statfs(vol);
 		if (ret < 0)
 			goto device_close;
 	}
 
 	/* Command line: -a option */
 	if (attr & OPTION_ALL) {
-		ret = info.ops->info();
+		volume_trace(vol, "info");
+		ret = volume_info(vol);
 		if (ret < 0)
 			goto device_close;
 	}
 
 	/* Command line: -f option */
 	if (attr & OPTION_FATENT) {
-		ret = info.ops->getfat(fatent, &value);
-		pr_msg("Get: Cluster %u is FAT entry %08x\n", fatent, value);
+		volume_trace(vol, "getfat");
+		ret = volume_getfat(vol, fatent, &value);
+		fprintf(output, "Get: Cluster %u is FAT entry %08x\n", fatent, value);
 		if (ret < 0)
 			goto device_close;
 	}
 
 	/* Command line: -u option */
 	if (attr & OPTION_UPPER) {
-		ret = info.ops->convert(input, strlen(input), out);
+		volume_trace(vol, "convert");
+		ret = volume_convert(vol, input, strlen(input), out);
 		if(ret < 0)
-			goto out;
-		pr_msg("Convert: %s -> %s\n", input, out);
+			goto device_close;
+		fprintf(output, "Convert: %s -> %s\n", input, out);
 	}
 
 	/* Command line: -c, -s option */
 	if ((attr & OPTION_SECTOR) || (attr & OPTION_CLUSTER)) {
+		volume_trace(vol, "dump");
 		if (attr & OPTION_CLUSTER)
-			ret = print_cluster(cluster);
+			ret = volume_print_cluster(vol, cluster);
 		else
-			ret = print_sector(sector);
+			ret = volume_print_sector(vol, sector);
 
 		if (ret < 0)
-			goto out;
+			goto device_close;
+	}
+
+	/* Command line: --discard-free option */
+	if (attr & OPTION_DISCARD) {
+		volume_trace(vol, "discard");
+		ret = volume_discard(vol, &discarded);
+		if (ret < 0)
+			goto device_close;
+		fprintf(output, "Discard: %u clusters.\n", discarded);
+	}
+
+	/* Command line: --sparsify option */
+	if (attr & OPTION_SPARSIFY) {
+		volume_trace(vol, "sparsify");
+		ret = volume_sparsify(vol, zero, &discarded);
+		if (ret < 0)
+			goto device_close;
+		fprintf(output, "Sparsify: %u clusters.\n", discarded);
+	}
+
+	/* Command line: --capture option */
+	if (attr & OPTION_CAPTURE) {
+		volume_trace(vol, "capture");
+		ret = volume_capture(vol, capture, &captured);
+		if (ret < 0)
+			goto device_close;
+		fprintf(output, "Capture: %zu bytes.\n", captured);
 	}
 
 	/* file argument */
@@ -628,29 +581,24 @@ int main(int argc, char *argv[])
 		uint32_t p_clu;
 		char *tmp;
 
+		volume_trace(vol, "stat");
 		tmp = calloc(strlen(filepath) + 1, sizeof(char));
 		format_path(tmp, strlen(filepath) + 1, filepath);
-		filepath = strtok_dir(tmp);
-		p_clu = info.ops->lookup(info.root_offset, tmp);
-		ret = info.ops->stat(filepath, p_clu);
+		/* Divide formatted path (always starts with "/") into directory and file */
+		filepath = strrchr(tmp, '/');
+		*filepath++ = '\0';
+		p_clu = volume_lookup(vol, volume_root(vol), tmp);
+		ret = volume_stat(vol, filepath, p_clu);
 
 		free(tmp);
 	}
 
-out:
-	free(info.vol_label);
-	free(info.upcase_table);
-	free(info.alloc_table);
-
 device_close:
-	close(info.fd);
+	volume_close(vol);
 
 output_close:
 	if (attr & OPTION_OUTPUT)
 		fclose(output);
 
-info_release:
-	free_dentry_list();
-
 	return ret;
 }
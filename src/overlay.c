@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "bitmap.h"
+#include "overlay.h"
+
+struct overlay {
+	int fd;
+	size_t size;
+	size_t block_size;
+	off_t data_offset;
+	bitmap_t index;
+	size_t index_size;
+	bool dirty;
+	void *buf;
+};
+
+/**
+ * overlay_probe - Check whether file is overlay
+ * @fd:            file descriptor
+ * @size:          volume size (Output)
+ *
+ * @return         true (file has overlay header)
+ */
+bool overlay_probe(int fd, size_t *size)
+{
+	struct overlay_header h;
+
+	if (pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+			memcmp(h.magic, OVERLAY_MAGIC, sizeof(h.magic)) || h.version != OVERLAY_VERSION)
+		return false;
+
+	*size = h.size;
+	return true;
+}
+
+/**
+ * overlay_open - Open overlay file for volume
+ * @path:         overlay file path
+ * @size:         volume size
+ * @readonly:     open without write permission
+ *
+ * @return        overlay
+ *                NULL (failed to open, or overlay is for another volume)
+ *
+ * NOTE: New overlay file is created if it doesn't exist or is empty.
+ *       In read-only session, such overlay is treated as no written block.
+ */
+struct overlay *overlay_open(const char *path, size_t size, bool readonly)
+{
+	struct overlay *o;
+	struct overlay_header h = {0};
+	struct stat s;
+	size_t num;
+
+	if (!(o = calloc(1, sizeof(struct overlay))))
+		return NULL;
+
+	o->fd = -1;
+	o->size = size;
+	o->block_size = OVERLAY_BLOCK_SIZE;
+	num = (size + o->block_size - 1) / o->block_size;
+	init_bitmap(&o->index, num);
+	o->index_size = num / CHAR_BIT + 1;
+	o->data_offset = (sizeof(h) + o->index_size + o->block_size - 1) / o->block_size * o->block_size;
+
+	if (!o->index.data || !(o->buf = malloc(o->block_size)))
+		goto err;
+
+	o->fd = open(path, readonly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+	if (o->fd < 0 && errno == ENOENT && readonly)
+		return o;
+	if (o->fd < 0 || fstat(o->fd, &s) < 0)
+		goto err;
+
+	/* Empty overlay has no written block */
+	if (!s.st_size && readonly)
+		return o;
+
+	if (!s.st_size) {
+		memcpy(h.magic, OVERLAY_MAGIC, sizeof(h.magic));
+		h.version = OVERLAY_VERSION;
+		h.block_size = o->block_size;
+		h.size = size;
+		h.data_offset = o->data_offset;
+		if (pwrite(o->fd, &h, sizeof(h), 0) != sizeof(h))
+			goto err;
+		o->dirty = true;
+		return o;
+	}
+
+	/* Existing overlay must be created for the same volume */
+	if (pread(o->fd, &h, sizeof(h), 0) != sizeof(h) ||
+			memcmp(h.magic, OVERLAY_MAGIC, sizeof(h.magic)) || h.version != OVERLAY_VERSION ||
+			h.block_size != o->block_size || h.size != size || h.data_offset != o->data_offset) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	if (pread(o->fd, o->index.data, o->index_size, sizeof(h)) != o->index_size) {
+		errno = EINVAL;
+		goto err;
+	}
+	return o;
+
+err:
+	if (o->fd >= 0)
+		close(o->fd);
+	free(o->buf);
+	free_bitmap(&o->index);
+	free(o);
+	return NULL;
+}
+
+/**
+ * overlay_sync - Write back block index
+ * @o:            overlay
+ *
+ * @return         0 (success)
+ *                -1 (failed to write)
+ */
+int overlay_sync(struct overlay *o)
+{
+	if (!o || !o->dirty)
+		return 0;
+
+	if (pwrite(o->fd, o->index.data, o->index_size, sizeof(struct overlay_header)) != o->index_size)
+		return -1;
+
+	o->dirty = false;
+	return 0;
+}
+
+/**
+ * overlay_datasync - Make written blocks and block index durable
+ * @o:                overlay
+ *
+ * @return             0 (success)
+ *                    -1 (failed to write or sync)
+ */
+int overlay_datasync(struct overlay *o)
+{
+	if (overlay_sync(o))
+		return -1;
+	return fdatasync(o->fd);
+}
+
+/**
+ * overlay_reset - Discard all written blocks
+ * @o:             overlay
+ *
+ * @return          0 (success)
+ *                 -1 (failed to truncate)
+ */
+int overlay_reset(struct overlay *o)
+{
+	if (ftruncate(o->fd, o->data_offset))
+		return -1;
+
+	memset(o->index.data, 0, o->index_size);
+	o->dirty = true;
+	return overlay_sync(o);
+}
+
+/**
+ * overlay_merge - Write all written blocks to base volume
+ * @o:             overlay
+ * @write:         write function of base volume
+ *
+ * @return          0 (success)
+ *                 -1 (failed to read or write)
+ */
+int overlay_merge(struct overlay *o, overlay_write_t write)
+{
+	size_t block, len;
+	off_t offset;
+	ssize_t count;
+
+	for (block = 0; block < o->index.size; block++) {
+		if (!get_bitmap(&o->index, block))
+			continue;
+
+		offset = block * o->block_size;
+		len = o->size - offset < o->block_size ? o->size - offset : o->block_size;
+		if ((count = pread(o->fd, o->buf, len, o->data_offset + offset)) < 0)
+			return -1;
+		memset(o->buf + count, 0, len - count);
+		if (write(o->buf, offset, len))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * overlay_close - Write back block index and close overlay
+ * @o:             overlay
+ */
+void overlay_close(struct overlay *o)
+{
+	if (!o)
+		return;
+
+	overlay_sync(o);
+	if (o->fd >= 0)
+		close(o->fd);
+	free(o->buf);
+	free_bitmap(&o->index);
+	free(o);
+}
+
+/**
+ * overlay_run - Get length of region which is in the same state
+ * @o:           overlay
+ * @offset:      Start bytes
+ * @len:         Length of the region
+ * @written:     whether first block is in overlay (Output)
+ *
+ * @return       bytes (until the state changes, or @len)
+ */
+static size_t overlay_run(struct overlay *o, off_t offset, size_t len, bool *written)
+{
+	size_t block = offset / o->block_size;
+	size_t run = (block + 1) * o->block_size - offset;
+
+	*written = get_bitmap(&o->index, block);
+	for (block++; run < len && !get_bitmap(&o->index, block) == !*written; block++)
+		run += o->block_size;
+
+	return run < len ? run : len;
+}
+
+/**
+ * overlay_read - Read data from overlay, or base volume
+ * @o:            overlay
+ * @data:         buffer (Output)
+ * @offset:       Start bytes
+ * @len:          read length
+ * @base:         read function of base volume
+ *
+ * @return         0 (success)
+ *                -1 (failed to read)
+ *
+ * NOTE: Beyond the end of volume is treated as zero.
+ */
+int overlay_read(struct overlay *o, void *data, off_t offset, size_t len, overlay_read_t base)
+{
+	size_t run;
+	ssize_t count;
+	bool written;
+
+	while (len && offset < o->size) {
+		run = overlay_run(o, offset, len, &written);
+		if (run > o->size - offset)
+			run = o->size - offset;
+
+		if (!written) {
+			if (base(data, offset, run))
+				return -1;
+		} else {
+			if ((count = pread(o->fd, data, run, o->data_offset + offset)) < 0)
+				return -1;
+			memset(data + count, 0, run - count);
+		}
+		data += run;
+		offset += run;
+		len -= run;
+	}
+
+	memset(data, 0, len);
+	return 0;
+}
+
+/**
+ * overlay_skip - Check whether block doesn't need to be stored
+ * @o:            overlay
+ * @data:         block data
+ * @block:        block index
+ *
+ * @return        true (unwritten block is written by zero)
+ */
+static bool overlay_skip(struct overlay *o, const void *data, size_t block)
+{
+	const unsigned char *p = data;
+
+	return !get_bitmap(&o->index, block) && !p[0] && !memcmp(p, p + 1, o->block_size - 1);
+}
+
+/**
+ * overlay_write - Write data to overlay
+ * @o:             overlay
+ * @data:          buffer
+ * @offset:        Start bytes
+ * @len:           write length
+ * @base:          read function of base volume
+ *
+ * @return          0 (success)
+ *                 -1 (failed to write, or beyond the end of volume)
+ *
+ * NOTE: Block which is written partially at first is copied from base volume.
+ *       Zero block which is written at first isn't stored, and remains hole.
+ */
+int overlay_write(struct overlay *o, const void *data, off_t offset, size_t len, overlay_read_t base)
+{
+	size_t block, head, run;
+
+	if (offset + len > o->size) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	while (len) {
+		block = offset / o->block_size;
+		head = offset % o->block_size;
+		run = o->block_size - head;
+		if (run > len)
+			run = len;
+
+		if (run != o->block_size && !get_bitmap(&o->index, block)) {
+			/* Partial write needs the rest of block */
+			if (base(o->buf, block * o->block_size, o->block_size))
+				return -1;
+			memcpy(o->buf + head, data, run);
+			if (pwrite(o->fd, o->buf, o->block_size,
+						o->data_offset + block * o->block_size) != o->block_size)
+				return -1;
+		} else if (run == o->block_size && overlay_skip(o, data, block)) {
+			/* Unwritten block is hole, so it is already zero */
+		} else {
+			/* Whole blocks are written at once */
+			if (run == o->block_size)
+				while (run + o->block_size <= len &&
+						!overlay_skip(o, data + run, block + run / o->block_size))
+					run += o->block_size;
+			if (pwrite(o->fd, data, run, o->data_offset + offset) != run)
+				return -1;
+		}
+
+		for (; block * o->block_size < offset + run; block++)
+			set_bitmap(&o->index, block);
+		o->dirty = true;
+		data += run;
+		offset += run;
+		len -= run;
+	}
+	return 0;
+}
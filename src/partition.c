@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "partition.h"
+
+/* MBR is always addressed by 512 bytes sector */
+#define MBR_SECTOR_SIZE  512
+
+/**
+ * is_extended - Check whether MBR entry is extended partition
+ * @type:        partition type
+ *
+ * @return       true (entry links to EBR)
+ */
+static bool is_extended(uint8_t type)
+{
+	return type == 0x05 || type == 0x0F || type == 0x85;
+}
+
+/**
+ * read_mbr - Read partition entries in MBR/EBR
+ * @read:     read function
+ * @offset:   Start bytes of MBR/EBR
+ * @entry:    partition entries (Output)
+ *
+ * @return     0 (success)
+ *            -1 (failed to read, or signature is invalid)
+ */
+static int read_mbr(partition_read_t read, off_t offset, struct mbr_entry *entry)
+{
+	uint8_t sector[MBR_SECTOR_SIZE];
+
+	if (read(sector, offset, MBR_SECTOR_SIZE))
+		return -1;
+
+	if ((sector[510] | (sector[511] << 8)) != MBR_SIGNATURE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(entry, sector + MBR_ENTRY_OFFSET, sizeof(struct mbr_entry) * MBR_ENTRIES);
+	return 0;
+}
+
+/**
+ * get_logical_partition - Search logical partition in extended partition
+ * @read:                  read function
+ * @ext:                   extended partition entry in MBR
+ * @index:                 logical partition number (start with 5)
+ * @part:                  partition (Output)
+ *
+ * @return                  0 (success)
+ *                         -1 (partition doesn't exist)
+ */
+static int get_logical_partition(partition_read_t read, struct mbr_entry *ext,
+		unsigned int index, struct partition *part)
+{
+	unsigned int i;
+	off_t base = (off_t)ext->StartingLBA * MBR_SECTOR_SIZE;
+	off_t ebr = base;
+	struct mbr_entry entry[MBR_ENTRIES];
+
+	/* Each EBR has one logical partition and link to the next EBR */
+	for (i = MBR_ENTRIES + 1; i < MBR_ENTRIES + 1 + MBR_LOGICAL_MAX; i++) {
+		if (read_mbr(read, ebr, entry))
+			return -1;
+		if (i == index) {
+			if (entry[0].PartitionType == MBR_TYPE_EMPTY)
+				break;
+			part->offset = ebr + (off_t)entry[0].StartingLBA * MBR_SECTOR_SIZE;
+			part->length = (off_t)entry[0].SizeInLBA * MBR_SECTOR_SIZE;
+			return 0;
+		}
+		if (!is_extended(entry[1].PartitionType))
+			break;
+		ebr = base + (off_t)entry[1].StartingLBA * MBR_SECTOR_SIZE;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+/**
+ * get_gpt_partition - Search partition in GPT
+ * @read:              read function
+ * @index:             partition number (start with 1)
+ * @part:              partition (Output)
+ *
+ * @return              0 (success)
+ *                     -1 (partition doesn't exist)
+ *
+ * NOTE: GPT header is searched at LBA 1 for 512 and 4096 bytes sector.
+ */
+static int get_gpt_partition(partition_read_t read, unsigned int index, struct partition *part)
+{
+	size_t lba;
+	struct gpt_header h;
+	struct gpt_entry e;
+	static const uint8_t unused[16] = {0};
+
+	for (lba = MBR_SECTOR_SIZE; lba <= 4096; lba *= 8) {
+		if (read(&h, lba, sizeof(h)))
+			return -1;
+		if (!memcmp(h.Signature, GPT_SIGNATURE, sizeof(h.Signature)))
+			break;
+	}
+
+	if (lba > 4096 || h.SizeOfPartitionEntry < GPT_ENTRY_MIN ||
+			h.NumberOfPartitionEntries > GPT_ENTRIES_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (index > h.NumberOfPartitionEntries) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (read(&e, h.PartitionEntryLBA * lba + (off_t)(index - 1) * h.SizeOfPartitionEntry, sizeof(e)))
+		return -1;
+
+	if (!memcmp(e.PartitionTypeGUID, unused, sizeof(unused)) || e.EndingLBA < e.StartingLBA) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	part->offset = e.StartingLBA * lba;
+	part->length = (e.EndingLBA - e.StartingLBA + 1) * lba;
+	return 0;
+}
+
+/**
+ * get_partition - Search partition in MBR or GPT
+ * @read:          read function
+ * @index:         partition number (start with 1)
+ * @part:          partition (Output)
+ *
+ * @return          0 (success)
+ *                 -1 (partition doesn't exist, errno is set)
+ *
+ * NOTE: Partition number is the same as Linux (e.g. /dev/sdaN).
+ */
+int get_partition(partition_read_t read, unsigned int index, struct partition *part)
+{
+	int i;
+	struct mbr_entry entry[MBR_ENTRIES];
+
+	if (!index) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (read_mbr(read, 0, entry))
+		return -1;
+
+	for (i = 0; i < MBR_ENTRIES; i++) {
+		if (entry[i].PartitionType == MBR_TYPE_GPT)
+			return get_gpt_partition(read, index, part);
+	}
+
+	if (index > MBR_ENTRIES) {
+		for (i = 0; i < MBR_ENTRIES; i++) {
+			if (is_extended(entry[i].PartitionType))
+				return get_logical_partition(read, &entry[i], index, part);
+		}
+		errno = ENOENT;
+		return -1;
+	}
+
+	i = index - 1;
+	if (entry[i].PartitionType == MBR_TYPE_EMPTY || is_extended(entry[i].PartitionType)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	part->offset = (off_t)entry[i].StartingLBA * MBR_SECTOR_SIZE;
+	part->length = (off_t)entry[i].SizeInLBA * MBR_SECTOR_SIZE;
+	return 0;
+}
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "debugfatfs.h"
+#include "shell.h"
+#include "serve.h"
+
+struct serve_client {
+	int fd;
+	size_t len;
+	char buf[sizeof(struct serve_header) + CMD_MAXLEN];
+	struct shell_session *session;
+	/* Responses which aren't sent yet */
+	char *out;
+	size_t out_len;
+	size_t out_pos;
+	bool closing;
+};
+
+static volatile sig_atomic_t serve_stop = 0;
+
+/**
+ * serve_signal - Stop server
+ * @sig:          signal number
+ */
+static void serve_signal(int sig)
+{
+	serve_stop = 1;
+}
+
+/**
+ * serve_listen - Create UNIX domain socket
+ * @path:         socket path
+ *
+ * @return        listening socket
+ *                -1 (failed to create)
+ *
+ * NOTE: Stale socket (e.g. left by killed server) is replaced.
+ */
+static int serve_listen(const char *path)
+{
+	int fd;
+	struct stat s;
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	if (!stat(path, &s) && S_ISSOCK(s.st_mode))
+		unlink(path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * serve_queue - Queue response to client
+ * @c:           client
+ * @status:      SERVE_OK or SERVE_CLOSED
+ * @data:        output of command
+ * @len:         length of output
+ *
+ * @return        0 (success)
+ *               -1 (failed to allocate)
+ */
+static int serve_queue(struct serve_client *c, uint32_t status, char *data, size_t len)
+{
+	char *tmp;
+	struct serve_header h = {htonl(len), htonl(status)};
+
+	if (!(tmp = realloc(c->out, c->out_len + sizeof(h) + len)))
+		return -1;
+	c->out = tmp;
+	memcpy(c->out + c->out_len, &h, sizeof(h));
+	memcpy(c->out + c->out_len + sizeof(h), data, len);
+	c->out_len += sizeof(h) + len;
+	return 0;
+}
+
+/**
+ * serve_flush - Send queued responses to client
+ * @c:           client
+ *
+ * @return        0 (success, or socket buffer is full)
+ *               -1 (failed to send, or session is closed and all is sent)
+ *
+ * NOTE: Client socket is non-blocking, so that a client which doesn't
+ *       read responses never stalls the others.
+ */
+static int serve_flush(struct serve_client *c)
+{
+	ssize_t count;
+
+	while (c->out_pos < c->out_len) {
+		if ((count = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -1;
+		}
+		c->out_pos += count;
+	}
+
+	free(c->out);
+	c->out = NULL;
+	c->out_len = c->out_pos = 0;
+	return c->closing ? -1 : 0;
+}
+
+/**
+ * serve_execute - Execute command and queue its output
+ * @c:             client
+ * @cmd:           command line
+ *
+ * @return          0 (success)
+ *                 -1 (failed to queue)
+ *
+ * NOTE: Output of command (including errors) is captured by switching output of this thread.
+ */
+static int serve_execute(struct serve_client *c, char *cmd)
+{
+	int ret, closed;
+	char *data = NULL;
+	size_t len = 0;
+	FILE *fp, *saved = output;
+
+	if (!(fp = open_memstream(&data, &len)))
+		return -1;
+
+	output = fp;
+	closed = shell_execute(c->session, cmd);
+	output = saved;
+	fclose(fp);
+
+	ret = serve_queue(c, closed ? SERVE_CLOSED : SERVE_OK, data, len);
+	free(data);
+	c->closing = closed;
+	return ret;
+}
+
+/**
+ * serve_receive - Receive requests from client, and execute them
+ * @c:             client
+ *
+ * @return          0 (success)
+ *                 -1 (connection is closed, or broken request)
+ *
+ * NOTE: Responses are only queued, serve_flush() sends them.
+ */
+static int serve_receive(struct serve_client *c)
+{
+	ssize_t count;
+	size_t len;
+	struct serve_header h;
+	char cmd[CMD_MAXLEN];
+
+	while ((count = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0)) < 0 && errno == EINTR)
+		;
+	if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+	if (count <= 0)
+		return -1;
+	c->len += count;
+
+	/* Buffer may have several requests, and no more after exit */
+	while (c->len >= sizeof(h) && !c->closing) {
+		memcpy(&h, c->buf, sizeof(h));
+		len = ntohl(h.length);
+		if (len >= CMD_MAXLEN)
+			return -1;
+		if (c->len < sizeof(h) + len)
+			break;
+
+		memcpy(cmd, c->buf + sizeof(h), len);
+		cmd[len] = '\0';
+		c->len -= sizeof(h) + len;
+		memmove(c->buf, c->buf + sizeof(h) + len, c->len);
+
+		if (serve_execute(c, cmd))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * serve_close - Disconnect client
+ * @c:           client
+ */
+static void serve_close(struct serve_client *c)
+{
+	close(c->fd);
+	shell_close(c->session);
+	free(c->out);
+	c->fd = -1;
+	c->len = 0;
+	c->session = NULL;
+	c->out = NULL;
+	c->out_len = c->out_pos = 0;
+	c->closing = false;
+}
+
+/**
+ * serve_accept - Accept new client
+ * @fd:           listening socket
+ * @clients:      clients
+ */
+static void serve_accept(int fd, struct serve_client *clients)
+{
+	int i, client;
+
+	if ((client = accept(fd, NULL, NULL)) < 0)
+		return;
+
+	for (i = 0; i < SERVE_MAX_CLIENTS; i++) {
+		if (clients[i].fd < 0)
+			break;
+	}
+
+	if (i == SERVE_MAX_CLIENTS) {
+		pr_warn("Client is rejected, too many clients.\n");
+		close(client);
+		return;
+	}
+
+	if (fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK) ||
+			!(clients[i].session = shell_open())) {
+		pr_warn("Client is rejected: %s.\n", strerror(errno));
+		close(client);
+		return;
+	}
+	clients[i].fd = client;
+}
+
+/**
+ * serve - Accept commands of interactive mode from UNIX domain socket
+ * @path:  socket path
+ *
+ * @return  0 (stopped by SIGINT or SIGTERM)
+ *         -1 (failed to start)
+ *
+ * NOTE: Each client has its own shell session (e.g. current directory),
+ *       and commands are executed one by one with shared caches.
+ *       Client isn't read while its responses are left in queue.
+ */
+int serve(const char *path)
+{
+	int i, num, fd;
+	int index[SERVE_MAX_CLIENTS + 1];
+	struct pollfd fds[SERVE_MAX_CLIENTS + 1];
+	struct serve_client *clients, *c;
+	struct sigaction sa = {.sa_handler = serve_signal};
+
+	if (!(clients = calloc(SERVE_MAX_CLIENTS, sizeof(struct serve_client))))
+		return -1;
+	for (i = 0; i < SERVE_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
+	if ((fd = serve_listen(path)) < 0) {
+		pr_err("%s: %s\n", path, strerror(errno));
+		free(clients);
+		return -1;
+	}
+
+	/* poll() is interrupted to stop server */
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!serve_stop) {
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		for (i = 0, num = 1; i < SERVE_MAX_CLIENTS; i++) {
+			if (clients[i].fd < 0)
+				continue;
+			fds[num].fd = clients[i].fd;
+			/* Next requests wait until responses are sent */
+			fds[num].events = clients[i].out_len ? POLLOUT : POLLIN;
+			index[num++] = i;
+		}
+
+		if (poll(fds, num, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("poll: %s\n", strerror(errno));
+			break;
+		}
+
+		for (i = 1; i < num; i++) {
+			c = &clients[index[i]];
+			if (!fds[i].revents)
+				continue;
+			if (!(fds[i].events & POLLOUT) && serve_receive(c)) {
+				serve_close(c);
+				continue;
+			}
+			/* Response is sent at once if socket buffer has room */
+			if (c->out_len && serve_flush(c))
+				serve_close(c);
+		}
+		if (fds[0].revents & POLLIN)
+			serve_accept(fd, clients);
+	}
+
+	for (i = 0; i < SERVE_MAX_CLIENTS; i++) {
+		if (clients[i].fd >= 0)
+			serve_close(&clients[i]);
+	}
+	close(fd);
+	unlink(path);
+	free(clients);
+	return 0;
+}
@@ -9,7 +9,13 @@
 #include "shell.h"
 #include "debugfatfs.h"
 
-static uint32_t cluster = 0;
+static __thread uint32_t cluster = 0;
+
+struct shell_session {
+	char **argv;
+	char **envp;
+	uint32_t cluster;
+};
 
 static int format_path(char *, size_t, char *, char **);
 
@@ -30,6 +36,14 @@ static int cmd_trim(int, char **, char **);
 static int cmd_fill(int, char **, char **);
 static int cmd_tail(int, char **, char **);
 static int cmd_stat(int, char **, char **);
+static int cmd_iostat(int, char **, char **);
+static int cmd_rollback(int, char **, char **);
+static int cmd_snapshot(int, char **, char **);
+static int cmd_restore(int, char **, char **);
+static int cmd_discard(int, char **, char **);
+static int cmd_sparsify(int, char **, char **);
+static int cmd_capture(int, char **, char **);
+static int cmd_expand(int, char **, char **);
 static int cmd_help(int, char **, char **);
 static int cmd_exit(int, char **, char **);
 
@@ -51,6 +65,14 @@ struct command cmd[] = {
 	{"fill", cmd_fill},
 	{"tail", cmd_tail},
 	{"stat", cmd_stat},
+	{"iostat", cmd_iostat},
+	{"rollback", cmd_rollback},
+	{"snapshot", cmd_snapshot},
+	{"restore", cmd_restore},
+	{"discard", cmd_discard},
+	{"sparsify", cmd_sparsify},
+	{"capture", cmd_capture},
+	{"expand", cmd_expand},
 	{"help", cmd_help},
 	{"exit", cmd_exit},
 };
@@ -72,16 +94,16 @@ static int cmd_ls(int argc, char **argv, char **envp)
 	struct directory *dirs = NULL, *dirs_tmp = NULL;
 
 	dirs = malloc(sizeof(struct directory) * DIRECTORY_FILES);
-	ret = info.ops->readdir(dirs, DIRECTORY_FILES, cluster);
+	ret = info->ops->readdir(dirs, DIRECTORY_FILES, cluster);
 	if (ret < 0) {
 		/* Only once, expand dirs structure and execute readdir */
 		ret = abs(ret) + 1;
 		dirs_tmp = realloc(dirs, sizeof(struct directory) * (DIRECTORY_FILES + ret));
 		if (dirs_tmp) {
 			dirs = dirs_tmp;
-			ret = info.ops->readdir(dirs, DIRECTORY_FILES + ret, cluster);
+			ret = info->ops->readdir(dirs, DIRECTORY_FILES + ret, cluster);
 		} else {
-			fprintf(stdout, "ls: failed to load firectory.\n");
+			pr_msg("ls: failed to load firectory.\n");
 			return 1;
 		}
 	}
@@ -92,18 +114,18 @@ static int cmd_ls(int argc, char **argv, char **envp)
 		snprintf(time, sizeof(time), "%d-%02d-%02d %02d:%02d:%02d",
 			1980 + t.tm_year, t.tm_mon, t.tm_mday,
 			t.tm_hour, t.tm_min, t.tm_sec);
-		fprintf(stdout, "%c", (dirs[i].attr & ATTR_READ_ONLY) ? ro : '-');
-		fprintf(stdout, "%c", (dirs[i].attr & ATTR_HIDDEN) ? hidden : '-');
-		fprintf(stdout, "%c", (dirs[i].attr & ATTR_SYSTEM) ? sys : '-');
-		fprintf(stdout, "%c", (dirs[i].attr & ATTR_DIRECTORY) ? dir : '-');
-		fprintf(stdout, "%c", (dirs[i].attr & ATTR_ARCHIVE) ? arch : '-');
-		fprintf(stdout, " %s", len);
-		fprintf(stdout, " %s", time);
-		fprintf(stdout, " %s ", dirs[i].name);
-		fprintf(stdout, "\n");
-	}
-
-	fprintf(stdout, "\n");
+		pr_msg("%c", (dirs[i].attr & ATTR_READ_ONLY) ? ro : '-');
+		pr_msg("%c", (dirs[i].attr & ATTR_HIDDEN) ? hidden : '-');
+		pr_msg("%c", (dirs[i].attr & ATTR_SYSTEM) ? sys : '-');
+		pr_msg("%c", (dirs[i].attr & ATTR_DIRECTORY) ? dir : '-');
+		pr_msg("%c", (dirs[i].attr & ATTR_ARCHIVE) ? arch : '-');
+		pr_msg(" %s", len);
+		pr_msg(" %s", time);
+		pr_msg(" %s ", dirs[i].name);
+		pr_msg("\n");
+	}
+
+	pr_msg("\n");
 	return 0;
 }
 
@@ -123,16 +145,16 @@ static int cmd_cd(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			dir = info.root_offset;
+			dir = info->root_offset;
 			snprintf(pwd, ARG_MAXLEN, "/");
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
-			dir = info.ops->lookup(cluster, buf);
+			dir = info->ops->lookup(cluster, buf);
 			snprintf(pwd, ARG_MAXLEN, "%s", buf);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 
@@ -156,13 +178,13 @@ static int cmd_cluster(int argc, char **argv, char **envp)
 {
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			print_cluster(strtoul(argv[1], NULL, 10));
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 
@@ -183,15 +205,15 @@ static int cmd_alloc(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			index = strtoul(argv[1], NULL, 10);
-			info.ops->alloc(index);
-			fprintf(stdout, "Alloc: cluster %u.\n", index);
+			info->ops->alloc(index);
+			pr_msg("Alloc: cluster %u.\n", index);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -211,15 +233,15 @@ static int cmd_release(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			index = strtoul(argv[1], NULL, 10);
-			info.ops->release(index);
-			fprintf(stdout, "Release: cluster %u.\n", index);
+			info->ops->release(index);
+			pr_msg("Release: cluster %u.\n", index);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -239,21 +261,21 @@ static int cmd_fat(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			index = strtoul(argv[1], NULL, 10);
-			info.ops->getfat(index, &entry);
-			fprintf(stdout, "Get: Cluster %u is FAT entry %08x\n", index, entry);
+			info->ops->getfat(index, &entry);
+			pr_msg("Get: Cluster %u is FAT entry %08x\n", index, entry);
 			break;
 		case 3:
 			index = strtoul(argv[1], NULL, 10);
 			entry = strtoul(argv[2], NULL, 16);
-			info.ops->setfat(index, entry);
-			fprintf(stdout, "Set: Cluster %u is FAT entry %08x\n", index, entry);
+			info->ops->setfat(index, entry);
+			pr_msg("Set: Cluster %u is FAT entry %08x\n", index, entry);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -275,17 +297,17 @@ static int cmd_create(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->create(filename, dir);
-			info.ops->reload(dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->create(filename, dir);
+			info->ops->reload(dir);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -307,17 +329,17 @@ static int cmd_mkdir(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->mkdir(filename, dir);
-			info.ops->reload(dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->mkdir(filename, dir);
+			info->ops->reload(dir);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -339,17 +361,17 @@ static int cmd_remove(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->remove(filename, dir);
-			info.ops->reload(dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->remove(filename, dir);
+			info->ops->reload(dir);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -371,17 +393,17 @@ static int cmd_rmdir(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->rmdir(filename, dir);
-			info.ops->reload(dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->rmdir(filename, dir);
+			info->ops->reload(dir);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -399,10 +421,10 @@ static int cmd_trim(int argc, char **argv, char **envp)
 {
 	switch (argc) {
 		case 1:
-			info.ops->trim(cluster);
+			info->ops->trim(cluster);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -422,17 +444,17 @@ static int cmd_fill(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			info.ops->fill(cluster, info.cluster_size / sizeof(struct exfat_dentry));
+			info->ops->fill(cluster, info->cluster_size / sizeof(struct exfat_dentry));
 			break;
 		case 2:
 			count = strtoul(argv[1], NULL, 10);
-			info.ops->fill(cluster, count);
+			info->ops->fill(cluster, count);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
-	info.ops->reload(cluster);
+	info->ops->reload(cluster);
 
 	return 0;
 }
@@ -453,16 +475,16 @@ static int cmd_tail(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->contents(filename, dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->contents(filename, dir);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -484,16 +506,240 @@ static int cmd_stat(int argc, char **argv, char **envp)
 
 	switch (argc) {
 		case 1:
-			fprintf(stdout, "%s: too few arguments.\n", argv[0]);
+			pr_msg("%s: too few arguments.\n", argv[0]);
 			break;
 		case 2:
 			format_path(buf, ARG_MAXLEN, argv[1], envp);
 			filename = strtok_dir(buf);
-			dir = info.ops->lookup(cluster, buf);
-			info.ops->stat(filename, dir);
+			dir = info->ops->lookup(cluster, buf);
+			info->ops->stat(filename, dir);
+			break;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * cmd_iostat - Display I/O statistics.
+ * @argc:       argument count
+ * @argv:       argument vetor
+ * @envp:       environment pointer
+ *
+ * @return      0 (success)
+ */
+static int cmd_iostat(int argc, char **argv, char **envp)
+{
+	switch (argc) {
+		case 1:
+			pr_msg("Last command:\n");
+			print_iostat(IOSTAT_COMMAND);
+			pr_msg("Session:\n");
+			print_iostat(IOSTAT_SESSION);
+			break;
+		case 2:
+			if (!strcmp(argv[1], "reset")) {
+				reset_iostat(IOSTAT_SESSION);
+				reset_iostat(IOSTAT_COMMAND);
+				break;
+			}
+			pr_msg("%s: invalid argument %s.\n", argv[0], argv[1]);
+			break;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * cmd_rollback - Restore device by undo journal.
+ * @argc:         argument count
+ * @argv:         argument vetor
+ * @envp:         environment pointer
+ *
+ * @return        0 (success)
+ *
+ * NOTE: Current directory is changed to root, because it may disappear.
+ */
+static int cmd_rollback(int argc, char **argv, char **envp)
+{
+	if (rollback_journal() || reload_filesystem()) {
+		pr_msg("%s: failed to restore device.\n", argv[0]);
+		return 0;
+	}
+
+	cluster = info->root_offset;
+	set_env(envp, "PWD", "/");
+	pr_msg("Rollback: device is restored.\n");
+	return 0;
+}
+
+/**
+ * cmd_snapshot - Save image to snapshot.
+ * @argc:         argument count
+ * @argv:         argument vetor
+ * @envp:         environment pointer
+ *
+ * @return        0 (success)
+ */
+static int cmd_snapshot(int argc, char **argv, char **envp)
+{
+	switch (argc) {
+		case 1:
+			pr_msg("%s: too few arguments.\n", argv[0]);
+			break;
+		case 2:
+			if (!take_snapshot(argv[1]))
+				pr_msg("Snapshot: %s.\n", argv[1]);
 			break;
 		default:
-			fprintf(stdout, "%s: too many arguments.\n", argv[0]);
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * cmd_restore - Replace image with snapshot.
+ * @argc:        argument count
+ * @argv:        argument vetor
+ * @envp:        environment pointer
+ *
+ * @return       0 (success)
+ *
+ * NOTE: Current directory is changed to root, because it may disappear.
+ */
+static int cmd_restore(int argc, char **argv, char **envp)
+{
+	switch (argc) {
+		case 1:
+			pr_msg("%s: too few arguments.\n", argv[0]);
+			break;
+		case 2:
+			if (restore_snapshot(argv[1]) || reload_filesystem()) {
+				pr_msg("%s: failed to restore %s.\n", argv[0], argv[1]);
+				break;
+			}
+			cluster = info->root_offset;
+			set_env(envp, "PWD", "/");
+			pr_msg("Restore: %s.\n", argv[1]);
+			break;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * cmd_discard - Discard free clusters.
+ * @argc:        argument count
+ * @argv:        argument vetor
+ * @envp:        environment pointer
+ *
+ * @return       0 (success)
+ */
+static int cmd_discard(int argc, char **argv, char **envp)
+{
+	uint32_t count;
+
+	if (discard_free(&count)) {
+		pr_msg("%s: failed to discard free clusters.\n", argv[0]);
+		return 0;
+	}
+
+	pr_msg("Discard: %u clusters.\n", count);
+	return 0;
+}
+
+/**
+ * cmd_sparsify - Punch holes in clusters which don't have any data.
+ * @argc:         argument count
+ * @argv:         argument vetor
+ * @envp:         environment pointer
+ *
+ * @return        0 (success)
+ */
+static int cmd_sparsify(int argc, char **argv, char **envp)
+{
+	uint32_t count;
+	bool zero = false;
+
+	switch (argc) {
+		case 1:
+			break;
+		case 2:
+			if (!strcmp(argv[1], "zero")) {
+				zero = true;
+				break;
+			}
+			pr_msg("%s: invalid argument '%s'.\n", argv[0], argv[1]);
+			return 0;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			return 0;
+	}
+
+	if (sparsify_image(zero, &count)) {
+		pr_msg("%s: failed to sparsify image.\n", argv[0]);
+		return 0;
+	}
+
+	pr_msg("Sparsify: %u clusters.\n", count);
+	return 0;
+}
+
+/**
+ * cmd_capture - Save only filesystem metadata to file.
+ * @argc:        argument count
+ * @argv:        argument vetor
+ * @envp:        environment pointer
+ *
+ * @return       0 (success)
+ */
+static int cmd_capture(int argc, char **argv, char **envp)
+{
+	size_t size;
+
+	switch (argc) {
+		case 1:
+			pr_msg("%s: too few arguments.\n", argv[0]);
+			break;
+		case 2:
+			if (capture_metadata(argv[1], &size))
+				pr_msg("%s: failed to capture metadata.\n", argv[0]);
+			else
+				pr_msg("Capture: %zu bytes.\n", size);
+			break;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * cmd_expand - Expand capture to sparse image.
+ * @argc:       argument count
+ * @argv:       argument vetor
+ * @envp:       environment pointer
+ *
+ * @return      0 (success)
+ */
+static int cmd_expand(int argc, char **argv, char **envp)
+{
+	switch (argc) {
+		case 1:
+			pr_msg("%s: too few arguments.\n", argv[0]);
+			break;
+		case 2:
+			if (!expand_capture(argv[1]))
+				pr_msg("Expand: %s.\n", argv[1]);
+			break;
+		default:
+			pr_msg("%s: too many arguments.\n", argv[0]);
 			break;
 	}
 	return 0;
@@ -509,22 +755,30 @@ static int cmd_stat(int argc, char **argv, char **envp)
  */
 static int cmd_help(int argc, char **argv, char **envp)
 {
-	fprintf(stderr, "ls         list current directory contents.\n");
-	fprintf(stderr, "cd         change directory.\n");
-	fprintf(stderr, "cluster    print cluster raw-data.\n");
-	fprintf(stderr, "alloc      allocate cluster.\n");
-	fprintf(stderr, "release    release cluster.\n");
-	fprintf(stderr, "fat        change File Allocation Table entry\n");
-	fprintf(stderr, "create     create directory entry for file.\n");
-	fprintf(stderr, "mkdir      create directory entry for directory.\n");
-	fprintf(stderr, "remove     remove directory entry for file.\n");
-	fprintf(stderr, "rmdir      remove directory entry for directory.\n");
-	fprintf(stderr, "trim       trim deleted dentry.\n");
-	fprintf(stderr, "fill       fill in directory.\n");
-	fprintf(stderr, "tail       output the last part of files.\n");
-	fprintf(stderr, "stat       output file stat.\n");
-	fprintf(stderr, "help       display this help.\n");
-	fprintf(stderr, "\n");
+	pr_msg("ls         list current directory contents.\n");
+	pr_msg("cd         change directory.\n");
+	pr_msg("cluster    print cluster raw-data.\n");
+	pr_msg("alloc      allocate cluster.\n");
+	pr_msg("release    release cluster.\n");
+	pr_msg("fat        change File Allocation Table entry\n");
+	pr_msg("create     create directory entry for file.\n");
+	pr_msg("mkdir      create directory entry for directory.\n");
+	pr_msg("remove     remove directory entry for file.\n");
+	pr_msg("rmdir      remove directory entry for directory.\n");
+	pr_msg("trim       trim deleted dentry.\n");
+	pr_msg("fill       fill in directory.\n");
+	pr_msg("tail       output the last part of files.\n");
+	pr_msg("stat       output file stat.\n");
+	pr_msg("iostat     display I/O statistics.\n");
+	pr_msg("rollback   restore device to the state at the start of session.\n");
+	pr_msg("snapshot   save image to file.\n");
+	pr_msg("restore    replace image with snapshot.\n");
+	pr_msg("discard    discard free clusters.\n");
+	pr_msg("sparsify   punch holes in free (and zero-filled) clusters.\n");
+	pr_msg("capture    save only filesystem metadata to file.\n");
+	pr_msg("expand     expand capture to sparse image.\n");
+	pr_msg("help       display this help.\n");
+	pr_msg("\n");
 	return 0;
 }
 
@@ -538,7 +792,7 @@ static int cmd_help(int argc, char **argv, char **envp)
  */
 static int cmd_exit(int argc, char **argv, char **envp)
 {
-	fprintf(stdout, "Goodbye!\n");
+	pr_msg("Goodbye!\n");
 	return 1;
 }
 
@@ -596,17 +850,24 @@ static int format_path(char *dist, size_t len, char *str, char **envp)
  */
 static int execute_cmd(int argc, char **argv, char **envp)
 {
-	int i;
+	int i, ret;
 
 	if (!argc)
 		return 0;
 
 	for (i = 0; i < (sizeof(cmd) / sizeof(struct command)); i++) {
-		if(!strcmp(argv[0], cmd[i].name))
-			return cmd[i].func(argc, argv, envp);
+		if(!strcmp(argv[0], cmd[i].name)) {
+			/* iostat displays counters of the previous command */
+			if (cmd[i].func != cmd_iostat)
+				reset_iostat(IOSTAT_COMMAND);
+			trace_op(info->trace, argv[0]);
+			ret = cmd[i].func(argc, argv, envp);
+			sync_volume(DURABILITY_COMMAND);
+			return ret;
+		}
 	}
 
-	fprintf(stdout, "%s: command not found\n", argv[0]);
+	pr_msg("%s: command not found\n", argv[0]);
 	return 0;
 }
 
@@ -709,11 +970,92 @@ static int get_env(char **envp, char *env, char *value)
  */
 static int init_env(char **envp)
 {
-	cluster = info.root_offset;
+	cluster = info->root_offset;
 	set_env(envp, "PWD", "/");
 	return 0;
 }
 
+/**
+ * shell_open - Start new shell session
+ *
+ * @return      shell session
+ *              NULL (failed to allocate)
+ */
+struct shell_session *shell_open(void)
+{
+	int i;
+	struct shell_session *s;
+
+	if (!(s = calloc(1, sizeof(struct shell_session))))
+		return NULL;
+
+	s->argv = calloc(ARG_MAXNUM, sizeof(char *));
+	s->envp = calloc(ENV_MAXNUM, sizeof(char *));
+	if (!s->argv || !s->envp) {
+		shell_close(s);
+		return NULL;
+	}
+
+	for (i = 0; i < ARG_MAXNUM; i++) {
+		if (!(s->argv[i] = calloc(ARG_MAXLEN, sizeof(char)))) {
+			shell_close(s);
+			return NULL;
+		}
+	}
+	for (i = 0; i < ENV_MAXNUM; i++) {
+		if (!(s->envp[i] = calloc(ARG_MAXLEN, sizeof(char)))) {
+			shell_close(s);
+			return NULL;
+		}
+	}
+
+	init_env(s->envp);
+	s->cluster = cluster;
+	info->ops->readdir(NULL, 0, cluster);
+	return s;
+}
+
+/**
+ * shell_execute - Execute one command line in shell session
+ * @s:             shell session
+ * @str:           command line
+ *
+ * @return         0 (continue shell)
+ *                 1 (exit shell)
+ */
+int shell_execute(struct shell_session *s, char *str)
+{
+	int argc, ret;
+
+	/* Current directory belongs to session */
+	cluster = s->cluster;
+	argc = decode_cmd(str, s->argv, s->envp);
+	ret = execute_cmd(argc, s->argv, s->envp);
+	s->cluster = cluster;
+	return ret;
+}
+
+/**
+ * shell_close - Release shell session
+ * @s:           shell session
+ */
+void shell_close(struct shell_session *s)
+{
+	int i;
+
+	if (!s)
+		return;
+
+	for (i = 0; s->envp && i < ENV_MAXNUM; i++)
+		free(s->envp[i]);
+	for (i = 0; s->argv && i < ARG_MAXNUM; i++)
+		free(s->argv[i]);
+
+	free(s->argv);
+	free(s->envp);
+	free(s);
+}
+
 /**
  * shell  - Interactive main function
  *
@@ -721,37 +1063,24 @@ static int init_env(char **envp)
  */
 int shell(void)
 {
-	int i, argc = 0;
 	char buf[CMD_MAXLEN] = {};
-	char **argv = calloc(ARG_MAXNUM, sizeof(char *));
-	char **envp = calloc(ENV_MAXNUM, sizeof(char *));
+	struct shell_session *s;
 
-	for (i = 0; i < ARG_MAXNUM; i++)
-		argv[i] = calloc(ARG_MAXLEN, sizeof(char));
-	for (i = 0; i < ENV_MAXNUM; i++)
-		envp[i] = calloc(ARG_MAXLEN, sizeof(char));
+	pr_msg("Welcome to %s %s (Interactive Mode)\n\n", PROGRAM_NAME, PROGRAM_VERSION);
+	if (!(s = shell_open()))
+		return 0;
 
-	fprintf(stdout, "Welcome to %s %s (Interactive Mode)\n\n", PROGRAM_NAME, PROGRAM_VERSION);
-	init_env(envp);
 	srand(time(NULL));
-	info.ops->readdir(NULL, 0, cluster);
 	while (1) {
-		get_env(envp, "PWD", buf);
-		fprintf(stdout, "%s> ", buf);
-		fflush(stdout);
+		get_env(s->envp, "PWD", buf);
+		pr_msg("%s> ", buf);
+		fflush(output);
 		if (read_cmd(buf))
 			break;
-		argc = decode_cmd(buf, argv, envp);
-		if (execute_cmd(argc, argv, envp))
+		if (shell_execute(s, buf))
 			break;
 	}
 
-	for (i = 0; i < ENV_MAXNUM; i++)
-		free(envp[i]);
-	for (i = 0; i < ARG_MAXNUM; i++)
-		free(argv[i]);
-
-	free(argv);
-	free(envp);
+	shell_close(s);
 	return 0;
 }
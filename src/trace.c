@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_BUFSIZE  (1024 * 1024)
+
+struct trace {
+	FILE *fp;
+	struct timespec start;
+	uint8_t op;
+	size_t op_num;
+	char *op_name[TRACE_OP_MAX];
+};
+
+/**
+ * trace_write - Append one record to trace file
+ * @t:           trace recorder
+ * @type:        record type
+ * @offset:      Start bytes
+ * @length:      Length
+ */
+static void trace_write(struct trace *t, int type, uint64_t offset, uint32_t length)
+{
+	struct timespec now;
+	struct trace_record r = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	r.time = (now.tv_sec - t->start.tv_sec) * 1000000000ULL + now.tv_nsec - t->start.tv_nsec;
+	r.offset = offset;
+	r.length = length;
+	r.type = type;
+	r.op = t->op;
+	fwrite(&r, sizeof(r), 1, t->fp);
+}
+
+/**
+ * trace_open - Start to record sector access
+ * @path:       trace file path
+ *
+ * @return      trace recorder
+ *              NULL (failed to open)
+ */
+struct trace *trace_open(const char *path)
+{
+	struct trace *t;
+	struct trace_header h = {0};
+
+	if (!(t = calloc(1, sizeof(struct trace))))
+		return NULL;
+
+	if (!(t->fp = fopen(path, "wb"))) {
+		free(t);
+		return NULL;
+	}
+	/* Records are small, so they are written in large chunk */
+	setvbuf(t->fp, NULL, _IOFBF, TRACE_BUFSIZE);
+
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.version = TRACE_VERSION;
+	fwrite(&h, sizeof(h), 1, t->fp);
+	clock_gettime(CLOCK_MONOTONIC, &t->start);
+	return t;
+}
+
+/**
+ * trace_close - Finish to record sector access
+ * @t:           trace recorder
+ */
+void trace_close(struct trace *t)
+{
+	size_t i;
+
+	if (!t)
+		return;
+
+	fclose(t->fp);
+	for (i = 0; i < t->op_num; i++)
+		free(t->op_name[i]);
+	free(t);
+}
+
+/**
+ * trace_op - Set operation which following accesses belong to
+ * @t:        trace recorder
+ * @name:     operation name
+ *
+ * NOTE: New operation name is recorded once.
+ *       Operations beyond TRACE_OP_MAX are merged into the last one.
+ */
+void trace_op(struct trace *t, const char *name)
+{
+	size_t i;
+
+	if (!t)
+		return;
+
+	for (i = 0; i < t->op_num; i++) {
+		if (!strcmp(t->op_name[i], name)) {
+			t->op = i;
+			return;
+		}
+	}
+
+	if (t->op_num == TRACE_OP_MAX || !(t->op_name[i] = strdup(name)))
+		return;
+
+	t->op = t->op_num++;
+	trace_write(t, TRACE_OPNAME, 0, strlen(name));
+	fwrite(name, strlen(name), 1, t->fp);
+}
+
+/**
+ * trace_layout - Record filesystem layout
+ * @t:            trace recorder
+ * @data_offset:  Start bytes of data region
+ * @sector_size:  sector size
+ */
+void trace_layout(struct trace *t, off_t data_offset, size_t sector_size)
+{
+	if (t)
+		trace_write(t, TRACE_LAYOUT, data_offset, sector_size);
+}
+
+/**
+ * trace_access - Record sector access
+ * @t:            trace recorder
+ * @type:         TRACE_READ or TRACE_WRITE
+ * @offset:       Start bytes
+ * @length:       Length of the access
+ */
+void trace_access(struct trace *t, int type, off_t offset, size_t length)
+{
+	if (t && length)
+		trace_write(t, type, offset, length);
+}
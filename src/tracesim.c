@@ -0,0 +1,687 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "trace.h"
+
+#define PROGRAM_NAME     "debugfatfs-trace"
+#define PROGRAM_VERSION  "0.4.0"
+#define PROGRAM_AUTHOR   "LeavaTail"
+#define COPYRIGHT_YEAR   "2021"
+
+#define SIZE_MAX_NUM     16
+
+/*
+ * Cache policy definition
+ */
+#define POLICY_LRU       0
+#define POLICY_ARC       1
+#define POLICY_PIN       2
+#define POLICY_NUM       3
+
+static const char *policy_name[POLICY_NUM] = {"lru", "arc", "pin"};
+
+/* list index in cache */
+#define LIST_T1          0  /* LRU: all, ARC: recent,  PIN: data */
+#define LIST_T2          1  /* ARC: frequent, PIN: metadata */
+#define LIST_B1          2  /* ARC: ghost of recent */
+#define LIST_B2          3  /* ARC: ghost of frequent */
+#define LIST_NUM         4
+
+struct entry {
+	uint64_t block;
+	int list;
+	struct entry *prev;
+	struct entry *next;
+	struct entry *hash;
+};
+
+struct lru_list {
+	struct entry *head;
+	struct entry *tail;
+	size_t len;
+};
+
+struct cache {
+	int policy;
+	size_t capacity;
+	double target;
+	uint64_t data_block;
+	size_t hash_size;
+	struct entry **hash;
+	struct lru_list list[LIST_NUM];
+};
+
+struct access {
+	uint64_t offset;
+	uint32_t length;
+	uint8_t type;
+	uint8_t op;
+};
+
+struct result {
+	uint64_t hit[TRACE_OP_MAX];
+	uint64_t miss[TRACE_OP_MAX];
+};
+
+/**
+ * Special Option(no short option)
+ */
+enum
+{
+	GETOPT_HELP_CHAR = (CHAR_MIN - 2),
+	GETOPT_VERSION_CHAR = (CHAR_MIN - 3)
+};
+
+/* option data {"long name", needs argument, flags, "short name"} */
+static struct option const longopts[] =
+{
+	{"block", required_argument, NULL, 'b'},
+	{"op", no_argument, NULL, 'o'},
+	{"policy", required_argument, NULL, 'p'},
+	{"size", required_argument, NULL, 's'},
+	{"help", no_argument, NULL, GETOPT_HELP_CHAR},
+	{"version", no_argument, NULL, GETOPT_VERSION_CHAR},
+	{0,0,0,0}
+};
+
+/**
+ * usage - print out usage
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [OPTION]... FILE\n", PROGRAM_NAME);
+	fprintf(stderr, "replay sector access trace against simulated caches.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -b, --block=size\tcache block size (default: sector size).\n");
+	fprintf(stderr, "  -o, --op\tbreak down hit ratio by operation.\n");
+	fprintf(stderr, "  -p, --policy=name\tcache policy (lru, arc, pin).\n");
+	fprintf(stderr, "  -s, --size=size\tcache size (K, M, G suffix is allowed).\n");
+	fprintf(stderr, "  --help\tdisplay this help and exit.\n");
+	fprintf(stderr, "  --version\toutput version information and exit.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Examples:\n");
+	fprintf(stderr, "  %s trace.dat\tsimulate all policies with default sizes.\n", PROGRAM_NAME);
+	fprintf(stderr, "  %s -p arc -s 1M -s 4M trace.dat\tsimulate ARC with 1MiB and 4MiB.\n",
+			PROGRAM_NAME);
+	fprintf(stderr, "\n");
+}
+
+/**
+ * version - print out program version
+ * @command_name: command name
+ * @version:      program version
+ * @author:       program authoer
+ */
+static void version(const char *command_name, const char *version, const char *author)
+{
+	fprintf(stdout, "%s %s\n", command_name, version);
+	fprintf(stdout, "\n");
+	fprintf(stdout, "Copyright (C) %s\n", COPYRIGHT_YEAR);
+	fprintf(stdout, "This is free software: you are free to change and redistribute it.\n");
+	fprintf(stdout, "There is NO WARRANTY, to the extent permitted by law.\n");
+	fprintf(stdout, "\n");
+	fprintf(stdout, "Written by %s.\n", author);
+}
+
+/**
+ * parse_size - Convert string into bytes
+ * @str:        string (e.g. "4096", "64K", "4M")
+ *
+ * @return      bytes
+ *              0 (invalid string)
+ */
+static uint64_t parse_size(const char *str)
+{
+	char *end;
+	uint64_t size = strtoull(str, &end, 0);
+
+	switch (*end) {
+		case 'G':
+		case 'g':
+			size <<= 10;
+			/* FALLTHROUGH */
+		case 'M':
+		case 'm':
+			size <<= 10;
+			/* FALLTHROUGH */
+		case 'K':
+		case 'k':
+			size <<= 10;
+			end++;
+			break;
+	}
+	return *end ? 0 : size;
+}
+
+/**
+ * list_remove - Remove entry from list
+ * @c:           cache
+ * @e:           entry
+ */
+static void list_remove(struct cache *c, struct entry *e)
+{
+	struct lru_list *l = &c->list[e->list];
+
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		l->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		l->tail = e->prev;
+	l->len--;
+}
+
+/**
+ * list_push - Insert entry to most recently used position
+ * @c:         cache
+ * @e:         entry
+ * @list:      list index
+ */
+static void list_push(struct cache *c, struct entry *e, int list)
+{
+	struct lru_list *l = &c->list[list];
+
+	e->list = list;
+	e->prev = NULL;
+	e->next = l->head;
+	if (l->head)
+		l->head->prev = e;
+	l->head = e;
+	if (!l->tail)
+		l->tail = e;
+	l->len++;
+}
+
+/**
+ * list_move - Move entry to most recently used position of any list
+ * @c:         cache
+ * @e:         entry
+ * @list:      list index
+ */
+static void list_move(struct cache *c, struct entry *e, int list)
+{
+	list_remove(c, e);
+	list_push(c, e, list);
+}
+
+/**
+ * cache_lookup - Search entry in cache (including ghost)
+ * @c:            cache
+ * @block:        block index
+ *
+ * @return        entry
+ *                NULL (Not found)
+ */
+static struct entry *cache_lookup(struct cache *c, uint64_t block)
+{
+	struct entry *e;
+
+	for (e = c->hash[block & (c->hash_size - 1)]; e; e = e->hash) {
+		if (e->block == block)
+			return e;
+	}
+	return NULL;
+}
+
+/**
+ * cache_insert - Create new entry
+ * @c:            cache
+ * @block:        block index
+ * @list:         list index
+ *
+ * @return        entry
+ */
+static struct entry *cache_insert(struct cache *c, uint64_t block, int list)
+{
+	struct entry *e;
+	struct entry **bucket = &c->hash[block & (c->hash_size - 1)];
+
+	if (!(e = calloc(1, sizeof(struct entry)))) {
+		fprintf(stderr, "calloc: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	e->block = block;
+	e->hash = *bucket;
+	*bucket = e;
+	list_push(c, e, list);
+	return e;
+}
+
+/**
+ * cache_delete - Delete least recently used entry in list
+ * @c:            cache
+ * @list:         list index
+ */
+static void cache_delete(struct cache *c, int list)
+{
+	struct entry *e = c->list[list].tail;
+	struct entry **p = &c->hash[e->block & (c->hash_size - 1)];
+
+	while (*p != e)
+		p = &(*p)->hash;
+	*p = e->hash;
+	list_remove(c, e);
+	free(e);
+}
+
+/**
+ * init_cache - Create empty cache
+ * @c:          cache (Output)
+ * @policy:     cache policy
+ * @capacity:   The number of blocks
+ * @data_block: First block of data region
+ */
+static void init_cache(struct cache *c, int policy, size_t capacity, uint64_t data_block)
+{
+	memset(c, 0, sizeof(struct cache));
+	c->policy = policy;
+	c->capacity = capacity;
+	c->data_block = data_block;
+	/* ARC keeps the same number of ghost entries as cache */
+	for (c->hash_size = 1; c->hash_size < capacity * 2; c->hash_size <<= 1)
+		;
+	if (!(c->hash = calloc(c->hash_size, sizeof(struct entry *)))) {
+		fprintf(stderr, "calloc: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * release_cache - Release all entries in cache
+ * @c:             cache
+ */
+static void release_cache(struct cache *c)
+{
+	int i;
+
+	for (i = 0; i < LIST_NUM; i++) {
+		while (c->list[i].len)
+			cache_delete(c, i);
+	}
+	free(c->hash);
+}
+
+/**
+ * lru_access - Access block in LRU cache
+ * @c:          cache
+ * @block:      block index
+ *
+ * @return      true (hit)
+ */
+static bool lru_access(struct cache *c, uint64_t block)
+{
+	struct entry *e;
+
+	if ((e = cache_lookup(c, block))) {
+		list_move(c, e, LIST_T1);
+		return true;
+	}
+
+	if (c->list[LIST_T1].len == c->capacity)
+		cache_delete(c, LIST_T1);
+	cache_insert(c, block, LIST_T1);
+	return false;
+}
+
+/**
+ * pin_access - Access block in metadata-pinned cache
+ * @c:          cache
+ * @block:      block index
+ *
+ * @return      true (hit)
+ *
+ * NOTE: Metadata (before data region) is evicted only if no data is cached.
+ */
+static bool pin_access(struct cache *c, uint64_t block)
+{
+	struct entry *e;
+	int list = (block < c->data_block) ? LIST_T2 : LIST_T1;
+
+	if ((e = cache_lookup(c, block))) {
+		list_move(c, e, list);
+		return true;
+	}
+
+	if (c->list[LIST_T1].len + c->list[LIST_T2].len == c->capacity)
+		cache_delete(c, c->list[LIST_T1].len ? LIST_T1 : LIST_T2);
+	cache_insert(c, block, list);
+	return false;
+}
+
+/**
+ * arc_replace - Move one cached block to ghost list
+ * @c:           cache
+ * @in_b2:       true (accessed block is in B2)
+ */
+static void arc_replace(struct cache *c, bool in_b2)
+{
+	size_t t1 = c->list[LIST_T1].len;
+
+	if (t1 && ((in_b2 && t1 == (size_t)c->target) || t1 > c->target))
+		list_move(c, c->list[LIST_T1].tail, LIST_B1);
+	else
+		list_move(c, c->list[LIST_T2].tail, LIST_B2);
+}
+
+/**
+ * arc_access - Access block in ARC cache
+ * @c:          cache
+ * @block:      block index
+ *
+ * @return      true (hit)
+ */
+static bool arc_access(struct cache *c, uint64_t block)
+{
+	struct entry *e;
+	double delta;
+	size_t t1 = c->list[LIST_T1].len, t2 = c->list[LIST_T2].len;
+	size_t b1 = c->list[LIST_B1].len, b2 = c->list[LIST_B2].len;
+
+	if ((e = cache_lookup(c, block))) {
+		switch (e->list) {
+			case LIST_T1:
+			case LIST_T2:
+				list_move(c, e, LIST_T2);
+				return true;
+			case LIST_B1:
+				delta = (b1 >= b2) ? 1 : (double)b2 / b1;
+				c->target = (c->target + delta < c->capacity) ? c->target + delta : c->capacity;
+				if (t1 + t2 >= c->capacity)
+					arc_replace(c, false);
+				list_move(c, e, LIST_T2);
+				return false;
+			case LIST_B2:
+				delta = (b2 >= b1) ? 1 : (double)b1 / b2;
+				c->target = (c->target > delta) ? c->target - delta : 0;
+				if (t1 + t2 >= c->capacity)
+					arc_replace(c, true);
+				list_move(c, e, LIST_T2);
+				return false;
+		}
+	}
+
+	if (t1 + b1 == c->capacity) {
+		if (t1 < c->capacity) {
+			cache_delete(c, LIST_B1);
+			if (t1 + t2 >= c->capacity)
+				arc_replace(c, false);
+		} else {
+			cache_delete(c, LIST_T1);
+		}
+	} else if (t1 + t2 + b1 + b2 >= c->capacity) {
+		if (t1 + t2 + b1 + b2 == c->capacity * 2)
+			cache_delete(c, LIST_B2);
+		if (t1 + t2 >= c->capacity)
+			arc_replace(c, false);
+	}
+	cache_insert(c, block, LIST_T1);
+	return false;
+}
+
+/**
+ * simulate - Replay accesses against one cache
+ * @accesses:   access list
+ * @num:        The number of accesses
+ * @c:          cache
+ * @block_size: cache block size
+ * @r:          hit/miss count for each operation (Output)
+ */
+static void simulate(struct access *accesses, size_t num,
+		struct cache *c, size_t block_size, struct result *r)
+{
+	size_t i;
+	uint64_t block, last;
+	bool hit;
+
+	memset(r, 0, sizeof(struct result));
+	for (i = 0; i < num; i++) {
+		last = (accesses[i].offset + accesses[i].length - 1) / block_size;
+		for (block = accesses[i].offset / block_size; block <= last; block++) {
+			switch (c->policy) {
+				case POLICY_ARC:
+					hit = arc_access(c, block);
+					break;
+				case POLICY_PIN:
+					hit = pin_access(c, block);
+					break;
+				default:
+					hit = lru_access(c, block);
+					break;
+			}
+			if (hit)
+				r->hit[accesses[i].op]++;
+			else
+				r->miss[accesses[i].op]++;
+		}
+	}
+}
+
+/**
+ * print_result - print hit ratio
+ * @label:        label of the line
+ * @hit:          The number of hits
+ * @miss:         The number of misses
+ */
+static void print_result(const char *label, uint64_t hit, uint64_t miss)
+{
+	fprintf(stdout, "%-20s %12" PRIu64 " %12" PRIu64 " %7.2f%%\n", label, hit, miss,
+			(hit + miss) ? 100.0 * hit / (hit + miss) : 0.0);
+}
+
+/**
+ * load_trace - Read all accesses from trace file
+ * @path:       trace file path
+ * @accesses:   access list (Output)
+ * @op_name:    operation names (Output)
+ * @data_offset: Start bytes of data region (Output)
+ * @sector_size: sector size (Output)
+ *
+ * @return      The number of accesses
+ *              -1 (invalid trace file)
+ */
+static ssize_t load_trace(const char *path, struct access **accesses,
+		char **op_name, uint64_t *data_offset, size_t *sector_size)
+{
+	FILE *fp;
+	ssize_t num = 0, size = 0;
+	struct trace_header h;
+	struct trace_record r;
+	struct access *tmp;
+
+	*accesses = NULL;
+	if (!(fp = fopen(path, "rb"))) {
+		fprintf(stderr, "open: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (fread(&h, sizeof(h), 1, fp) != 1 ||
+			memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) || h.version != TRACE_VERSION) {
+		fprintf(stderr, "%s isn't trace file.\n", path);
+		goto err;
+	}
+
+	while (fread(&r, sizeof(r), 1, fp) == 1) {
+		switch (r.type) {
+			case TRACE_OPNAME:
+				free(op_name[r.op]);
+				if (!(op_name[r.op] = calloc(r.length + 1, sizeof(char))) ||
+						fread(op_name[r.op], r.length, 1, fp) != 1)
+					goto broken;
+				break;
+			case TRACE_LAYOUT:
+				*data_offset = r.offset;
+				*sector_size = r.length;
+				break;
+			case TRACE_READ:
+			case TRACE_WRITE:
+				if (!r.length)
+					break;
+				if (num == size) {
+					size = size ? size * 2 : 4096;
+					if (!(tmp = realloc(*accesses, sizeof(struct access) * size))) {
+						fprintf(stderr, "realloc: %s\n", strerror(errno));
+						goto err;
+					}
+					*accesses = tmp;
+				}
+				(*accesses)[num].offset = r.offset;
+				(*accesses)[num].length = r.length;
+				(*accesses)[num].type = r.type;
+				(*accesses)[num].op = r.op;
+				num++;
+				break;
+			default:
+				goto broken;
+		}
+	}
+
+	fclose(fp);
+	return num;
+
+broken:
+	fprintf(stderr, "%s is broken.\n", path);
+err:
+	free(*accesses);
+	*accesses = NULL;
+	fclose(fp);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, longindex;
+	int policy, ret = EXIT_SUCCESS;
+	bool by_op = false;
+	bool policies[POLICY_NUM] = {false};
+	size_t i, j, op;
+	size_t size_num = 0, sector_size = 0, block_size = 0;
+	uint64_t sizes[SIZE_MAX_NUM];
+	uint64_t data_offset = 0, hit, miss, reads = 0, writes = 0;
+	uint64_t default_sizes[] = {256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024};
+	char *op_name[TRACE_OP_MAX] = {NULL};
+	char label[64];
+	ssize_t num;
+	struct access *accesses;
+	struct cache c;
+	struct result *r;
+
+	while ((opt = getopt_long(argc, argv, "b:op:s:", longopts, &longindex)) != -1) {
+		switch (opt) {
+			case 'b':
+				if (!(block_size = parse_size(optarg))) {
+					fprintf(stderr, "invalid block size %s.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'o':
+				by_op = true;
+				break;
+			case 'p':
+				for (policy = 0; policy < POLICY_NUM; policy++) {
+					if (!strcmp(optarg, policy_name[policy]))
+						break;
+				}
+				if (policy == POLICY_NUM) {
+					fprintf(stderr, "unknown policy %s.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				policies[policy] = true;
+				break;
+			case 's':
+				if (size_num == SIZE_MAX_NUM || !(sizes[size_num++] = parse_size(optarg))) {
+					fprintf(stderr, "invalid cache size %s.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case GETOPT_HELP_CHAR:
+				usage();
+				exit(EXIT_SUCCESS);
+			case GETOPT_VERSION_CHAR:
+				version(PROGRAM_NAME, PROGRAM_VERSION, PROGRAM_AUTHOR);
+				exit(EXIT_SUCCESS);
+			default:
+				usage();
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if ((num = load_trace(argv[optind], &accesses, op_name, &data_offset, &sector_size)) < 0)
+		exit(EXIT_FAILURE);
+
+	if (!block_size)
+		block_size = sector_size ? sector_size : 512;
+	if (!size_num) {
+		size_num = sizeof(default_sizes) / sizeof(uint64_t);
+		memcpy(sizes, default_sizes, sizeof(default_sizes));
+	}
+	if (!policies[POLICY_LRU] && !policies[POLICY_ARC] && !policies[POLICY_PIN])
+		policies[POLICY_LRU] = policies[POLICY_ARC] = policies[POLICY_PIN] = true;
+
+	for (i = 0; i < num; i++) {
+		if (accesses[i].type == TRACE_WRITE)
+			writes++;
+		else
+			reads++;
+	}
+	fprintf(stdout, "Trace: %zd accesses (%" PRIu64 " reads, %" PRIu64 " writes)\n",
+			num, reads, writes);
+	fprintf(stdout, "Block size: %zu, Data region: 0x%" PRIx64 "\n", block_size, data_offset);
+
+	if (!(r = malloc(sizeof(struct result)))) {
+		fprintf(stderr, "malloc: %s\n", strerror(errno));
+		ret = EXIT_FAILURE;
+		goto out;
+	}
+
+	fprintf(stdout, "\n%-20s %12s %12s %8s\n", "policy/size", "hits", "misses", "ratio");
+	for (policy = 0; policy < POLICY_NUM; policy++) {
+		if (!policies[policy])
+			continue;
+		for (i = 0; i < size_num; i++) {
+			if (sizes[i] < block_size)
+				continue;
+			init_cache(&c, policy, sizes[i] / block_size, data_offset / block_size);
+			simulate(accesses, num, &c, block_size, r);
+			release_cache(&c);
+
+			for (hit = miss = op = 0; op < TRACE_OP_MAX; op++) {
+				hit += r->hit[op];
+				miss += r->miss[op];
+			}
+			snprintf(label, sizeof(label), "%s/%" PRIu64 "K", policy_name[policy], sizes[i] >> 10);
+			print_result(label, hit, miss);
+
+			if (!by_op)
+				continue;
+			for (j = 0; j < TRACE_OP_MAX; j++) {
+				if (!r->hit[j] && !r->miss[j])
+					continue;
+				snprintf(label, sizeof(label), "  %s", op_name[j] ? op_name[j] : "-");
+				print_result(label, r->hit[j], r->miss[j]);
+			}
+		}
+	}
+
+	free(r);
+out:
+	for (i = 0; i < TRACE_OP_MAX; i++)
+		free(op_name[i]);
+	free(accesses);
+	return ret;
+}
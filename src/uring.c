@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+
+struct uring {
+	int fd;
+	unsigned int entries;
+	unsigned int queued;
+	unsigned int inflight;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_len;
+	size_t cq_len;
+	size_t sqe_len;
+};
+
+/**
+ * uring_init - Create io_uring instance
+ * @entries:    The number of submission queue entries
+ *
+ * @return      io_uring instance
+ *              NULL (io_uring is unavailable)
+ */
+struct uring *uring_init(unsigned int entries)
+{
+	struct io_uring_params p;
+	struct uring *r;
+
+	if (!(r = calloc(1, sizeof(struct uring))))
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	if ((r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+		goto free;
+
+	r->entries = p.sq_entries;
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqe_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_len = r->cq_len = (r->sq_len > r->cq_len) ? r->sq_len : r->cq_len;
+
+	r->sq_ring = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto close;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED)
+			goto sq_unmap;
+	}
+
+	r->sqes = mmap(NULL, r->sqe_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto cq_unmap;
+
+	r->sq_head = r->sq_ring + p.sq_off.head;
+	r->sq_tail = r->sq_ring + p.sq_off.tail;
+	r->sq_mask = r->sq_ring + p.sq_off.ring_mask;
+	r->sq_array = r->sq_ring + p.sq_off.array;
+	r->cq_head = r->cq_ring + p.cq_off.head;
+	r->cq_tail = r->cq_ring + p.cq_off.tail;
+	r->cq_mask = r->cq_ring + p.cq_off.ring_mask;
+	r->cqes = r->cq_ring + p.cq_off.cqes;
+
+	return r;
+
+cq_unmap:
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_len);
+sq_unmap:
+	munmap(r->sq_ring, r->sq_len);
+close:
+	close(r->fd);
+free:
+	free(r);
+	return NULL;
+}
+
+/**
+ * uring_exit - Release io_uring instance
+ * @r:          io_uring instance
+ */
+void uring_exit(struct uring *r)
+{
+	if (!r)
+		return;
+
+	munmap(r->sqes, r->sqe_len);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_len);
+	munmap(r->sq_ring, r->sq_len);
+	close(r->fd);
+	free(r);
+}
+
+/**
+ * uring_prep_read - Queue read request
+ * @r:               io_uring instance
+ * @fd:              file descriptor
+ * @data:            buffer (Output)
+ * @len:             read length
+ * @offset:          Start bytes
+ * @user:            value to identify the request on completion
+ *
+ * @return            0 (success)
+ *                   -1 (submission queue is full)
+ */
+int uring_prep_read(struct uring *r, int fd, void *data, size_t len, off_t offset, uint64_t user)
+{
+	unsigned int tail = *r->sq_tail;
+	unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int index;
+	struct io_uring_sqe *sqe;
+
+	/* Completion queue must not overflow */
+	if (tail - head >= r->entries || r->queued + r->inflight >= r->entries)
+		return -1;
+
+	index = tail & *r->sq_mask;
+	sqe = &r->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = user;
+	r->sq_array[index] = index;
+
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->queued++;
+	return 0;
+}
+
+/**
+ * uring_submit - Submit all queued requests
+ * @r:            io_uring instance
+ *
+ * @return        The number of submitted requests
+ *                -1 (failed to submit)
+ */
+int uring_submit(struct uring *r)
+{
+	int ret;
+
+	if (!r->queued)
+		return 0;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->queued, 0, 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -1;
+
+	r->queued -= ret;
+	r->inflight += ret;
+	return ret;
+}
+
+/**
+ * uring_wait - Reap one completed request
+ * @r:          io_uring instance
+ * @user:       value of the completed request (Output)
+ * @res:        result of the completed request (Output)
+ *
+ * @return       0 (success)
+ *              -1 (no request is in flight, or failed to wait)
+ */
+int uring_wait(struct uring *r, uint64_t *user, ssize_t *res)
+{
+	unsigned int head, tail;
+	struct io_uring_cqe *cqe;
+
+	for (;;) {
+		head = *r->cq_head;
+		tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		if (head != tail)
+			break;
+		if (!r->inflight)
+			return -1;
+		if (syscall(__NR_io_uring_enter, r->fd, 0, 1,
+					IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+			return -1;
+	}
+
+	cqe = &r->cqes[head & *r->cq_mask];
+	*user = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	r->inflight--;
+	return 0;
+}
+
+/**
+ * uring_inflight - Get the number of requests not reaped yet
+ * @r:              io_uring instance
+ *
+ * @return          The number of requests
+ */
+unsigned int uring_inflight(struct uring *r)
+{
+	return r->queued + r->inflight;
+}
+
+#else
+
+struct uring *uring_init(unsigned int entries)
+{
+	return NULL;
+}
+
+void uring_exit(struct uring *r)
+{
+}
+
+int uring_prep_read(struct uring *r, int fd, void *data, size_t len, off_t offset, uint64_t user)
+{
+	return -1;
+}
+
+int uring_submit(struct uring *r)
+{
+	return -1;
+}
+
+int uring_wait(struct uring *r, uint64_t *user, ssize_t *res)
+{
+	return -1;
+}
+
+unsigned int uring_inflight(struct uring *r)
+{
+	return 0;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
@@ -0,0 +1,3277 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <time.h>
+#include <inttypes.h>
+#include <mntent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/falloc.h>
+
+#include "debugfatfs.h"
+unsigned int print_level = PRINT_WARNING;
+__thread FILE *output = NULL;
+
+struct volume {
+	struct device_info info;
+	FILE *output;
+};
+
+/* Volume which is selected by the calling thread */
+static __thread struct volume *selected = NULL;
+__thread struct device_info *info = NULL;
+
+/**
+ * alloc_aligned - Allocate buffer suitable for device access
+ * @size:          buffer size
+ *
+ * @return         buffer
+ *                 NULL (failed to allocate)
+ */
+static void *alloc_aligned(size_t size)
+{
+	void *data;
+
+	if (!info->pool.align)
+		return malloc(size);
+
+	if (posix_memalign(&data, info->pool.align, ROUNDUP(size, info->pool.align) * info->pool.align))
+		return NULL;
+	return data;
+}
+
+/**
+ * is_aligned - Check whether buffer can be used for device access directly
+ * @data:       buffer
+ * @index:      Start bytes
+ * @len:        data length
+ *
+ * @return      true (No alignment is required, or all are aligned)
+ */
+static bool is_aligned(const void *data, off_t index, size_t len)
+{
+	size_t align = info->pool.align;
+
+	return !align ||
+		(!((uintptr_t)data % align) && !(index % align) && !(len % align));
+}
+
+/**
+ * alloc_sector - Get sector buffer from buffer pool
+ *
+ * @return        sector buffer
+ *                NULL (failed to allocate)
+ *
+ * NOTE: buffer must be released by free_sector().
+ */
+void *alloc_sector(void)
+{
+	if (info->pool.sector_num)
+		return info->pool.sector[--info->pool.sector_num];
+	return alloc_aligned(info->sector_size);
+}
+
+/**
+ * alloc_cluster - Get cluster buffer from buffer pool
+ *
+ * @return         cluster buffer
+ *                 NULL (failed to allocate)
+ *
+ * NOTE: buffer must be released by free_cluster().
+ */
+void *alloc_cluster(void)
+{
+	if (info->pool.cluster_num)
+		return info->pool.cluster[--info->pool.cluster_num];
+	return alloc_aligned(info->cluster_size);
+}
+
+/**
+ * free_sector - Return sector buffer to buffer pool
+ * @data:        sector buffer
+ */
+void free_sector(void *data)
+{
+	if (data && info->pool.sector_num < POOL_MAX)
+		info->pool.sector[info->pool.sector_num++] = data;
+	else
+		free(data);
+}
+
+/**
+ * free_cluster - Return cluster buffer to buffer pool
+ * @data:         cluster buffer
+ */
+void free_cluster(void *data)
+{
+	if (data && info->pool.cluster_num < POOL_MAX)
+		info->pool.cluster[info->pool.cluster_num++] = data;
+	else
+		free(data);
+}
+
+/**
+ * release_pool - Release all buffers in buffer pool
+ */
+static void release_pool(void)
+{
+	while (info->pool.sector_num)
+		free(info->pool.sector[--info->pool.sector_num]);
+	while (info->pool.cluster_num)
+		free(info->pool.cluster[--info->pool.cluster_num]);
+}
+
+/**
+ * elapsed_nsec - Get elapsed time
+ * @start:        start time
+ *
+ * @return        nanoseconds from @start
+ */
+static uint64_t elapsed_nsec(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec - start->tv_nsec;
+}
+
+/**
+ * touch_sectors - Record sectors as accessed
+ * @c:             I/O counter
+ * @index:         Start bytes
+ * @len:           Length of the access
+ *
+ * NOTE: Accessed sectors are kept as sorted, disjoint extents [start, end),
+ *       so that memory depends on the access pattern, not the device size.
+ */
+static void touch_sectors(struct io_counter *c, off_t index, size_t len)
+{
+	size_t lo = 0, hi = c->touched_num, i, j;
+	uint64_t start = index / info->sector_size;
+	uint64_t end = (index + len - 1) / info->sector_size + 1;
+	uint64_t fresh = end - start;
+	struct io_extent *tmp;
+
+	/* First extent which ends at or after @start */
+	while (lo < hi) {
+		i = lo + (hi - lo) / 2;
+		if (c->touched[i].end < start)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	/* Merge overlapping or adjacent extents */
+	for (j = lo; j < c->touched_num && c->touched[j].start <= end; j++) {
+		if (c->touched[j].end > start && c->touched[j].start < end)
+			fresh -= MIN(c->touched[j].end, end) - MAX(c->touched[j].start, start);
+		start = MIN(c->touched[j].start, start);
+		end = MAX(c->touched[j].end, end);
+	}
+
+	if (j == lo) {
+		if (c->touched_num == c->touched_size) {
+			i = c->touched_size ? c->touched_size * 2 : 16;
+			if (!(tmp = realloc(c->touched, sizeof(struct io_extent) * i)))
+				return;
+			c->touched = tmp;
+			c->touched_size = i;
+		}
+		memmove(c->touched + lo + 1, c->touched + lo,
+				sizeof(struct io_extent) * (c->touched_num - lo));
+		c->touched_num++;
+	} else {
+		memmove(c->touched + lo + 1, c->touched + j,
+				sizeof(struct io_extent) * (c->touched_num - j));
+		c->touched_num -= j - lo - 1;
+	}
+	c->touched[lo].start = start;
+	c->touched[lo].end = end;
+	c->sectors += fresh;
+}
+
+/**
+ * account_io - Count I/O request in session and command counters
+ * @write:      true (write request) / false (read request)
+ * @index:      Start bytes
+ * @len:        Length of the request
+ * @nsec:       latency of the request
+ */
+static void account_io(bool write, off_t index, size_t len, uint64_t nsec)
+{
+	int i;
+	struct io_counter *c;
+
+	trace_access(info->trace, write ? TRACE_WRITE : TRACE_READ, index, len);
+	for (i = 0; i < IOSTAT_NUM; i++) {
+		c = write ? &info->stat[i].write : &info->stat[i].read;
+		c->calls++;
+		c->bytes += len;
+		c->nsec += nsec;
+		if ((info->attr & OPTION_STATS) && len && info->sector_size)
+			touch_sectors(c, index, len);
+	}
+}
+
+/**
+ * account_syscall - Count system call issued to the device
+ * @write:           true (write request) / false (read request)
+ */
+static void account_syscall(bool write)
+{
+	int i;
+
+	for (i = 0; i < IOSTAT_NUM; i++) {
+		if (write)
+			info->stat[i].write.syscalls++;
+		else
+			info->stat[i].read.syscalls++;
+	}
+}
+
+/**
+ * reset_iostat - Clear I/O counters
+ * @type:         IOSTAT_SESSION or IOSTAT_COMMAND
+ */
+void reset_iostat(int type)
+{
+	free(info->stat[type].read.touched);
+	free(info->stat[type].write.touched);
+	memset(&info->stat[type], 0, sizeof(struct io_stat));
+}
+
+/**
+ * print_iostat - Print I/O counters
+ * @type:         IOSTAT_SESSION or IOSTAT_COMMAND
+ */
+void print_iostat(int type)
+{
+	struct io_stat *st = &info->stat[type];
+
+	pr_msg("%-8s %12s %12s %16s %12s %16s\n", "", "calls", "syscalls", "bytes", "sectors", "latency(ns)");
+	pr_msg("%-8s %12zu %12zu %16" PRIu64 " %12" PRIu64 " %16" PRIu64 "\n", "read",
+			st->read.calls, st->read.syscalls, st->read.bytes, st->read.sectors, st->read.nsec);
+	pr_msg("%-8s %12zu %12zu %16" PRIu64 " %12" PRIu64 " %16" PRIu64 "\n", "write",
+			st->write.calls, st->write.syscalls, st->write.bytes, st->write.sectors, st->write.nsec);
+	pr_msg("%-8s %12zu\n", "sync", st->syncs);
+}
+
+/**
+ * read_device - Get Raw-Data from whole device
+ * @data:        Raw data (Output)
+ * @offset:      Start bytes in device
+ * @len:         read length
+ *
+ * @return        0 (success)
+ *               -1 (failed to read)
+ *
+ * NOTE: Unlike get_sector(), @offset isn't relative to the start of volume.
+ *       Beyond the end of device is treated as zero.
+ */
+static int read_device(void *data, off_t offset, size_t len)
+{
+	size_t align = MAX(info->pool.align, 1);
+	off_t start = offset - offset % align;
+	size_t size = ROUNDUP(offset + len - start, align) * align;
+	ssize_t count;
+	void *buf;
+
+	if (info->zimage)
+		return zimage_read(info->zimage, data, offset, len);
+
+	if (!(buf = alloc_aligned(size)))
+		return -1;
+
+	account_syscall(false);
+	if ((count = pread(info->fd, buf, size, start)) < 0) {
+		free(buf);
+		return -1;
+	}
+	memset(buf + count, 0, size - count);
+	memcpy(data, buf + (offset - start), len);
+	free(buf);
+	return 0;
+}
+
+/**
+ * write_device - Set Raw-Data to whole device
+ * @data:         Raw data
+ * @offset:       Start bytes in device
+ * @len:          write length
+ *
+ * @return         0 (success)
+ *                -1 (failed to write)
+ *
+ * NOTE: Unlike set_sector(), @offset isn't relative to the start of volume.
+ *       Unaligned request is bounced through aligned buffer with --direct,
+ *       so surrounding data in the first and last blocks is read at first.
+ */
+static int write_device(void *data, off_t offset, size_t len)
+{
+	int ret = -1;
+	size_t align = MAX(info->pool.align, 1);
+	off_t start = offset - offset % align;
+	size_t size = ROUNDUP(offset + len - start, align) * align;
+	void *buf;
+
+	if (is_aligned(data, offset, len))
+		return pwrite(info->fd, data, len, offset) == len ? 0 : -1;
+
+	if (!(buf = alloc_aligned(size)))
+		return -1;
+	if (read_device(buf, start, size))
+		goto out;
+
+	memcpy(buf + (offset - start), data, len);
+	if (pwrite(info->fd, buf, size, start) == size)
+		ret = 0;
+out:
+	free(buf);
+	return ret;
+}
+
+/**
+ * read_base - Get Raw-Data from volume under overlay
+ * @data:      Raw data (Output)
+ * @index:     Start bytes
+ * @len:       read length
+ *
+ * @return      0 (success)
+ *             -1 (failed to read)
+ */
+static int read_base(void *data, off_t index, size_t len)
+{
+	size_t i;
+	unsigned char *p = data;
+
+	/* Capture doesn't have any base volume */
+	if (info->capture) {
+		for (i = 0; i < len; i++)
+			p[i] = CAPTURE_FILL[(index + i) % (sizeof(CAPTURE_FILL) - 1)];
+		return 0;
+	}
+	return read_device(data, info->volume_offset + index, len);
+}
+
+/**
+ * write_base - Set Raw-Data to volume under overlay
+ * @data:       Raw data
+ * @index:      Start bytes
+ * @len:        write length
+ *
+ * @return       0 (success)
+ *              -1 (failed to write)
+ */
+static int write_base(void *data, off_t index, size_t len)
+{
+	account_syscall(true);
+	info->unsynced = true;
+	return write_device(data, info->volume_offset + index, len);
+}
+
+/**
+ * volume_preadv - Read volume into multiple buffers
+ * @iov:           buffers
+ * @num:           The number of buffers
+ * @index:         Start bytes
+ *
+ * @return         read bytes
+ *                 -1 (failed to read)
+ */
+static ssize_t volume_preadv(const struct iovec *iov, int num, off_t index)
+{
+	int i;
+	ssize_t len = 0;
+
+	if (!info->overlay)
+		return preadv(info->fd, iov, num, info->volume_offset + index);
+
+	/* Written blocks are read from overlay, and the others from device */
+	for (i = 0; i < num; len += iov[i++].iov_len) {
+		if (overlay_read(info->overlay, iov[i].iov_base, index + len, iov[i].iov_len, read_base))
+			return -1;
+	}
+	return len;
+}
+
+/**
+ * volume_pwritev - Write volume from multiple buffers
+ * @iov:            buffers
+ * @num:            The number of buffers
+ * @index:          Start bytes
+ *
+ * @return          written bytes
+ *                  -1 (failed to write)
+ */
+static ssize_t volume_pwritev(const struct iovec *iov, int num, off_t index)
+{
+	int i;
+	ssize_t len = 0;
+
+	/* Written data isn't durable until sync_volume() */
+	info->unsynced = true;
+	if (!info->overlay)
+		return pwritev(info->fd, iov, num, info->volume_offset + index);
+
+	/* Device is never modified in overlay session */
+	for (i = 0; i < num; len += iov[i++].iov_len) {
+		if (overlay_write(info->overlay, iov[i].iov_base, index + len, iov[i].iov_len, read_base))
+			return -1;
+	}
+	return len;
+}
+
+/**
+ * read_volume - Get Raw-Data from volume without cache
+ * @data:        Raw data (Output)
+ * @index:       Start bytes
+ * @len:         read length
+ *
+ * @return        0 (success)
+ *               -1 (failed to read)
+ */
+static int read_volume(void *data, off_t index, size_t len)
+{
+	if (info->overlay)
+		return overlay_read(info->overlay, data, index, len, read_base);
+	return read_base(data, index, len);
+}
+
+/**
+ * write_volume - Set Raw-Data to volume without cache
+ * @data:         Raw data
+ * @index:        Start bytes
+ * @len:          write length
+ *
+ * @return         0 (success)
+ *                -1 (failed to write)
+ */
+static int write_volume(void *data, off_t index, size_t len)
+{
+	/* Device is never modified in overlay session */
+	if (info->overlay) {
+		account_syscall(true);
+		info->unsynced = true;
+		return overlay_write(info->overlay, data, index, len, read_base);
+	}
+	return write_base(data, index, len);
+}
+
+/**
+ * init_hole_map - Build hole map of sparse image
+ *
+ * @return         0 (success)
+ *                -1 (image can't tell holes)
+ *
+ * NOTE: Only regular file is supported, because block device doesn't have hole.
+ */
+static int init_hole_map(void)
+{
+	off_t data, hole = info->volume_offset;
+	off_t end = info->volume_offset + info->total_size;
+	struct hole *tmp;
+	size_t size = 0;
+
+	while (hole < end) {
+		if ((data = lseek(info->fd, hole, SEEK_DATA)) < 0) {
+			if (errno != ENXIO)
+				goto err;
+			/* No data until the end of image */
+			data = end;
+		}
+
+		if (data > hole) {
+			if (info->hole_num == size) {
+				size = size ? size * 2 : DENTRY_LISTSIZE;
+				if (!(tmp = realloc(info->holes, sizeof(struct hole) * size)))
+					goto err;
+				info->holes = tmp;
+			}
+			/* Hole map is relative to the start of volume */
+			info->holes[info->hole_num].start = hole - info->volume_offset;
+			info->holes[info->hole_num].end = MIN(data, end) - info->volume_offset;
+			info->hole_num++;
+		}
+
+		if (data >= end || (hole = lseek(info->fd, data, SEEK_HOLE)) < 0)
+			break;
+	}
+
+	pr_debug("Hole map: %zu holes\n", info->hole_num);
+	return 0;
+
+err:
+	pr_debug("lseek: %s\n", strerror(errno));
+	free(info->holes);
+	info->holes = NULL;
+	info->hole_num = 0;
+	return -1;
+}
+
+/**
+ * reset_hole_map - Rebuild hole map after holes in image are changed
+ */
+static void reset_hole_map(void)
+{
+	free(info->holes);
+	info->holes = NULL;
+	info->hole_num = 0;
+	init_hole_map();
+}
+
+/**
+ * find_hole - Search hole which contains any byte
+ * @index:     byte offset
+ *
+ * @return     index of the hole in hole map
+ *             -1 (@index is in data)
+ */
+static ssize_t find_hole(off_t index)
+{
+	size_t low = 0, high = info->hole_num, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (index < info->holes[mid].start)
+			high = mid;
+		else if (index >= info->holes[mid].end)
+			low = mid + 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+/**
+ * is_hole - Check whether region is entirely in hole
+ * @index:   Start bytes
+ * @len:     Length of the region
+ *
+ * @return   true (The region is read as zero without device access)
+ */
+bool is_hole(off_t index, size_t len)
+{
+	ssize_t i = find_hole(index);
+
+	return i >= 0 && index + len <= info->holes[i].end;
+}
+
+/**
+ * find_data - Get the first byte not in hole
+ * @index:     Start bytes
+ *
+ * @return     @index (@index is in data)
+ *             End of the hole which contains @index
+ *
+ * NOTE: Bulk scan can skip the region from @index to return value.
+ */
+off_t find_data(off_t index)
+{
+	ssize_t i = find_hole(index);
+
+	return (i < 0) ? index : info->holes[i].end;
+}
+
+/**
+ * fill_hole - Remove region from hole map
+ * @index:     Start bytes
+ * @len:       Length of the region
+ *
+ * NOTE: Region written by caller is no longer hole.
+ */
+static void fill_hole(off_t index, size_t len)
+{
+	size_t i;
+	off_t end = index + len;
+	struct hole *tmp;
+
+	for (i = 0; i < info->hole_num; i++) {
+		if (info->holes[i].end <= index || info->holes[i].start >= end)
+			continue;
+
+		if (info->holes[i].start < index && info->holes[i].end > end) {
+			/* Hole is split into two holes */
+			if (!(tmp = realloc(info->holes, sizeof(struct hole) * (info->hole_num + 1)))) {
+				/* Hole map can't be trusted anymore */
+				free(info->holes);
+				info->holes = NULL;
+				info->hole_num = 0;
+				return;
+			}
+			info->holes = tmp;
+			memmove(info->holes + i + 1, info->holes + i,
+					sizeof(struct hole) * (info->hole_num - i));
+			info->hole_num++;
+			info->holes[i].end = index;
+			info->holes[i + 1].start = end;
+			return;
+		}
+
+		if (info->holes[i].start < index) {
+			info->holes[i].end = index;
+		} else if (info->holes[i].end > end) {
+			info->holes[i].start = end;
+		} else {
+			memmove(info->holes + i, info->holes + i + 1,
+					sizeof(struct hole) * (info->hole_num - i - 1));
+			info->hole_num--;
+			i--;
+		}
+	}
+}
+
+/**
+ * init_cache - Initialize sector cache
+ * @block_size:  cache block size (sector size)
+ *
+ * @return        0 (success)
+ *               -1 (failed to allocate)
+ */
+static int init_cache(size_t block_size)
+{
+	struct sector_cache *c;
+
+	if (!(c = calloc(1, sizeof(struct sector_cache))))
+		return -1;
+
+	c->block_size = block_size;
+	c->max_count = MAX(CACHE_SIZE / block_size, CACHE_BYPASS * CACHE_RUN_MAX);
+	c->hash_size = c->max_count;
+	if (!(c->hash = calloc(c->hash_size, sizeof(struct cache_block *)))) {
+		free(c);
+		return -1;
+	}
+
+	info->cache = c;
+	return 0;
+}
+
+/**
+ * cache_bucket - Get hash bucket for cache block
+ * @offset:       Start bytes of cache block
+ *
+ * @return        hash bucket
+ */
+static struct cache_block **cache_bucket(off_t offset)
+{
+	struct sector_cache *c = info->cache;
+
+	return &c->hash[(offset / c->block_size) % c->hash_size];
+}
+
+/**
+ * cache_lookup - Search cache block
+ * @offset:       Start bytes of cache block
+ *
+ * @return        cache block
+ *                NULL (Not cached)
+ */
+static struct cache_block *cache_lookup(off_t offset)
+{
+	struct cache_block *b;
+
+	for (b = *cache_bucket(offset); b; b = b->hash) {
+		if (b->offset == offset)
+			return b;
+	}
+	return NULL;
+}
+
+/**
+ * cache_unlink - Remove cache block from LRU list and hash table
+ * @b:            cache block
+ */
+static void cache_unlink(struct cache_block *b)
+{
+	struct sector_cache *c = info->cache;
+	struct cache_block **p;
+
+	for (p = cache_bucket(b->offset); *p; p = &(*p)->hash) {
+		if (*p == b) {
+			*p = b->hash;
+			break;
+		}
+	}
+
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		c->head = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+	else
+		c->tail = b->prev;
+	b->prev = b->next = b->hash = NULL;
+}
+
+/**
+ * cache_touch - Move cache block to the head of LRU list
+ * @b:           cache block
+ */
+static void cache_touch(struct cache_block *b)
+{
+	struct sector_cache *c = info->cache;
+
+	if (c->head == b)
+		return;
+
+	if (b->prev)
+		b->prev->next = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+	else
+		c->tail = b->prev;
+
+	b->prev = NULL;
+	b->next = c->head;
+	c->head->prev = b;
+	c->head = b;
+}
+
+/**
+ * compare_block - compare cache block offset for qsort
+ * @a:             cache block
+ * @b:             cache block
+ *
+ * @return         difference of offset
+ */
+static int compare_block(const void *a, const void *b)
+{
+	off_t x = (*(struct cache_block **)a)->offset;
+	off_t y = (*(struct cache_block **)b)->offset;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * flush_cache - Write back all dirty blocks in sector cache
+ *
+ * @return        0 (success)
+ *               -1 (failed to write)
+ *
+ * NOTE: Contiguous dirty blocks are written by one system call.
+ */
+int flush_cache(void)
+{
+	int ret = 0;
+	size_t i, j, n = 0;
+	struct sector_cache *c = info->cache;
+	struct cache_block *b;
+	struct cache_block **dirty;
+	struct iovec iov[CACHE_RUN_MAX];
+
+	if (!c || !c->dirty_count)
+		return 0;
+
+	if (!(dirty = malloc(sizeof(struct cache_block *) * c->dirty_count))) {
+		pr_err("malloc: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (b = c->head; b; b = b->next) {
+		if (b->dirty)
+			dirty[n++] = b;
+	}
+	qsort(dirty, n, sizeof(struct cache_block *), compare_block);
+
+	/* Undo records must be durable before the device is modified */
+	if (journal_sync(info->journal)) {
+		pr_err("journal: %s\n", strerror(errno));
+		free(dirty);
+		return -1;
+	}
+
+	for (i = 0; i < n; i = j) {
+		for (j = i; j < n && j - i < CACHE_RUN_MAX; j++) {
+			if (j != i && dirty[j]->offset != dirty[j - 1]->offset + c->block_size)
+				break;
+			iov[j - i].iov_base = dirty[j]->data;
+			iov[j - i].iov_len = c->block_size;
+		}
+
+		pr_debug("Flush: Sector from 0x%lx to 0x%lx\n", dirty[i]->offset,
+				dirty[j - 1]->offset + c->block_size - 1);
+		account_syscall(true);
+		if (volume_pwritev(iov, j - i, dirty[i]->offset) < 0) {
+			pr_err("write: %s\n", strerror(errno));
+			ret = -1;
+			continue;
+		}
+		while (i < j) {
+			dirty[i++]->dirty = false;
+			c->dirty_count--;
+		}
+	}
+
+	free(dirty);
+	if (overlay_sync(info->overlay)) {
+		pr_err("write: %s\n", strerror(errno));
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * sync_volume - Make written data durable at the boundary
+ * @boundary:    DURABILITY_SESSION, DURABILITY_COMMAND or DURABILITY_WRITE
+ *
+ * @return        0 (success, or policy doesn't sync at @boundary)
+ *               -1 (failed to write or sync)
+ *
+ * NOTE: Dirty blocks in cache are written back, and then only one
+ *       fdatasync is issued if anything was written since the last sync.
+ */
+int sync_volume(int boundary)
+{
+	int i, ret;
+
+	if (info->durability < boundary)
+		return 0;
+
+	if (flush_cache())
+		return -1;
+	if (!info->unsynced)
+		return 0;
+
+	ret = info->overlay ? overlay_datasync(info->overlay) : fdatasync(info->fd);
+	if (ret) {
+		pr_err("sync: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < IOSTAT_NUM; i++)
+		info->stat[i].syncs++;
+	info->unsynced = false;
+	return 0;
+}
+
+/**
+ * release_cache - Write back and release sector cache
+ */
+static void release_cache(void)
+{
+	struct sector_cache *c = info->cache;
+	struct cache_block *b, *next;
+
+	if (!c)
+		return;
+
+	flush_cache();
+	for (b = c->head; b; b = next) {
+		next = b->next;
+		free(b->data);
+		free(b);
+	}
+	free(c->hash);
+	free(c);
+	info->cache = NULL;
+}
+
+/**
+ * discard_cache - Release sector cache without write back
+ *
+ * NOTE: Device is going to be replaced, so changes in cache are lost.
+ */
+static void discard_cache(void)
+{
+	struct cache_block *b;
+
+	if (!info->cache)
+		return;
+
+	for (b = info->cache->head; b; b = b->next)
+		b->dirty = false;
+	info->cache->dirty_count = 0;
+	release_cache();
+}
+
+/**
+ * cache_alloc - Get unused cache block
+ * @offset:      Start bytes of cache block
+ *
+ * @return       cache block (not filled)
+ *               NULL (failed to allocate, or to write back evicted block)
+ *
+ * NOTE: If cache is full, The least recently used block is evicted.
+ */
+static struct cache_block *cache_alloc(off_t offset)
+{
+	struct sector_cache *c = info->cache;
+	struct cache_block *b;
+
+	if (c->count < c->max_count) {
+		if (!(b = calloc(1, sizeof(struct cache_block))))
+			return NULL;
+		if (!(b->data = alloc_aligned(c->block_size))) {
+			free(b);
+			return NULL;
+		}
+		c->count++;
+	} else {
+		b = c->tail;
+		/* Victim keeps its data until it is written back */
+		if (b->dirty && flush_cache())
+			return NULL;
+		cache_unlink(b);
+	}
+
+	b->offset = offset;
+	b->hash = *cache_bucket(offset);
+	*cache_bucket(offset) = b;
+	b->next = c->head;
+	if (c->head)
+		c->head->prev = b;
+	c->head = b;
+	if (!c->tail)
+		c->tail = b;
+
+	return b;
+}
+
+/**
+ * cache_fill - Read continuous cache blocks from device
+ * @blocks:     cache blocks
+ * @num:        The number of blocks
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ */
+static int cache_fill(struct cache_block **blocks, size_t num)
+{
+	size_t i;
+	ssize_t len;
+	size_t block_size = info->cache->block_size;
+	struct iovec iov[CACHE_RUN_MAX];
+
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = blocks[i]->data;
+		iov[i].iov_len = block_size;
+	}
+
+	/* Hole is read as zero without device access */
+	if (is_hole(blocks[0]->offset, block_size * num)) {
+		for (i = 0; i < num; i++)
+			memset(blocks[i]->data, 0, block_size);
+		return 0;
+	}
+
+	account_syscall(false);
+	if ((len = volume_preadv(iov, num, blocks[0]->offset)) < 0) {
+		pr_err("read: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* Beyond the end of image is treated as zero */
+	for (i = 0; i < num; i++) {
+		if (len >= (ssize_t)((i + 1) * block_size))
+			continue;
+		if (len <= (ssize_t)(i * block_size))
+			memset(blocks[i]->data, 0, block_size);
+		else
+			memset(blocks[i]->data + (len - i * block_size), 0,
+					(i + 1) * block_size - len);
+	}
+	return 0;
+}
+
+/**
+ * cache_drop - Discard cache blocks
+ * @blocks:     cache blocks
+ * @num:        The number of blocks
+ */
+static void cache_drop(struct cache_block **blocks, size_t num)
+{
+	size_t i;
+	struct sector_cache *c = info->cache;
+
+	for (i = 0; i < num; i++) {
+		cache_unlink(blocks[i]);
+		free(blocks[i]->data);
+		free(blocks[i]);
+		c->count--;
+	}
+}
+
+/**
+ * cache_read - Read Raw-Data through sector cache
+ * @data:       Raw data (Output)
+ * @index:      Start bytes
+ * @len:        data length
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ */
+static int cache_read(void *data, off_t index, size_t len)
+{
+	size_t i, n, pos, skip, copy;
+	size_t block_size = info->cache->block_size;
+	off_t offset = index - (index % block_size);
+	off_t end = index + len;
+	struct cache_block *run[CACHE_RUN_MAX];
+
+	for (pos = 0; pos < len; ) {
+		if ((run[0] = cache_lookup(offset)) != NULL) {
+			cache_touch(run[0]);
+			n = 1;
+		} else {
+			/* Read continuous missing blocks at once */
+			for (n = 0; n < CACHE_RUN_MAX && offset + n * block_size < end; n++) {
+				if (n && cache_lookup(offset + n * block_size))
+					break;
+				if (!(run[n] = cache_alloc(offset + n * block_size))) {
+					cache_drop(run, n);
+					return -1;
+				}
+			}
+			if (cache_fill(run, n)) {
+				cache_drop(run, n);
+				return -1;
+			}
+		}
+
+		for (i = 0; i < n; i++, offset += block_size) {
+			skip = (offset < index) ? (index - offset) : 0;
+			copy = MIN(block_size - skip, len - pos);
+			memcpy(data + pos, run[i]->data + skip, copy);
+			pos += copy;
+		}
+	}
+	return 0;
+}
+
+/**
+ * cache_write - Write Raw-Data through sector cache
+ * @data:        Raw data
+ * @index:       Start bytes
+ * @len:         data length
+ *
+ * @return        0 (success)
+ *               -1 (failed to write)
+ */
+static int cache_write(void *data, off_t index, size_t len)
+{
+	size_t pos, skip, copy;
+	size_t block_size = info->cache->block_size;
+	off_t offset = index - (index % block_size);
+	struct cache_block *b;
+
+	for (pos = 0; pos < len; offset += block_size) {
+		skip = (pos == 0) ? (index - offset) : 0;
+		copy = MIN(block_size - skip, len - pos);
+
+		if ((b = cache_lookup(offset)) != NULL) {
+			cache_touch(b);
+		} else {
+			if (!(b = cache_alloc(offset)))
+				return -1;
+			/* Partial update needs the current contents */
+			if (copy != block_size && cache_fill(&b, 1)) {
+				cache_drop(&b, 1);
+				return -1;
+			}
+		}
+
+		memcpy(b->data + skip, data + pos, copy);
+		if (!b->dirty) {
+			b->dirty = true;
+			info->cache->dirty_count++;
+		}
+		pos += copy;
+	}
+	return 0;
+}
+
+/**
+ * cache_sync - Synchronize cached blocks with uncached access
+ * @data:       Raw data
+ * @index:      Start bytes
+ * @len:        data length
+ * @write:      true if @data was written to device
+ *
+ * NOTE: cached contents are newer than device on read,
+ *       and written data are newer than cached contents on write.
+ */
+static void cache_sync(void *data, off_t index, size_t len, bool write)
+{
+	off_t start, end;
+	struct sector_cache *c = info->cache;
+	struct cache_block *b;
+
+	for (b = c->head; b; b = b->next) {
+		if (b->offset + (off_t)c->block_size <= index || b->offset >= index + (off_t)len)
+			continue;
+
+		start = MAX(b->offset, index);
+		end = MIN(b->offset + (off_t)c->block_size, index + (off_t)len);
+		if (write) {
+			memcpy(b->data + (start - b->offset), data + (start - index), end - start);
+			if (b->dirty && end - start == c->block_size) {
+				b->dirty = false;
+				c->dirty_count--;
+			}
+		} else {
+			memcpy(data + (start - index), b->data + (start - b->offset), end - start);
+		}
+	}
+}
+
+/**
+ * read_sector - Get Raw-Data from any sector
+ * @data:       Sector raw data (Output)
+ * @index:      Start bytes
+ * @count:      The number of sectors
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+static int read_sector(void *data, off_t index, size_t count)
+{
+	size_t sector_size = info->sector_size;
+	size_t len = count * sector_size;
+	size_t copy;
+	struct iovec iov = {data, len};
+
+	pr_debug("Get: Sector from 0x%lx to 0x%lx\n", index , index + (count * sector_size) - 1);
+	if (info->map) {
+		/* Beyond the end of image is treated as zero */
+		copy = (index < info->total_size) ? MIN(len, info->total_size - index) : 0;
+		memcpy(data, info->map + index, copy);
+		memset(data + copy, 0, len - copy);
+		return 0;
+	}
+
+	if (info->zimage && !info->overlay)
+		return zimage_read(info->zimage, data, info->volume_offset + index, len);
+
+	/* Hole is read as zero without device access */
+	if (is_hole(index, len)) {
+		memset(data, 0, len);
+		return 0;
+	}
+
+	if (!info->cache && sector_size)
+		init_cache(MAX(sector_size, info->pool.align));
+
+	if (info->cache && (len <= info->cache->block_size * (info->cache->max_count / CACHE_BYPASS) ||
+				!is_aligned(data, index, len)))
+		return cache_read(data, index, len);
+
+	account_syscall(false);
+	if (volume_preadv(&iov, 1, index) < 0) {
+		pr_err("read: %s\n", strerror(errno));
+		return -1;
+	}
+	if (info->cache)
+		cache_sync(data, index, len, false);
+	return 0;
+}
+
+/**
+ * get_sector - Get Raw-Data from any sector
+ * @data:       Sector raw data (Output)
+ * @index:      Start bytes
+ * @count:      The number of sectors
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+int get_sector(void *data, off_t index, size_t count)
+{
+	int ret;
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = read_sector(data, index, count);
+	account_io(false, index, count * info->sector_size, elapsed_nsec(&start));
+	return ret;
+}
+
+/**
+ * map_sector - Get pointer to Raw-Data of any sector
+ * @index:      Start bytes
+ * @count:      The number of sectors
+ *
+ * @return      pointer to Raw-Data
+ *              NULL (image isn't mapped)
+ *
+ * NOTE: Returned data must not be modified or freed.
+ */
+void *map_sector(off_t index, size_t count)
+{
+	if (!info->map || index + count * info->sector_size > info->total_size)
+		return NULL;
+
+	/* Memory access has no latency to account for */
+	account_io(false, index, count * info->sector_size, 0);
+	return info->map + index;
+}
+
+/**
+ * advise_access - Tell the kernel how a region is going to be accessed
+ * @index:         Start bytes
+ * @len:           Length of the region (0 means until the end)
+ * @pattern:       ACCESS_SEQUENTIAL (scan, region is prefetched)
+ *                 ACCESS_RANDOM     (chain walk, readahead is disabled)
+ *                 ACCESS_ONCE       (region was read just once, pages are dropped)
+ *
+ * @return          0 (success)
+ *                 -1 (failed to advise)
+ *
+ * NOTE: Pages dropped by ACCESS_ONCE are limited to ACCESS_DROP_MIN bytes or more,
+ *       since small region is likely to share page with metadata.
+ */
+int advise_access(off_t index, size_t len, int pattern)
+{
+	int ret = 0;
+	off_t start;
+	size_t size;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	/* Direct I/O doesn't go through page cache */
+	if ((info->attr & OPTION_DIRECT) || info->zimage)
+		return 0;
+	if (pattern == ACCESS_ONCE && len < ACCESS_DROP_MIN)
+		return 0;
+
+	/* Memory map has its own readahead state */
+	if (info->map && index < info->total_size) {
+		/* Memory map starts at the page which contains the start of volume */
+		start = index - (info->volume_offset + index) % page_size;
+		size = (!len || index + len > info->total_size) ? info->total_size - start : len + index - start;
+		switch (pattern) {
+			case ACCESS_SEQUENTIAL:
+				ret = madvise(info->map + start, size, MADV_SEQUENTIAL);
+				break;
+			case ACCESS_RANDOM:
+				ret = madvise(info->map + start, size, MADV_RANDOM);
+				break;
+			case ACCESS_ONCE:
+				ret = madvise(info->map + start, size, MADV_DONTNEED);
+				break;
+		}
+		if (ret)
+			goto out;
+	}
+
+	switch (pattern) {
+		case ACCESS_SEQUENTIAL:
+			ret = posix_fadvise(info->fd, info->volume_offset + index, len, POSIX_FADV_SEQUENTIAL);
+			if (!ret && readahead(info->fd, info->volume_offset + index,
+						len ? len : info->total_size - index) < 0)
+				ret = -1;
+			break;
+		case ACCESS_RANDOM:
+			ret = posix_fadvise(info->fd, info->volume_offset + index, len, POSIX_FADV_RANDOM);
+			break;
+		case ACCESS_ONCE:
+			/* Pages must be clean before dropping */
+			flush_cache();
+			ret = posix_fadvise(info->fd, info->volume_offset + index, len, POSIX_FADV_DONTNEED);
+			break;
+	}
+
+out:
+	if (ret) {
+		pr_debug("advise: %s\n", strerror(ret > 0 ? ret : errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * write_sector - Set Raw-Data from any sector
+ * @data:       Sector raw data
+ * @index:      Start bytes
+ * @count:      The number of sectors
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ *       Data is written back when flush_cache() is called.
+ */
+static int write_sector(void *data, off_t index, size_t count)
+{
+	size_t sector_size = info->sector_size;
+	size_t len = count * sector_size;
+	struct iovec iov = {data, len};
+
+	pr_debug("Set: Sector from 0x%lx to 0x%lx\n", index, index + (count * sector_size) - 1);
+	if (info->zimage && !info->overlay) {
+		pr_err("Compressed image is read-only.\n");
+		return -1;
+	}
+
+	if (info->journal && journal_record(info->journal, index, len, read_volume)) {
+		pr_err("journal: %s\n", strerror(errno));
+		return -1;
+	}
+
+	fill_hole(index, len);
+	if (!info->cache && sector_size)
+		init_cache(MAX(sector_size, info->pool.align));
+
+	if (info->cache && (len <= info->cache->block_size * (info->cache->max_count / CACHE_BYPASS) ||
+				!is_aligned(data, index, len)))
+		return cache_write(data, index, len);
+
+	if (journal_sync(info->journal)) {
+		pr_err("journal: %s\n", strerror(errno));
+		return -1;
+	}
+
+	account_syscall(true);
+	if (volume_pwritev(&iov, 1, index) < 0) {
+		pr_err("write: %s\n", strerror(errno));
+		return -1;
+	}
+	if (info->cache)
+		cache_sync(data, index, len, true);
+	return 0;
+}
+
+/**
+ * set_sector - Set Raw-Data from any sector
+ * @data:       Sector raw data
+ * @index:      Start bytes
+ * @count:      The number of sectors
+ *
+ * @return       0 (success)
+ *              -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ *       Data is written back when flush_cache() is called,
+ *       or made durable immediately by DURABILITY_WRITE.
+ */
+int set_sector(void *data, off_t index, size_t count)
+{
+	int ret;
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = write_sector(data, index, count);
+	account_io(true, index, count * info->sector_size, elapsed_nsec(&start));
+	if (!ret)
+		ret = sync_volume(DURABILITY_WRITE);
+	return ret;
+}
+
+/**
+ * get_cluster - Get Raw-Data from any cluster
+ * @data:        cluster raw data (Output)
+ * @index:       Start cluster index
+ *
+ * @return        0 (success)
+ *               -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+int get_cluster(void *data, off_t index)
+{
+	return get_clusters(data, index, 1);
+}
+
+/**
+ * set_cluster - Set Raw-Data from any cluster
+ * @data:        cluster raw data
+ * @index:       Start cluster index
+ *
+ * @return        0 (success)
+ *               -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+int set_cluster(void *data, off_t index)
+{
+	return set_clusters(data, index, 1);
+}
+
+/**
+ * get_clusters - Get Raw-Data from any cluster
+ * @data:         cluster raw data (Output)
+ * @index:        Start cluster index
+ * @num:          The number of clusters
+ *
+ * @return         0 (success)
+ *                -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+int get_clusters(void *data, off_t index, size_t num)
+{
+	size_t clu_per_sec = info->cluster_size / info->sector_size;
+	off_t heap_start = info->heap_offset * info->sector_size;
+
+	if (index < 2 || index + num > info->cluster_count) {
+		pr_err("invalid cluster index %lu.\n", index);
+		return -1;
+	}
+
+	return get_sector(data,
+			heap_start + ((index - 2) * info->cluster_size),
+			clu_per_sec * num);
+}
+
+/**
+ * is_valid_chain - Check whether all clusters in index list are valid
+ * @chain:          cluster index list
+ * @num:            The number of clusters
+ *
+ * @return          true (All clusters are valid)
+ */
+static bool is_valid_chain(uint32_t *chain, size_t num)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		if (chain[i] < 2 || chain[i] >= info->cluster_count + 2)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * chain_extent - Get the number of continuous clusters in cluster index list
+ * @chain:        cluster index list
+ * @num:          The number of clusters
+ *
+ * @return        The number of clusters continuous from @chain[0]
+ */
+static size_t chain_extent(uint32_t *chain, size_t num)
+{
+	size_t len = 1;
+
+	while (len < num && chain[len] == chain[0] + len &&
+			(len + 1) * info->cluster_size <= CHAIN_EXTENT_MAX)
+		len++;
+	return len;
+}
+
+/**
+ * get_cluster_chain - Get Raw-Data from discontinuous clusters
+ * @data:              cluster raw data (Output)
+ * @chain:             cluster index list
+ * @num:               The number of clusters
+ *
+ * @return              0 (success)
+ *                     -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ *       Continuous clusters are read by one request, and
+ *       all requests are submitted to io_uring at once if available.
+ *       Invalid cluster is reported, and the others are still read.
+ */
+int get_cluster_chain(void *data, uint32_t *chain, size_t num)
+{
+	int ret = 0;
+	size_t i, len, done = 0;
+	size_t cluster_size = info->cluster_size;
+	off_t heap_start = info->heap_offset * info->sector_size;
+	uint64_t index;
+	ssize_t res;
+	int submitted;
+	struct timespec start;
+
+	if (!info->uring || chain_extent(chain, num) == num ||
+			!is_valid_chain(chain, num) || !is_aligned(data, heap_start, cluster_size))
+		goto sync;
+
+	/* Device must be up-to-date, because io_uring doesn't go through cache */
+	flush_cache();
+	for (i = 0; done < num; done += len) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (; i < num; i += len) {
+			len = chain_extent(chain + i, num - i);
+			if (uring_prep_read(info->uring, info->fd, data + cluster_size * i,
+						cluster_size * len,
+						info->volume_offset + heap_start + (chain[i] - 2) * cluster_size, i))
+				break;
+		}
+		if ((submitted = uring_submit(info->uring)) > 0)
+			account_syscall(false);
+		if (submitted < 0 || uring_wait(info->uring, &index, &res) < 0) {
+			pr_debug("io_uring: %s\n", strerror(errno));
+			/* Give up io_uring, and read all clusters again */
+			uring_exit(info->uring);
+			info->uring = NULL;
+			goto sync;
+		}
+		/* Short read or error is retried by synchronous read */
+		len = chain_extent(chain + index, num - index);
+		account_io(false, heap_start + (chain[index] - 2) * cluster_size,
+				cluster_size * len, elapsed_nsec(&start));
+		if (res != cluster_size * len)
+			ret |= get_clusters(data + cluster_size * index, chain[index], len);
+	}
+	return ret;
+
+sync:
+	for (i = 0; i < num; i += len) {
+		len = chain_extent(chain + i, num - i);
+		ret |= get_clusters(data + cluster_size * i, chain[i], len);
+	}
+	return ret;
+}
+
+/**
+ * get_cluster_chains - Get Raw-Data from several cluster index lists at once
+ * @chain:              cluster index lists
+ * @num:                The number of clusters in each list
+ * @count:              The number of lists
+ *
+ * @return              cluster raw data (lists are stored in order)
+ *                      NULL (failed to allocate)
+ *
+ * NOTE: All lists are read by one get_cluster_chain(), so they share io_uring submissions.
+ *       Returned buffer must be released by caller.
+ */
+void *get_cluster_chains(uint32_t **chain, size_t *num, size_t count)
+{
+	size_t i, total = 0;
+	uint32_t *list;
+	void *data;
+
+	for (i = 0; i < count; i++)
+		total += num[i];
+
+	if (!(list = malloc(sizeof(uint32_t) * total)))
+		return NULL;
+	if (!(data = alloc_aligned(info->cluster_size * total))) {
+		free(list);
+		return NULL;
+	}
+
+	for (total = 0, i = 0; i < count; total += num[i++])
+		memcpy(list + total, chain[i], sizeof(uint32_t) * num[i]);
+
+	get_cluster_chain(data, list, total);
+	free(list);
+	return data;
+}
+
+/**
+ * set_cluster_chain - Set Raw-Data to discontinuous clusters
+ * @data:              cluster raw data
+ * @chain:             cluster index list
+ * @num:               The number of clusters
+ *
+ * @return              0 (success)
+ *                     -1 (failed to write)
+ *
+ * NOTE: Continuous clusters are written by one request.
+ *       Invalid cluster is reported, and the others are still written.
+ */
+int set_cluster_chain(void *data, uint32_t *chain, size_t num)
+{
+	int ret = 0;
+	size_t i, len;
+
+	for (i = 0; i < num; i += len) {
+		len = chain_extent(chain + i, num - i);
+		ret |= set_clusters(data + info->cluster_size * i, chain[i], len);
+	}
+	return ret;
+}
+
+/**
+ * open_cluster_stream - Start to read discontinuous clusters in order
+ * @s:                   cluster stream (Output)
+ * @chain:               cluster index list
+ * @num:                 The number of clusters
+ *
+ * @return                0 (success)
+ *                       -1 (failed to allocate)
+ *
+ * NOTE: Clusters are read ahead into a ring of STREAM_DEPTH buffers,
+ *       so the caller can parse a cluster while the next ones are read.
+ *       io_uring instance of the volume is held until close_cluster_stream().
+ *       @chain must be kept until close_cluster_stream().
+ */
+int open_cluster_stream(struct cluster_stream *s, uint32_t *chain, size_t num)
+{
+	size_t i;
+
+	memset(s, 0, sizeof(struct cluster_stream));
+	s->chain = chain;
+	s->num = num;
+
+	for (i = 0; i < STREAM_DEPTH && i < num; i++) {
+		if (!(s->buf[i] = alloc_cluster())) {
+			close_cluster_stream(s);
+			return -1;
+		}
+	}
+
+	/* Read ahead only pays off when the stream has more than one cluster */
+	if (num > 1 && info->uring && !info->zimage && is_valid_chain(chain, num) &&
+			is_aligned(s->buf[0], info->heap_offset * info->sector_size, info->cluster_size)) {
+		/* Device must be up-to-date, because io_uring doesn't go through cache */
+		flush_cache();
+		/* Borrow volume's ring, nested readers fall back to synchronous read */
+		s->uring = info->uring;
+		info->uring = NULL;
+	}
+	return 0;
+}
+
+/**
+ * wait_cluster_stream - Wait until cluster in the stream is read
+ * @s:                   cluster stream
+ * @index:               cluster index in the stream (already submitted)
+ */
+static void wait_cluster_stream(struct cluster_stream *s, size_t index)
+{
+	size_t slot = index % STREAM_DEPTH;
+	uint64_t done;
+	ssize_t res;
+	struct timespec start;
+
+	while (!s->ready[slot]) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (!s->uring || uring_wait(s->uring, &done, &res) < 0) {
+			get_cluster(s->buf[slot], s->chain[index]);
+			s->ready[slot] = true;
+			break;
+		}
+		account_io(false, (info->heap_offset * info->sector_size) +
+				(s->chain[done] - 2) * info->cluster_size, info->cluster_size, elapsed_nsec(&start));
+		/* Short read or error is retried by synchronous read */
+		if (res != info->cluster_size)
+			get_cluster(s->buf[done % STREAM_DEPTH], s->chain[done]);
+		s->ready[done % STREAM_DEPTH] = true;
+	}
+}
+
+/**
+ * fill_cluster_stream - Submit read requests for clusters ahead
+ * @s:                   cluster stream
+ * @index:               cluster index in the stream going to be accessed
+ *
+ * NOTE: clusters older than @index - (STREAM_DEPTH - STREAM_AHEAD - 1)
+ *       are released to reuse their buffers.
+ */
+static void fill_cluster_stream(struct cluster_stream *s, size_t index)
+{
+	size_t slot;
+	int submitted = 0;
+	size_t end = MIN(s->num, index + STREAM_AHEAD + 1);
+	off_t heap_start = info->heap_offset * info->sector_size;
+
+	while (s->tail < end) {
+		if (s->tail - s->head == STREAM_DEPTH) {
+			wait_cluster_stream(s, s->head);
+			s->ready[s->head % STREAM_DEPTH] = false;
+			s->head++;
+		}
+
+		slot = s->tail % STREAM_DEPTH;
+		if (!s->uring) {
+			/* Without io_uring, only accessed cluster is read */
+			if (s->tail > index)
+				break;
+			get_cluster(s->buf[slot], s->chain[s->tail]);
+			s->ready[slot] = true;
+		} else if (uring_prep_read(s->uring, info->fd, s->buf[slot], info->cluster_size,
+					info->volume_offset + heap_start + (s->chain[s->tail] - 2) * info->cluster_size,
+					s->tail)) {
+			break;
+		}
+		s->tail++;
+	}
+
+	if (s->uring && (submitted = uring_submit(s->uring)) > 0)
+		account_syscall(false);
+	if (s->uring && submitted < 0) {
+		pr_debug("io_uring: %s\n", strerror(errno));
+		uring_exit(s->uring);
+		s->uring = NULL;
+		/* Read all submitted clusters again */
+		for (slot = s->head; slot < s->tail; slot++) {
+			get_cluster(s->buf[slot % STREAM_DEPTH], s->chain[slot]);
+			s->ready[slot % STREAM_DEPTH] = true;
+		}
+	}
+}
+
+/**
+ * read_cluster_stream - Get Raw-Data at any position in cluster stream
+ * @s:                   cluster stream
+ * @offset:              Start bytes in the stream
+ *
+ * @return               pointer to Raw-Data (valid until next call)
+ *                       NULL (@offset is out of stream)
+ *
+ * NOTE: Data is never across the cluster boundary.
+ *       Access must be in ascending order, except within
+ *       STREAM_DEPTH - STREAM_AHEAD clusters from the latest one.
+ */
+void *read_cluster_stream(struct cluster_stream *s, size_t offset)
+{
+	size_t index = offset / info->cluster_size;
+
+	if (index >= s->num || index < s->head) {
+		if (index < s->head)
+			pr_err("cluster stream can't go back to %lu.\n", index);
+		return NULL;
+	}
+
+	if (index >= s->tail)
+		fill_cluster_stream(s, index);
+
+	wait_cluster_stream(s, index);
+	return s->buf[index % STREAM_DEPTH] + (offset % info->cluster_size);
+}
+
+/**
+ * close_cluster_stream - Finish to read cluster stream
+ * @s:                    cluster stream
+ */
+void close_cluster_stream(struct cluster_stream *s)
+{
+	size_t i;
+	uint64_t done;
+	ssize_t res;
+
+	if (s->uring) {
+		/* Buffers must not be released while reading */
+		while (uring_inflight(s->uring) && !uring_wait(s->uring, &done, &res))
+			;
+		/* Ring is given back to volume only if it is drained */
+		if (uring_inflight(s->uring))
+			uring_exit(s->uring);
+		else
+			info->uring = s->uring;
+	}
+
+	for (i = 0; i < STREAM_DEPTH; i++)
+		free_cluster(s->buf[i]);
+	memset(s, 0, sizeof(struct cluster_stream));
+}
+
+/**
+ * set_clusters - Set Raw-Data from any cluster
+ * @data:         cluster raw data
+ * @index:        Start cluster index
+ * @num:          The number of clusters
+ *
+ * @return         0 (success)
+ *                -1 (failed to read)
+ *
+ * NOTE: Need to allocate @data before call it.
+ */
+int set_clusters(void *data, off_t index, size_t num)
+{
+	size_t clu_per_sec = info->cluster_size / info->sector_size;
+	off_t heap_start = info->heap_offset * info->sector_size;
+
+	if (index < 2 || index + num > info->cluster_count) {
+		pr_err("invalid cluster index %lu.\n", index);
+		return -1;
+	}
+
+	return set_sector(data,
+			heap_start + ((index - 2) * info->cluster_size),
+			clu_per_sec * num);
+}
+
+/**
+ * hexdump - Hex dump of a given data
+ * @data:    Input data
+ * @size:    Input data size
+ */
+void hexdump(void *data, size_t size)
+{
+	size_t skip = 0;
+	size_t line, byte = 0;
+	size_t count = size / 0x10;
+	const char zero[0x10] = {0};
+
+	for (line = 0; line < count; line++) {
+		if ((line != count - 1) && (!memcmp(data + line * 0x10, zero, 0x10))) {
+			switch (skip++) {
+				case 0:
+					break;
+				case 1:
+					pr_msg("*\n");
+					/* FALLTHROUGH */
+				default:
+					continue;
+			}
+		} else {
+			skip = 0;
+		}
+
+		pr_msg("%08zX:  ", line * 0x10);
+		for (byte = 0; byte < 0x10; byte++) {
+			pr_msg("%02X ", ((unsigned char *)data)[line * 0x10 + byte]);
+		}
+		pr_msg(" ");
+		for (byte = 0; byte < 0x10; byte++) {
+			char ch = ((unsigned char *)data)[line * 0x10 + byte];
+			pr_msg("%c", isprint(ch) ? ch : '.');
+		}
+		pr_msg("\n");
+	}
+}
+
+/**
+ * gen_rand - generate random string of any characters
+ * @data:     Output data (Output)
+ * @len:      data length
+ */
+void gen_rand(char *data, size_t len)
+{
+	int i;
+	const char strset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+	for (i = 0; i < len; i++)
+		data[i] = strset[rand() % (sizeof(strset) - 1)];
+	data[i] = '\0';
+}
+
+/**
+ * check_mounted_filesystem - check if the image has mounted
+ *
+ * @return                    0 (not mount)
+ *                            1 (already mounted)
+ */
+static int check_mounted_filesystem(void)
+{
+	FILE *fstab = setmntent("/etc/mtab", "r");
+	struct mntent *e = NULL;
+
+	while ((e = getmntent(fstab)) != NULL) {
+		if (!strcmp(e->mnt_fsname, info->name))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * init_device_info - Initialize member in struct device_info
+ */
+static void init_device_info(void)
+{
+	info->fd = -1;
+	info->attr = 0;
+	info->total_size = 0;
+	info->sector_size = 0;
+	info->cluster_size = 0;
+	info->cluster_count = 0;
+	info->fstype = 0;
+	info->flags = 0;
+	info->fat_offset = 0;
+	info->fat_length = 0;
+	info->heap_offset = 0;
+	info->root_offset = 0;
+	info->root_length = 0;
+	info->alloc_table = NULL;
+	info->upcase_table = NULL;
+	info->upcase_size = 0;
+	info->vol_label = NULL;
+	info->vol_length = 0;
+	info->cache = NULL;
+	memset(&info->pool, 0, sizeof(struct buffer_pool));
+	info->map = NULL;
+	info->uring = NULL;
+	memset(info->stat, 0, sizeof(info->stat));
+	info->trace = NULL;
+	info->holes = NULL;
+	info->hole_num = 0;
+	info->zimage = NULL;
+	info->volume_offset = 0;
+	info->overlay = NULL;
+	info->capture = false;
+	info->journal = NULL;
+	info->durability = DURABILITY_NONE;
+	info->unsynced = false;
+	info->root_size = DENTRY_LISTSIZE;
+	info->root = calloc(info->root_size, sizeof(node2_t *));
+}
+
+/**
+ * locate_volume - Decide where filesystem is in device
+ * @attr:          command line options
+ * @partition:     partition number (--partition)
+ * @offset:        Start bytes of filesystem (--offset)
+ *
+ * @return          0 (success)
+ *                 -1 (volume isn't in device)
+ *
+ * NOTE: After this, info->total_size is the size of volume.
+ */
+static int locate_volume(uint32_t attr, unsigned int partition, off_t offset)
+{
+	off_t length;
+	struct partition part;
+
+	if ((attr & OPTION_PARTITION) && (attr & OPTION_OFFSET)) {
+		pr_err("--partition and --offset can't be specified at the same time.\n");
+		return -1;
+	}
+
+	if (attr & OPTION_PARTITION) {
+		if (get_partition(read_device, partition, &part)) {
+			pr_err("Partition %u: %s\n", partition,
+					errno == ENOENT ? "No such partition" :
+					errno == EINVAL ? "Partition table isn't found" : strerror(errno));
+			return -1;
+		}
+		offset = part.offset;
+		length = part.length;
+		pr_info("Partition %u: offset 0x%lx, length 0x%lx\n", partition, offset, length);
+	} else {
+		length = info->total_size - offset;
+	}
+
+	if (offset < 0 || (info->total_size && offset + length > info->total_size)) {
+		pr_err("Volume (offset 0x%lx) is beyond the end of device.\n", offset);
+		return -1;
+	}
+
+	if (info->pool.align && offset % info->pool.align) {
+		pr_err("Volume offset must be aligned to %zu bytes with --direct.\n", info->pool.align);
+		return -1;
+	}
+
+	info->volume_offset = offset;
+	if (info->total_size)
+		info->total_size = length;
+	return 0;
+}
+
+/**
+ * open_overlay - Open overlay file for volume
+ * @attr:         command line options
+ * @path:         overlay file path (--overlay)
+ *
+ * @return         0 (success, or no overlay)
+ *                -1 (failed to open)
+ *
+ * NOTE: Overlay isn't created in read-only session.
+ */
+static int open_overlay(uint32_t attr, const char *path)
+{
+	if (!(attr & OPTION_OVERLAY))
+		return 0;
+
+	if (!(info->overlay = overlay_open(path, info->total_size, attr & OPTION_READONLY))) {
+		pr_err("%s: %s\n", path,
+				errno == EINVAL ? "overlay is created for another volume" : strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * get_device_info - get device name and store in device_info
+ * @attr:            command line options
+ * @partition:       partition number (--partition)
+ * @offset:          Start bytes of filesystem (--offset)
+ * @overlay:         overlay file path (--overlay)
+ *
+ * @return            0 (success)
+ *                   -1 (failed to open)
+ */
+static int get_device_info(uint32_t attr, unsigned int partition, off_t offset, const char *overlay)
+{
+	int fd, flags;
+	int block_size = 0;
+	uint64_t device_size;
+	off_t map_offset;
+	size_t capture_size;
+	struct stat s;
+
+	if (check_mounted_filesystem() &&
+			!(attr & (OPTION_READONLY | OPTION_OVERLAY))) {
+		pr_err("Error has occurred becasue %s has already mounted.\n", info->name);
+		return -1;
+	}
+
+	if ((attr & OPTION_OVERLAY) && (attr & OPTION_DIRECT)) {
+		pr_err("--overlay and --direct can't be specified at the same time.\n");
+		return -1;
+	}
+
+	/* Device is never written in overlay session */
+	flags = attr & (OPTION_READONLY | OPTION_OVERLAY) ? O_RDONLY : O_RDWR;
+	if (attr & OPTION_DIRECT)
+		flags |= O_DIRECT;
+
+	if ((fd = open(info->name, flags)) < 0) {
+		pr_err("open: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &s) < 0) {
+		pr_err("stat: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	info->fd = fd;
+	info->total_size = s.st_size;
+	if (S_ISBLK(s.st_mode) && !ioctl(fd, BLKGETSIZE64, &device_size))
+		info->total_size = device_size;
+
+	/* Compressed image is decompressed on demand, instead of device access */
+	if (S_ISREG(s.st_mode) && zimage_probe(fd, s.st_size)) {
+		if (!(attr & (OPTION_READONLY | OPTION_OVERLAY)) || (attr & OPTION_DIRECT)) {
+			pr_err("Compressed image can be opened only in read-only or overlay mode without --direct.\n");
+			close(fd);
+			return -1;
+		}
+		if (!(info->zimage = zimage_open(fd, s.st_size))) {
+			pr_err("%s: %s\n", info->name,
+					errno == ENOTSUP ? "compressed image isn't supported" : "broken compressed image");
+			close(fd);
+			return -1;
+		}
+		info->total_size = zimage_size(info->zimage);
+		if (locate_volume(attr, partition, offset) || open_overlay(attr, overlay)) {
+			zimage_close(info->zimage);
+			info->zimage = NULL;
+			close(fd);
+			return -1;
+		}
+		return 0;
+	}
+
+	/* Capture is opened as volume which has only captured region */
+	if (S_ISREG(s.st_mode) && overlay_probe(fd, &capture_size)) {
+		if (attr & (OPTION_DIRECT | OPTION_PARTITION | OPTION_OFFSET | OPTION_OVERLAY)) {
+			pr_err("Capture can't be opened with --direct, --partition, --offset or --overlay.\n");
+			close(fd);
+			return -1;
+		}
+		info->total_size = capture_size;
+		info->capture = true;
+		if (!(info->overlay = overlay_open(info->name, info->total_size, attr & OPTION_READONLY))) {
+			pr_err("%s: %s\n", info->name, strerror(errno));
+			info->capture = false;
+			close(fd);
+			return -1;
+		}
+		return 0;
+	}
+
+	/* O_DIRECT requires buffer/offset/length to be aligned to logical block */
+	if (attr & OPTION_DIRECT) {
+		if (!S_ISBLK(s.st_mode) || ioctl(fd, BLKSSZGET, &block_size) < 0)
+			block_size = s.st_blksize;
+		if (!is_power2(block_size))
+			block_size = SECSIZE;
+		info->pool.align = MAX(block_size, sizeof(void *));
+		pr_debug("Direct I/O alignment: %d\n", block_size);
+	}
+
+	if (locate_volume(attr, partition, offset) || open_overlay(attr, overlay)) {
+		close(fd);
+		return -1;
+	}
+
+	/* Hole in device may be written in overlay */
+	if (S_ISREG(s.st_mode) && !info->overlay)
+		init_hole_map();
+
+	/* Image file in read-only session can be accessed via memory map */
+	if ((attr & OPTION_READONLY) && !(attr & OPTION_DIRECT) && !info->overlay &&
+			S_ISREG(s.st_mode) && info->total_size) {
+		/* Mapping must start at page boundary */
+		map_offset = info->volume_offset % sysconf(_SC_PAGESIZE);
+		info->map = mmap(NULL, info->total_size + map_offset, PROT_READ, MAP_SHARED,
+				fd, info->volume_offset - map_offset);
+		if (info->map == MAP_FAILED) {
+			pr_debug("mmap: %s\n", strerror(errno));
+			info->map = NULL;
+		} else {
+			info->map += map_offset;
+		}
+	}
+
+	/* Otherwise, cluster chain can be read by batch */
+	if (!info->map && !info->overlay)
+		info->uring = uring_init(URING_ENTRIES);
+	return 0;
+}
+
+/**
+ * free_dentry_list - release list2_t
+ *
+ * @return            Number of lists freed
+ */
+static int free_dentry_list(void)
+{
+	int i;
+
+	for(i = 0; i < info->root_size && info->root[i]; i++) {
+		info->ops->clean(i);
+	}
+	free(info->root);
+	return i;
+}
+
+/**
+ * pseudo_check_filesystem - virtual function to check filesystem
+ * @boot:                    boot sector pointer
+ *
+ * return:                    0 (succeeded in obtaining filesystem)
+ *                           -1 (failed)
+ */
+static int pseudo_check_filesystem(struct pseudo_bootsec *boot)
+{
+	void *data;
+
+	if (!(data = alloc_aligned(SECSIZE))) {
+		pr_err("malloc: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (read_volume(data, 0, SECSIZE)) {
+		pr_err("read: %s\n", strerror(errno));
+		free(data);
+		return -1;
+	}
+	memcpy(boot, data, SECSIZE);
+	free(data);
+
+	if (exfat_check_filesystem(boot))
+		return 0;
+	if (fat_check_filesystem(boot))
+		return 0;
+
+	pr_err("%s can't support this image.\n", PROGRAM_NAME);
+	return -1;
+}
+
+/**
+ * reload_filesystem - Discard filesystem information, and load it again
+ *
+ * @return             0 (success)
+ *                    -1 (failed)
+ *
+ * NOTE: Directory chains loaded before are released.
+ */
+int reload_filesystem(void)
+{
+	struct pseudo_bootsec boot;
+
+	free(info->vol_label);
+	free(info->upcase_table);
+	free(info->alloc_table);
+	info->vol_label = NULL;
+	info->vol_length = 0;
+	info->upcase_table = NULL;
+	info->upcase_size = 0;
+	info->alloc_table = NULL;
+	info->alloc_cluster = 0;
+
+	free_dentry_list();
+	info->root_size = DENTRY_LISTSIZE;
+	if (!(info->root = calloc(info->root_size, sizeof(node2_t *)))) {
+		pr_err("calloc: %s\n", strerror(errno));
+		return -1;
+	}
+	return pseudo_check_filesystem(&boot);
+}
+
+/**
+ * rollback_journal - Restore device to the state before the session
+ *
+ * @return            0 (success)
+ *                   -1 (failed)
+ *
+ * NOTE: Changes in cache are discarded without write back.
+ */
+int rollback_journal(void)
+{
+	if (!info->journal) {
+		pr_err("Undo journal isn't enabled.\n");
+		return -1;
+	}
+
+	discard_cache();
+
+	if (journal_rollback(info->journal, write_volume) || overlay_sync(info->overlay) ||
+			fdatasync(info->fd) || journal_reset(info->journal)) {
+		pr_err("rollback: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * clone_volume - Share volume data between files
+ * @dst:          destination file descriptor
+ * @dst_offset:   Start bytes in destination
+ * @src:          source file descriptor
+ * @src_offset:   Start bytes in source
+ *
+ * @return         0 (success)
+ *                -1 (reflink isn't supported)
+ */
+static int clone_volume(int dst, off_t dst_offset, int src, off_t src_offset)
+{
+	struct file_clone_range range = {
+		.src_fd = src,
+		.src_offset = src_offset,
+		.src_length = info->total_size,
+		.dest_offset = dst_offset,
+	};
+
+	return ioctl(dst, FICLONERANGE, &range);
+}
+
+/**
+ * take_snapshot - Save current state of volume
+ * @name:          snapshot file path
+ *
+ * @return          0 (success)
+ *                 -1 (failed)
+ *
+ * NOTE: If reflink isn't supported, volume is frozen instead, and
+ *       following changes are written to @name as overlay.
+ *       Such snapshot is available until the end of session.
+ */
+int take_snapshot(const char *name)
+{
+	int fd, ret;
+
+	if (info->overlay) {
+		pr_err("Snapshot can't be taken in overlay session.\n");
+		return -1;
+	}
+
+	/* Snapshot must contain changes in cache */
+	if (flush_cache())
+		return -1;
+
+	if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		pr_err("open: %s\n", strerror(errno));
+		return -1;
+	}
+	ret = clone_volume(fd, 0, info->fd, info->volume_offset);
+	close(fd);
+	if (!ret)
+		return 0;
+
+	pr_debug("ioctl: %s\n", strerror(errno));
+	if ((info->attr & OPTION_READONLY) ||
+			!(info->overlay = overlay_open(name, info->total_size, false))) {
+		pr_err("%s: reflink isn't supported.\n", name);
+		unlink(name);
+		return -1;
+	}
+
+	/* io_uring would read device, which is no longer up-to-date */
+	uring_exit(info->uring);
+	info->uring = NULL;
+	info->snapshot = strdup(name);
+	pr_warn("%s: reflink isn't supported, following changes are written to it.\n", name);
+	return 0;
+}
+
+/**
+ * restore_snapshot - Replace volume with snapshot
+ * @name:             snapshot file path
+ *
+ * @return             0 (success)
+ *                    -1 (failed)
+ *
+ * NOTE: Changes in cache are discarded without write back.
+ */
+int restore_snapshot(const char *name)
+{
+	int fd, ret = -1;
+	char magic[sizeof(OVERLAY_MAGIC)] = {};
+
+	if ((info->attr & OPTION_READONLY) || info->journal) {
+		pr_err("Snapshot can't be restored with -r or --journal.\n");
+		return -1;
+	}
+
+	/* Snapshot taken without reflink is just discarding overlay */
+	if (info->snapshot && !strcmp(name, info->snapshot)) {
+		discard_cache();
+		if (overlay_reset(info->overlay)) {
+			pr_err("restore: %s\n", strerror(errno));
+			return -1;
+		}
+		return 0;
+	}
+
+	if ((fd = open(name, O_RDONLY)) < 0) {
+		pr_err("open: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (pread(fd, magic, sizeof(magic) - 1, 0) < 0 || !strcmp(magic, OVERLAY_MAGIC)) {
+		pr_err("%s is snapshot without reflink, it is available only in the session.\n", name);
+		goto out;
+	}
+
+	if (info->overlay) {
+		pr_err("Snapshot can't be restored in overlay session.\n");
+		goto out;
+	}
+
+	discard_cache();
+	if (clone_volume(info->fd, info->volume_offset, fd, 0)) {
+		pr_err("restore: %s\n", strerror(errno));
+		goto out;
+	}
+
+	/* Holes in device are also replaced */
+	reset_hole_map();
+	ret = 0;
+out:
+	close(fd);
+	return ret;
+}
+
+/**
+ * release_snapshot - Write changes after snapshot back to volume
+ *
+ * NOTE: Only for snapshot which is taken without reflink.
+ */
+static void release_snapshot(void)
+{
+	if (!info->snapshot)
+		return;
+
+	if (overlay_merge(info->overlay, write_base) || fdatasync(info->fd)) {
+		pr_err("%s: %s, changes are left in it.\n", info->snapshot, strerror(errno));
+	} else {
+		unlink(info->snapshot);
+	}
+	free(info->snapshot);
+	info->snapshot = NULL;
+}
+
+/**
+ * discard_range - Tell device that region is no longer used
+ * @index:         Start bytes
+ * @len:           Length of the region
+ * @blkdev:        device is block device (true), or image file (false)
+ *
+ * @return          0 (success)
+ *                 -1 (failed to discard)
+ */
+static int discard_range(off_t index, size_t len, bool blkdev)
+{
+	uint64_t range[2] = {info->volume_offset + index, len};
+
+	account_syscall(true);
+	info->unsynced = true;
+	if (blkdev)
+		return ioctl(info->fd, BLKDISCARD, range);
+	return fallocate(info->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			info->volume_offset + index, len);
+}
+
+/**
+ * discard_flush - Issue all extents in batch
+ * @b:             discard batch
+ *
+ * @return          0 (success)
+ *                 -1 (failed to discard)
+ */
+static int discard_flush(struct discard_batch *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->num; i++) {
+		if (discard_range(b->extent[i].start, b->extent[i].end - b->extent[i].start, b->blkdev)) {
+			pr_err("discard: %s\n", strerror(errno));
+			return -1;
+		}
+		b->bytes += b->extent[i].end - b->extent[i].start;
+	}
+	b->num = 0;
+	return 0;
+}
+
+/**
+ * discard_add - Add clusters to batch
+ * @b:           discard batch
+ * @clu:         first cluster index
+ * @len:         number of clusters
+ *
+ * @return        0 (success)
+ *               -1 (failed to discard)
+ *
+ * NOTE: Extent next to the last one is merged, and batch is issued when it is full.
+ */
+static int discard_add(struct discard_batch *b, uint32_t clu, uint32_t len)
+{
+	off_t start = info->heap_offset * info->sector_size + (off_t)(clu - 2) * info->cluster_size;
+	off_t end = start + (off_t)len * info->cluster_size;
+
+	if (b->num && b->extent[b->num - 1].end == start) {
+		b->extent[b->num - 1].end = end;
+		return 0;
+	}
+
+	if (b->num == DISCARD_BATCH && discard_flush(b))
+		return -1;
+
+	b->extent[b->num].start = start;
+	b->extent[b->num].end = end;
+	b->num++;
+	return 0;
+}
+
+/**
+ * discard_zero - Add used clusters which are entirely zero to batch
+ * @b:            discard batch
+ * @clu:          first cluster index
+ * @len:          number of clusters
+ *
+ * @return         0 (success)
+ *                -1 (failed)
+ */
+static int discard_zero(struct discard_batch *b, uint32_t clu, uint32_t len)
+{
+	int ret = 0;
+	off_t heap_start = info->heap_offset * info->sector_size;
+	void *data, *zero;
+	uint32_t i;
+
+	data = alloc_cluster();
+	zero = calloc(1, info->cluster_size);
+	if (!data || !zero) {
+		ret = -1;
+		goto out;
+	}
+
+	for (i = clu; i < clu + len; i++) {
+		/* Hole is already sparse */
+		if (is_hole(heap_start + (off_t)(i - 2) * info->cluster_size, info->cluster_size))
+			continue;
+
+		if (get_cluster(data, i) || memcmp(data, zero, info->cluster_size))
+			continue;
+
+		if ((ret = discard_add(b, i, 1)))
+			break;
+	}
+
+out:
+	free(zero);
+	free_cluster(data);
+	return ret;
+}
+
+/**
+ * discard_clusters - Discard clusters which don't have any data
+ * @sparsify:         only image file is accepted, and it is always punched
+ * @zero:             also discard used clusters which are entirely zero
+ * @count:            number of discarded clusters (Output)
+ *
+ * @return             0 (success)
+ *                    -1 (failed)
+ *
+ * NOTE: Free clusters in a row are discarded at once, and extents are
+ *       issued by DISCARD_BATCH.
+ *       Block device is discarded by BLKDISCARD, and image file is punched.
+ */
+static int discard_clusters(bool sparsify, bool zero, uint32_t *count)
+{
+	int ret = 0;
+	struct stat s;
+	struct discard_batch b = {0};
+	uint32_t clu = 2, next = 2, len;
+
+	*count = 0;
+	if ((info->attr & OPTION_READONLY) || info->overlay || info->journal || info->zimage) {
+		pr_err("Clusters can't be discarded with -r, --overlay, --journal or compressed image.\n");
+		return -1;
+	}
+
+	if (fstat(info->fd, &s) < 0) {
+		pr_err("stat: %s\n", strerror(errno));
+		return -1;
+	}
+	b.blkdev = S_ISBLK(s.st_mode);
+	if (sparsify && !S_ISREG(s.st_mode)) {
+		pr_err("Only image file can be sparsified.\n");
+		return -1;
+	}
+
+	/* Freed cluster may still have dirty data in cache */
+	if (flush_cache())
+		return -1;
+
+	while (!ret) {
+		if (info->ops->freerun(&clu, &len)) {
+			/* Used clusters until the end of volume */
+			clu = MAX(info->cluster_count, next);
+			len = 0;
+		}
+
+		if (zero && clu > next)
+			ret = discard_zero(&b, next, clu - next);
+		if (!ret && len)
+			ret = discard_add(&b, clu, len);
+		if (!len)
+			break;
+
+		next = clu += len;
+	}
+
+	if (!ret)
+		ret = discard_flush(&b);
+	*count = b.bytes / info->cluster_size;
+
+	/* Cache may have the data before discard */
+	discard_cache();
+	if (!b.blkdev)
+		reset_hole_map();
+	return ret;
+}
+
+/**
+ * discard_free - Discard all free clusters
+ * @count:        number of discarded clusters (Output)
+ *
+ * @return         0 (success)
+ *                -1 (failed)
+ */
+int discard_free(uint32_t *count)
+{
+	return discard_clusters(false, false, count);
+}
+
+/**
+ * sparsify_image - Punch holes in clusters which don't have any data
+ * @zero:           also punch used clusters which are entirely zero
+ * @count:          number of punched clusters (Output)
+ *
+ * @return           0 (success)
+ *                  -1 (failed)
+ */
+int sparsify_image(bool zero, uint32_t *count)
+{
+	return discard_clusters(true, zero, count);
+}
+
+/* Clusters listed by metadata_add() */
+static __thread struct {
+	uint32_t *clu;
+	size_t num;
+	size_t size;
+} metadata_list;
+
+/**
+ * metadata_add - Add clusters in a row to metadata list
+ * @clu:          first cluster index
+ * @len:          The number of clusters
+ *
+ * @return         0 (success)
+ *                -1 (failed to allocate)
+ *
+ * NOTE: Cluster out of the volume is ignored (e.g. broken directory entry).
+ */
+static int metadata_add(uint32_t clu, size_t len)
+{
+	uint32_t *tmp;
+	size_t size;
+
+	for (; len; clu++, len--) {
+		if (clu < 2 || clu >= info->cluster_count + 2)
+			continue;
+
+		if (metadata_list.num == metadata_list.size) {
+			size = metadata_list.size ? metadata_list.size * 2 : 1024;
+			if (!(tmp = realloc(metadata_list.clu, size * sizeof(uint32_t))))
+				return -1;
+			metadata_list.clu = tmp;
+			metadata_list.size = size;
+		}
+		metadata_list.clu[metadata_list.num++] = clu;
+	}
+	return 0;
+}
+
+/**
+ * compare_cluster - Compare cluster index for qsort()
+ * @a:               cluster index
+ * @b:               cluster index
+ *
+ * @return           difference
+ */
+static int compare_cluster(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * read_zero - Fill zero as base of capture
+ * @data:      buffer (Output)
+ * @index:     Start bytes
+ * @len:       read length
+ *
+ * @return     0 (success)
+ */
+static int read_zero(void *data, off_t index, size_t len)
+{
+	memset(data, 0, len);
+	return 0;
+}
+
+/**
+ * capture_region - Copy region of volume to capture
+ * @o:              capture
+ * @buf:            buffer (CAPTURE_CHUNK bytes)
+ * @start:          Start bytes
+ * @end:            End bytes
+ *
+ * @return           0 (success)
+ *                  -1 (failed to read or write)
+ */
+static int capture_region(struct overlay *o, void *buf, off_t start, off_t end)
+{
+	size_t len;
+
+	if (end > info->total_size)
+		end = info->total_size;
+
+	for (; start < end; start += len) {
+		len = MIN(end - start, CAPTURE_CHUNK);
+		if (read_volume(buf, start, len) ||
+				overlay_write(o, buf, start, len, read_zero))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * capture_metadata - Save only filesystem metadata to file
+ * @path:             capture file path
+ * @size:             bytes of captured region (Output)
+ *
+ * @return             0 (success)
+ *                    -1 (failed)
+ *
+ * NOTE: Boot region (including FAT and root directory in FAT12/16),
+ *       Allocation bitmap, Up-case table and all directories are captured.
+ *       Capture is overlay file format which doesn't have any base volume,
+ *       so region which isn't captured remains hole in sparse file.
+ *       Regions are copied in physical order by OVERLAY_BLOCK_SIZE.
+ */
+int capture_metadata(const char *path, size_t *size)
+{
+	int ret = -1;
+	size_t i;
+	off_t heap_start = (off_t)info->heap_offset * info->sector_size;
+	off_t start, end, next;
+	struct overlay *o = NULL;
+	void *buf = NULL;
+
+	*size = 0;
+	metadata_list.num = 0;
+	if (info->ops->metadata(metadata_add)) {
+		pr_err("Failed to list metadata clusters.\n");
+		goto out;
+	}
+	qsort(metadata_list.clu, metadata_list.num, sizeof(uint32_t), compare_cluster);
+
+	/* Directory data may still be dirty in cache */
+	if (flush_cache())
+		goto out;
+
+	unlink(path);
+	if (!(o = overlay_open(path, info->total_size, false))) {
+		pr_err("%s: %s\n", path, strerror(errno));
+		goto out;
+	}
+	if (!(buf = malloc(CAPTURE_CHUNK)))
+		goto out;
+
+	start = 0;
+	end = ROUNDUP(heap_start, OVERLAY_BLOCK_SIZE) * OVERLAY_BLOCK_SIZE;
+	for (i = 0; i < metadata_list.num; i++) {
+		if (i && metadata_list.clu[i] == metadata_list.clu[i - 1])
+			continue;
+
+		next = heap_start + (off_t)(metadata_list.clu[i] - 2) * info->cluster_size;
+		next = next / OVERLAY_BLOCK_SIZE * OVERLAY_BLOCK_SIZE;
+		if (next > end) {
+			if (capture_region(o, buf, start, end))
+				goto out;
+			*size += end - start;
+			start = next;
+		}
+		end = heap_start + (off_t)(metadata_list.clu[i] - 1) * info->cluster_size;
+		end = ROUNDUP(end, OVERLAY_BLOCK_SIZE) * OVERLAY_BLOCK_SIZE;
+	}
+	if (capture_region(o, buf, start, end))
+		goto out;
+	*size += MIN(end, info->total_size) - start;
+
+	ret = overlay_sync(o);
+out:
+	overlay_close(o);
+	free(buf);
+	free(metadata_list.clu);
+	metadata_list.clu = NULL;
+	metadata_list.size = metadata_list.num = 0;
+	return ret;
+}
+
+/* Image file which capture is expanded to */
+static __thread int expand_fd = -1;
+
+/**
+ * write_expand - Write captured region to expanded image
+ * @data:         Raw data
+ * @index:        Start bytes
+ * @len:          write length
+ *
+ * @return         0 (success)
+ *                -1 (failed to write)
+ *
+ * NOTE: Zero region isn't written, so that it remains hole.
+ */
+static int write_expand(void *data, off_t index, size_t len)
+{
+	unsigned char *p = data;
+
+	if (!len || (!p[0] && !memcmp(p, p + 1, len - 1)))
+		return 0;
+	return pwrite(expand_fd, data, len, index) == len ? 0 : -1;
+}
+
+/**
+ * expand_capture - Expand capture to sparse image of the original size
+ * @path:           image file path
+ *
+ * @return           0 (success)
+ *                  -1 (failed)
+ *
+ * NOTE: Region which isn't captured remains hole (zero) in image.
+ */
+int expand_capture(const char *path)
+{
+	int ret = -1;
+
+	if (!info->capture) {
+		pr_err("%s isn't capture.\n", info->name);
+		return -1;
+	}
+
+	/* Image must contain changes in cache */
+	if (flush_cache())
+		return -1;
+
+	if ((expand_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		pr_err("open: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(expand_fd, info->total_size) ||
+			overlay_merge(info->overlay, write_expand) || fdatasync(expand_fd)) {
+		pr_err("%s: %s\n", path, strerror(errno));
+		goto out;
+	}
+	ret = 0;
+out:
+	close(expand_fd);
+	expand_fd = -1;
+	return ret;
+}
+
+/**
+ * print_sector - print any sector
+ * @sector:       sector index to display
+ *
+ * return:        0 (succeeded in obtaining filesystem)
+ */
+int print_sector(off_t sector)
+{
+	void *data;
+
+	data = alloc_sector();
+	if (!get_sector(data, sector, 1)) {
+		pr_msg("Sector #%ld:\n", sector);
+		hexdump(data, info->sector_size);
+	}
+	free_sector(data);
+	return 0;
+}
+
+/**
+ * print_cluster - print any cluster
+ * @index:         cluster index to display
+ *
+ * @return        0 (success)
+ */
+int print_cluster(uint32_t index)
+{
+	void *data;
+
+	data = alloc_cluster();
+	if (!get_cluster(data, index)) {
+		pr_msg("Cluster #%u:\n", index);
+		hexdump(data, info->cluster_size);
+		advise_access((info->heap_offset * info->sector_size) + (index - 2) * info->cluster_size,
+				info->cluster_size, ACCESS_ONCE);
+	}
+	free_cluster(data);
+	return 0;
+}
+
+
+/**
+ * volume_select - Select volume which the calling thread accesses
+ * @v:             volume (NULL is none)
+ *
+ * @return         volume which was selected before
+ *
+ * NOTE: Output of the thread is also switched to output of @v.
+ */
+struct volume *volume_select(struct volume *v)
+{
+	struct volume *prev = selected;
+
+	selected = v;
+	info = v ? &v->info : NULL;
+	if (v)
+		output = v->output;
+	return prev;
+}
+
+/**
+ * volume_open - Open device as new volume, and select it
+ * @path:        device path
+ * @attr:        command line options
+ * @opt:         how to access the device (NULL is default)
+ *
+ * @return       volume
+ *               NULL (failed to open)
+ *
+ * NOTE: Filesystem isn't loaded until volume_load(),
+ *       so that rollback, restore and expand can be done before it.
+ */
+struct volume *volume_open(const char *path, uint32_t attr, const struct volume_options *opt)
+{
+	struct volume *v, *prev;
+	const struct volume_options none = {0};
+
+	if (!opt)
+		opt = &none;
+
+	if (!(v = calloc(1, sizeof(struct volume))))
+		return NULL;
+
+	v->output = opt->output ? opt->output : stdout;
+	prev = volume_select(v);
+
+	init_device_info();
+	info->attr = attr;
+	info->durability = opt->durability;
+	strncpy(info->name, path, sizeof(info->name) - 1);
+	if (get_device_info(attr, opt->partition, opt->offset, opt->overlay) < 0) {
+		/* Nothing has been accessed yet */
+		info->attr &= ~OPTION_STATS;
+		goto err;
+	}
+
+	if ((attr & OPTION_TRACE) && !(info->trace = trace_open(opt->trace))) {
+		pr_err("open: %s\n", strerror(errno));
+		goto err;
+	}
+
+	/* Journal: --journal, --rollback option */
+	if (attr & (OPTION_JOURNAL | OPTION_ROLLBACK)) {
+		if ((attr & OPTION_READONLY) || ((attr & OPTION_JOURNAL) && (attr & OPTION_ROLLBACK))) {
+			pr_err("--journal and --rollback can't be used with -r, or each other.\n");
+			goto err;
+		}
+		if (!(info->journal = journal_open(opt->journal, info->total_size, attr & OPTION_JOURNAL))) {
+			pr_err("%s: %s\n", opt->journal,
+					errno == EINVAL ? "journal is recorded for another volume" : strerror(errno));
+			goto err;
+		}
+	}
+	return v;
+
+err:
+	volume_close(v);
+	volume_select(prev);
+	return NULL;
+}
+
+/**
+ * volume_load - Load filesystem in volume, and select it
+ * @v:           volume
+ *
+ * @return        0 (success)
+ *               -1 (failed to load)
+ */
+int volume_load(struct volume *v)
+{
+	struct pseudo_bootsec bootsec;
+
+	volume_select(v);
+	trace_op(info->trace, "load");
+	if (pseudo_check_filesystem(&bootsec) < 0)
+		return -1;
+	trace_layout(info->trace, info->heap_offset * info->sector_size, info->sector_size);
+
+	/* Most of accesses are cluster chain walk */
+	advise_access(0, 0, ACCESS_RANDOM);
+	return 0;
+}
+
+/**
+ * volume_close - Write back and close volume
+ * @v:            volume
+ *
+ * NOTE: Volume is deselected if the calling thread selects it.
+ */
+void volume_close(struct volume *v)
+{
+	struct volume *prev;
+	off_t map_offset;
+
+	if (!v)
+		return;
+
+	prev = volume_select(v);
+	trace_op(info->trace, "close");
+	sync_volume(DURABILITY_SESSION);
+	uring_exit(info->uring);
+	release_cache();
+	journal_close(info->journal);
+	release_snapshot();
+	overlay_close(info->overlay);
+	release_pool();
+	trace_close(info->trace);
+	if (info->attr & OPTION_STATS) {
+		pr_msg("I/O statistics:\n");
+		print_iostat(IOSTAT_SESSION);
+	}
+	reset_iostat(IOSTAT_SESSION);
+	reset_iostat(IOSTAT_COMMAND);
+	if (info->map) {
+		map_offset = info->volume_offset % sysconf(_SC_PAGESIZE);
+		munmap(info->map - map_offset, info->total_size + map_offset);
+	}
+	free(info->holes);
+	zimage_close(info->zimage);
+	if (info->fd >= 0)
+		close(info->fd);
+
+	free(info->vol_label);
+	free(info->upcase_table);
+	free(info->alloc_table);
+	free_dentry_list();
+
+	volume_select(prev == v ? NULL : prev);
+	free(v);
+}
+
+/**
+ * volume_root - Get first cluster of root directory
+ * @v:           volume (loaded)
+ *
+ * @return       cluster index (0 is FAT12/16 root directory region)
+ */
+uint32_t volume_root(struct volume *v)
+{
+	volume_select(v);
+	return info->root_offset;
+}
+
+/**
+ * volume_statfs - Print boot sector of volume
+ * @v:             volume (loaded)
+ *
+ * @return          0 (success)
+ *                 -1 (failed)
+ */
+int volume_statfs(struct volume *v)
+{
+	volume_select(v);
+	return info->ops->statfs();
+}
+
+/**
+ * volume_info - Print filesystem information of volume
+ * @v:           volume (loaded)
+ *
+ * @return        0 (success)
+ *               -1 (failed)
+ */
+int volume_info(struct volume *v)
+{
+	volume_select(v);
+	return info->ops->info();
+}
+
+/**
+ * volume_lookup - Find directory in volume
+ * @v:             volume (loaded)
+ * @clu:           first cluster of the starting directory
+ * @path:          directory path
+ *
+ * @return         first cluster of the directory
+ *                 -1 (not found)
+ */
+int volume_lookup(struct volume *v, uint32_t clu, char *path)
+{
+	volume_select(v);
+	return info->ops->lookup(clu, path);
+}
+
+/**
+ * volume_readdir - Read entries of directory in volume
+ * @v:              volume (loaded)
+ * @dirs:           directory entries (Output)
+ * @count:          The number of @dirs
+ * @clu:            first cluster of the directory
+ *
+ * @return          The number of entries
+ *                  negative (@count is short by the absolute value)
+ *
+ * NOTE: Names in @dirs are allocated, and must be released by caller.
+ */
+int volume_readdir(struct volume *v, struct directory *dirs, size_t count, uint32_t clu)
+{
+	volume_select(v);
+	return info->ops->readdir(dirs, count, clu);
+}
+
+/**
+ * volume_stat - Print file status in volume
+ * @v:           volume (loaded)
+ * @name:        file name
+ * @clu:         first cluster of the parent directory
+ *
+ * @return        0 (success)
+ *               -1 (not found)
+ */
+int volume_stat(struct volume *v, const char *name, uint32_t clu)
+{
+	volume_select(v);
+	return info->ops->stat(name, clu);
+}
+
+/**
+ * volume_print_cluster - Print any cluster of volume
+ * @v:                    volume (loaded)
+ * @index:                cluster index to display
+ *
+ * @return                0 (success)
+ */
+int volume_print_cluster(struct volume *v, uint32_t index)
+{
+	volume_select(v);
+	return print_cluster(index);
+}
+
+/**
+ * volume_print_sector - Print any sector of volume
+ * @v:                   volume (loaded)
+ * @sector:              sector index to display
+ *
+ * @return               0 (success)
+ */
+int volume_print_sector(struct volume *v, off_t sector)
+{
+	volume_select(v);
+	return print_sector(sector);
+}
+
+/**
+ * volume_getfat - Get FAT entry of volume
+ * @v:             volume (loaded)
+ * @index:         cluster index
+ * @entry:         FAT entry (Output)
+ *
+ * @return          0 (success)
+ *                 -1 (invalid cluster)
+ */
+int volume_getfat(struct volume *v, uint32_t index, uint32_t *entry)
+{
+	volume_select(v);
+	return info->ops->getfat(index, entry);
+}
+
+/**
+ * volume_convert - Convert characters by up-case table of volume
+ * @v:              volume (loaded)
+ * @src:            characters in UTF-8
+ * @len:            length of @src
+ * @dist:           converted characters (Output)
+ *
+ * @return           0 (success)
+ *                  -1 (failed to convert)
+ *
+ * NOTE: @dist needs MAX_NAME_LENGTH + 1 bytes.
+ */
+int volume_convert(struct volume *v, const char *src, size_t len, char *dist)
+{
+	volume_select(v);
+	return info->ops->convert(src, len, dist);
+}
+
+/**
+ * volume_shell - Operate volume by interactive mode
+ * @v:            volume (loaded)
+ *
+ * @return        0
+ */
+int volume_shell(struct volume *v)
+{
+	volume_select(v);
+	return shell();
+}
+
+/**
+ * volume_serve - Accept commands of interactive mode for volume from UNIX domain socket
+ * @v:            volume (loaded)
+ * @path:         socket path
+ *
+ * @return         0 (stopped by SIGINT or SIGTERM)
+ *                -1 (failed to start)
+ */
+int volume_serve(struct volume *v, const char *path)
+{
+	volume_select(v);
+	return serve(path);
+}
+
+/**
+ * volume_rollback - Restore device of volume by journal
+ * @v:               volume (opened with OPTION_ROLLBACK)
+ *
+ * @return            0 (success)
+ *                   -1 (failed to restore)
+ */
+int volume_rollback(struct volume *v)
+{
+	volume_select(v);
+	return rollback_journal();
+}
+
+/**
+ * volume_snapshot - Save image of volume to file
+ * @v:               volume
+ * @name:            snapshot file
+ *
+ * @return            0 (success)
+ *                   -1 (failed to save)
+ */
+int volume_snapshot(struct volume *v, const char *name)
+{
+	volume_select(v);
+	return take_snapshot(name);
+}
+
+/**
+ * volume_restore - Replace image of volume with snapshot
+ * @v:              volume
+ * @name:           snapshot file
+ *
+ * @return           0 (success)
+ *                  -1 (failed to restore)
+ */
+int volume_restore(struct volume *v, const char *name)
+{
+	volume_select(v);
+	return restore_snapshot(name);
+}
+
+/**
+ * volume_expand - Expand capture to sparse image
+ * @v:             volume (device is capture)
+ * @path:          image file
+ *
+ * @return          0 (success)
+ *                 -1 (failed to expand)
+ */
+int volume_expand(struct volume *v, const char *path)
+{
+	volume_select(v);
+	return expand_capture(path);
+}
+
+/**
+ * volume_discard - Discard free clusters of volume
+ * @v:              volume (loaded)
+ * @count:          The number of discarded clusters (Output)
+ *
+ * @return           0 (success)
+ *                  -1 (failed to discard)
+ */
+int volume_discard(struct volume *v, uint32_t *count)
+{
+	volume_select(v);
+	return discard_free(count);
+}
+
+/**
+ * volume_sparsify - Punch holes in free clusters of volume
+ * @v:               volume (loaded)
+ * @zero:            also punch zero-filled clusters (non-zero)
+ * @count:           The number of punched clusters (Output)
+ *
+ * @return            0 (success)
+ *                   -1 (failed to sparsify)
+ */
+int volume_sparsify(struct volume *v, int zero, uint32_t *count)
+{
+	volume_select(v);
+	return sparsify_image(zero, count);
+}
+
+/**
+ * volume_capture - Save only filesystem metadata of volume to file
+ * @v:              volume (loaded)
+ * @path:           capture file
+ * @size:           The number of captured bytes (Output)
+ *
+ * @return           0 (success)
+ *                  -1 (failed to capture)
+ */
+int volume_capture(struct volume *v, const char *path, size_t *size)
+{
+	volume_select(v);
+	return capture_metadata(path, size);
+}
+
+/**
+ * volume_trace - Tag following accesses to volume with operation name
+ * @v:            volume
+ * @op:           operation name
+ *
+ * NOTE: Nothing is recorded if volume isn't opened with OPTION_TRACE.
+ */
+void volume_trace(struct volume *v, const char *op)
+{
+	volume_select(v);
+	trace_op(info->trace, op);
+}
@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "zimage.h"
+
+/**
+ * get_le32 - Get little endian 32bit value
+ * @p:        byte sequence
+ *
+ * @return    value
+ */
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * zimage_probe - Check whether file is seekable zstd image
+ * @fd:           file descriptor
+ * @size:         file size
+ *
+ * @return        true (file has seek table footer)
+ */
+bool zimage_probe(int fd, off_t size)
+{
+	uint8_t footer[ZIMAGE_FOOTER_SIZE];
+
+	if (size < ZIMAGE_FOOTER_SIZE ||
+			pread(fd, footer, ZIMAGE_FOOTER_SIZE, size - ZIMAGE_FOOTER_SIZE) != ZIMAGE_FOOTER_SIZE)
+		return false;
+
+	return get_le32(footer + 5) == ZIMAGE_SEEKABLE_MAGIC;
+}
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#include <zstd.h>
+
+struct zframe {
+	off_t c_offset;
+	off_t d_offset;
+	uint32_t c_size;
+	uint32_t d_size;
+};
+
+struct zimage {
+	int fd;
+	size_t num;
+	size_t size;
+	struct zframe *frames;
+	ZSTD_DCtx *dctx;
+	void *cbuf;
+	size_t cbuf_size;
+	/* Decompressed frame cache */
+	size_t cached[ZIMAGE_CACHE_FRAMES];
+	uint64_t used[ZIMAGE_CACHE_FRAMES];
+	void *dbuf[ZIMAGE_CACHE_FRAMES];
+	uint64_t clock;
+};
+
+/**
+ * zimage_open - Open seekable zstd image
+ * @fd:          file descriptor
+ * @size:        file size
+ *
+ * @return       compressed image
+ *               NULL (broken image, or failed to allocate)
+ */
+struct zimage *zimage_open(int fd, off_t size)
+{
+	size_t i, entry_size, table_size;
+	size_t d_max = 0;
+	uint8_t footer[ZIMAGE_FOOTER_SIZE];
+	uint8_t *table = NULL;
+	off_t c_offset = 0, d_offset = 0;
+	struct zimage *z;
+
+	if (pread(fd, footer, ZIMAGE_FOOTER_SIZE, size - ZIMAGE_FOOTER_SIZE) != ZIMAGE_FOOTER_SIZE)
+		return NULL;
+
+	if (!(z = calloc(1, sizeof(struct zimage))))
+		return NULL;
+	z->fd = fd;
+	z->num = get_le32(footer);
+	entry_size = (footer[4] & ZIMAGE_CHECKSUM_FLAG) ? 12 : 8;
+	table_size = z->num * entry_size + ZIMAGE_FOOTER_SIZE;
+
+	/* Seek table is wrapped by skippable frame header */
+	if (table_size + 8 > size || !(table = malloc(table_size + 8)) ||
+			pread(fd, table, table_size + 8, size - table_size - 8) != table_size + 8 ||
+			get_le32(table) != ZIMAGE_SKIPPABLE_MAGIC || get_le32(table + 4) != table_size)
+		goto err;
+
+	if (!(z->frames = calloc(z->num, sizeof(struct zframe))))
+		goto err;
+
+	for (i = 0; i < z->num; i++) {
+		z->frames[i].c_offset = c_offset;
+		z->frames[i].d_offset = d_offset;
+		z->frames[i].c_size = get_le32(table + 8 + i * entry_size);
+		z->frames[i].d_size = get_le32(table + 8 + i * entry_size + 4);
+		c_offset += z->frames[i].c_size;
+		d_offset += z->frames[i].d_size;
+		if (z->frames[i].c_size > z->cbuf_size)
+			z->cbuf_size = z->frames[i].c_size;
+		if (z->frames[i].d_size > d_max)
+			d_max = z->frames[i].d_size;
+	}
+	z->size = d_offset;
+
+	if (c_offset + table_size + 8 > size || !(z->dctx = ZSTD_createDCtx()) ||
+			!(z->cbuf = malloc(z->cbuf_size)))
+		goto err;
+
+	for (i = 0; i < ZIMAGE_CACHE_FRAMES; i++) {
+		z->cached[i] = z->num;
+		if (!(z->dbuf[i] = malloc(d_max ? d_max : 1)))
+			goto err;
+	}
+
+	free(table);
+	return z;
+
+err:
+	free(table);
+	zimage_close(z);
+	return NULL;
+}
+
+/**
+ * zimage_close - Close seekable zstd image
+ * @z:            compressed image
+ */
+void zimage_close(struct zimage *z)
+{
+	size_t i;
+
+	if (!z)
+		return;
+
+	for (i = 0; i < ZIMAGE_CACHE_FRAMES; i++)
+		free(z->dbuf[i]);
+	free(z->cbuf);
+	ZSTD_freeDCtx(z->dctx);
+	free(z->frames);
+	free(z);
+}
+
+/**
+ * zimage_size - Get decompressed size
+ * @z:           compressed image
+ *
+ * @return       bytes
+ */
+size_t zimage_size(struct zimage *z)
+{
+	return z->size;
+}
+
+/**
+ * zimage_find_frame - Search frame which contains any byte
+ * @z:                 compressed image
+ * @offset:            decompressed byte offset
+ *
+ * @return             frame index
+ */
+static size_t zimage_find_frame(struct zimage *z, off_t offset)
+{
+	size_t low = 0, high = z->num, mid;
+
+	while (high - low > 1) {
+		mid = (low + high) / 2;
+		if (offset < z->frames[mid].d_offset)
+			high = mid;
+		else
+			low = mid;
+	}
+	return low;
+}
+
+/**
+ * zimage_get_frame - Get decompressed frame
+ * @z:                compressed image
+ * @index:            frame index
+ *
+ * @return            decompressed data
+ *                    NULL (failed to decompress)
+ *
+ * NOTE: The least recently used frame is evicted from frame cache.
+ */
+static void *zimage_get_frame(struct zimage *z, size_t index)
+{
+	size_t i, victim = 0;
+	size_t ret;
+	struct zframe *f = &z->frames[index];
+
+	for (i = 0; i < ZIMAGE_CACHE_FRAMES; i++) {
+		if (z->cached[i] == index) {
+			z->used[i] = ++z->clock;
+			return z->dbuf[i];
+		}
+		if (z->used[i] < z->used[victim])
+			victim = i;
+	}
+
+	z->cached[victim] = z->num;
+	if (pread(z->fd, z->cbuf, f->c_size, f->c_offset) != f->c_size)
+		return NULL;
+
+	ret = ZSTD_decompressDCtx(z->dctx, z->dbuf[victim], f->d_size, z->cbuf, f->c_size);
+	if (ZSTD_isError(ret) || ret != f->d_size) {
+		errno = EIO;
+		return NULL;
+	}
+
+	z->cached[victim] = index;
+	z->used[victim] = ++z->clock;
+	return z->dbuf[victim];
+}
+
+/**
+ * zimage_read - Read decompressed data
+ * @z:           compressed image
+ * @data:        buffer (Output)
+ * @offset:      Start bytes
+ * @len:         read length
+ *
+ * @return        0 (success)
+ *               -1 (failed to decompress)
+ *
+ * NOTE: Beyond the end of image is treated as zero.
+ */
+int zimage_read(struct zimage *z, void *data, off_t offset, size_t len)
+{
+	size_t index, copy;
+	void *frame;
+	struct zframe *f;
+
+	while (len && offset < z->size) {
+		index = zimage_find_frame(z, offset);
+		f = &z->frames[index];
+		if (!(frame = zimage_get_frame(z, index)))
+			return -1;
+
+		copy = f->d_offset + f->d_size - offset;
+		if (copy > len)
+			copy = len;
+		memcpy(data, frame + (offset - f->d_offset), copy);
+		data += copy;
+		offset += copy;
+		len -= copy;
+	}
+
+	memset(data, 0, len);
+	return 0;
+}
+
+#else
+
+struct zimage *zimage_open(int fd, off_t size)
+{
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void zimage_close(struct zimage *z)
+{
+}
+
+size_t zimage_size(struct zimage *z)
+{
+	return 0;
+}
+
+int zimage_read(struct zimage *z, void *data, off_t offset, size_t len)
+{
+	return -1;
+}
+
+#endif /* HAVE_ZSTD_H && HAVE_LIBZSTD */
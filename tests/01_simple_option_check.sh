@@ -7,6 +7,10 @@ source tests/common.sh
 
 IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
 OUTPUT=data.dat
+OVERLAY=overlay.dat
+JOURNAL=journal.dat
+SNAPSHOT=snapshot.dat
+CAPTURE=capture.dat
 
 function test_options () {
 	./debugfatfs $1
@@ -19,6 +23,27 @@ function test_options () {
 	./debugfatfs -r $1
 	./debugfatfs -u a $1
 	./debugfatfs -v $1
+	./debugfatfs --direct $1
+	./debugfatfs --stats $1
+	./debugfatfs --trace $OUTPUT $1
+	./debugfatfs --offset 0 $1
+	./debugfatfs --overlay $OVERLAY $1
+	rm -f $OVERLAY
+	./debugfatfs --journal $JOURNAL $1
+	./debugfatfs --rollback $JOURNAL $1
+	rm -f $JOURNAL
+	./debugfatfs --snapshot $SNAPSHOT $1
+	if [ -e $SNAPSHOT ]; then
+		./debugfatfs --restore $SNAPSHOT $1
+	fi
+	rm -f $SNAPSHOT
+	./debugfatfs --discard-free $1
+	./debugfatfs --sparsify $1
+	./debugfatfs --durability=session $1
+	echo $1 | ./debugfatfs --batch - --jobs 1
+	./debugfatfs --capture $CAPTURE $1
+	./debugfatfs --expand $OUTPUT $CAPTURE
+	rm -f $CAPTURE
 	./debugfatfs --help
 	./debugfatfs --version
 }
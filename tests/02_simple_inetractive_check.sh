@@ -36,6 +36,10 @@ function test_shell () {
 	expect \"/> \"
 	send \"ls\n\"
 	expect \"/> \"
+	send \"iostat\n\"
+	expect \"/> \"
+	send \"iostat reset\n\"
+	expect \"/> \"
 	send \"exit\n\"
 	expect eof
 	exit
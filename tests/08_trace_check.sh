@@ -0,0 +1,32 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+TRACE=trace.dat
+
+function test_trace () {
+	./debugfatfs --trace $TRACE -a $1
+	./debugfatfs-trace $TRACE
+	./debugfatfs-trace -o -p lru -s 64K -s 1M $TRACE
+	./debugfatfs-trace -p arc -b 4K $TRACE
+	./debugfatfs-trace -p pin -s 4M $TRACE
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_trace ${fs}
+	done
+
+	# Invalid trace file must be rejected
+	./debugfatfs-trace README.md && exit 1
+	rm -f $TRACE
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,73 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+# Large images take too long to be split into frames by shell
+IMAGES=("fat12.img" "fat16.img")
+FRAME_SIZE=262144
+WORKDIR=zimage.d
+
+# print 32bit value as little endian binary
+function le32 () {
+	printf "\\x$(printf %02x $(($1 & 0xff)))\\x$(printf %02x $((($1 >> 8) & 0xff)))"
+	printf "\\x$(printf %02x $((($1 >> 16) & 0xff)))\\x$(printf %02x $((($1 >> 24) & 0xff)))"
+}
+
+# compress image into seekable zstd format
+function compress_image () {
+	local num=0
+	local table=${WORKDIR}/table
+
+	rm -rf ${WORKDIR} && mkdir ${WORKDIR}
+	split -b ${FRAME_SIZE} -d -a 6 $1 ${WORKDIR}/chunk.
+	: > $2
+	: > ${table}
+	for chunk in ${WORKDIR}/chunk.*; do
+		zstd -q -c ${chunk} > ${chunk}.zst
+		cat ${chunk}.zst >> $2
+		le32 $(stat -c %s ${chunk}.zst) >> ${table}
+		le32 $(stat -c %s ${chunk}) >> ${table}
+		num=$((num + 1))
+	done
+
+	le32 0x184D2A5E >> $2
+	le32 $((num * 8 + 9)) >> $2
+	cat ${table} >> $2
+	le32 ${num} >> $2
+	printf "\\x00" >> $2
+	le32 0x8F92EAB1 >> $2
+	rm -rf ${WORKDIR}
+}
+
+function test_compressed () {
+	compress_image $1 $1.zst
+
+	# Only read-only mode is allowed
+	./debugfatfs $1.zst && exit 1
+
+	local out=$(./debugfatfs -r $1.zst 2>&1 || true)
+	if grep -q "isn't supported" <<< "${out}"; then
+		echo "debugfatfs doesn't support compressed image."
+		rm -f $1.zst
+		exit 77
+	fi
+
+	diff <(./debugfatfs -r -a $1) <(./debugfatfs -r -a $1.zst)
+	diff <(./debugfatfs -r -c 4 $1) <(./debugfatfs -r -c 4 $1.zst)
+	rm -f $1.zst
+}
+
+function main() {
+	which zstd > /dev/null || exit 77
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_compressed ${fs}
+	done
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+MBR_DISK=mbr_disk.img
+GPT_DISK=gpt_disk.img
+
+# print 32bit/64bit value as little endian binary
+function le32 () {
+	printf "\\x$(printf %02x $(($1 & 0xff)))\\x$(printf %02x $((($1 >> 8) & 0xff)))"
+	printf "\\x$(printf %02x $((($1 >> 16) & 0xff)))\\x$(printf %02x $((($1 >> 24) & 0xff)))"
+}
+
+function le64 () {
+	le32 $(($1 & 0xffffffff))
+	le32 $(($1 >> 32))
+}
+
+# print MBR entry {type, start LBA, size}
+function mbr_entry () {
+	printf "\\x00\\x00\\x00\\x00\\x$(printf %02x $1)\\x00\\x00\\x00"
+	le32 $2
+	le32 $3
+}
+
+# write bytes from stdin to any sector of disk
+function put_sector () {
+	dd of=$1 bs=512 seek=$2 conv=notrunc status=none
+}
+
+function put_signature () {
+	printf "\\x55\\xaa" | dd of=$1 bs=1 seek=$(($2 * 512 + 510)) conv=notrunc status=none
+}
+
+# P1: fat12, P2: fat16, P3: extended (P5: fat12)
+function create_mbr_disk () {
+	rm -f ${MBR_DISK}
+	truncate -s $((167936 * 512)) ${MBR_DISK}
+	dd if=fat12.img of=${MBR_DISK} bs=512 seek=2048 conv=notrunc,sparse status=none
+	dd if=fat16.img of=${MBR_DISK} bs=512 seek=18432 conv=notrunc,sparse status=none
+	dd if=fat12.img of=${MBR_DISK} bs=512 seek=151552 conv=notrunc,sparse status=none
+
+	(mbr_entry 0x01 2048 16384; mbr_entry 0x06 18432 131072; mbr_entry 0x05 149504 18432) |
+		dd of=${MBR_DISK} bs=1 seek=446 conv=notrunc status=none
+	put_signature ${MBR_DISK} 0
+	mbr_entry 0x01 2048 16384 | dd of=${MBR_DISK} bs=1 seek=$((149504 * 512 + 446)) conv=notrunc status=none
+	put_signature ${MBR_DISK} 149504
+}
+
+# P1: fat16
+function create_gpt_disk () {
+	rm -f ${GPT_DISK}
+	truncate -s $((135168 * 512)) ${GPT_DISK}
+	dd if=fat16.img of=${GPT_DISK} bs=512 seek=2048 conv=notrunc,sparse status=none
+
+	(mbr_entry 0xee 1 135167) | dd of=${GPT_DISK} bs=1 seek=446 conv=notrunc status=none
+	put_signature ${GPT_DISK} 0
+	(printf "EFI PART"; le32 0x00010000; le32 92; le32 0; le32 0; le64 1; le64 135167;
+	 le64 34; le64 135134; le64 0; le64 0; le64 2; le32 128; le32 128; le32 0) | put_sector ${GPT_DISK} 1
+	(le64 0x4433b9e5ebd0a0a2; le64 0xc79926b7b668c087; le64 1; le64 1;
+	 le64 2048; le64 $((2048 + 131072 - 1)); le64 0) | put_sector ${GPT_DISK} 2
+}
+
+# compare filesystem in disk with original image
+function compare_volume () {
+	local disk=$1
+	local image=$2
+	shift 2
+
+	diff <(./debugfatfs -r -a ${image}) <(./debugfatfs -r -a "$@" ${disk})
+	diff <(./debugfatfs -r -c 4 ${image}) <(./debugfatfs -r -c 4 "$@" ${disk})
+	diff <(./debugfatfs -c 4 ${image}) <(./debugfatfs -c 4 "$@" ${disk})
+}
+
+function main() {
+	init_image
+
+	create_mbr_disk
+	compare_volume ${MBR_DISK} fat12.img --partition 1
+	compare_volume ${MBR_DISK} fat16.img --partition 2
+	compare_volume ${MBR_DISK} fat12.img --partition 5
+	compare_volume ${MBR_DISK} fat16.img --offset $((18432 * 512))
+	./debugfatfs -r --partition 3 ${MBR_DISK} && exit 1
+	./debugfatfs -r --partition 6 ${MBR_DISK} && exit 1
+	./debugfatfs -r --partition 1 --offset 0 ${MBR_DISK} && exit 1
+
+	create_gpt_disk
+	compare_volume ${GPT_DISK} fat16.img --partition 1
+	./debugfatfs -r --partition 2 ${GPT_DISK} && exit 1
+	./debugfatfs -r --partition 1 fat16.img && exit 1
+
+	rm -f ${MBR_DISK} ${GPT_DISK}
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+OVERLAY=overlay.dat
+COPY=copy.img
+
+function create_file () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq $*
+	expect \"/> \"
+	send \"create $1\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	sync
+}
+
+function test_overlay () {
+	local hash=$(md5sum $1 | cut -d" " -f 1)
+	local other=fat12.img
+
+	test "$1" = "${other}" && other=fat16.img
+
+	rm -f ${OVERLAY}
+	cp --sparse=always $1 ${COPY}
+
+	# Changes are accumulated in overlay
+	create_file OVERLAY0.TXT --overlay ${OVERLAY} $1
+	create_file OVERLAY1.TXT --overlay ${OVERLAY} $1
+	create_file OVERLAY0.TXT ${COPY}
+	create_file OVERLAY1.TXT ${COPY}
+
+	test "$(md5sum $1 | cut -d" " -f 1)" = "${hash}"
+	diff <(./debugfatfs -r -a ${COPY}) <(./debugfatfs -r -a --overlay ${OVERLAY} $1)
+	diff <(./debugfatfs -a ${COPY}) <(./debugfatfs -a --overlay ${OVERLAY} $1)
+
+	# Overlay for another image must be rejected
+	./debugfatfs -r --overlay ${OVERLAY} ${other} && exit 1
+
+	# Removing overlay resets all changes
+	rm -f ${OVERLAY} ${COPY}
+	diff <(./debugfatfs -r -a $1) <(./debugfatfs -r -a --overlay ${OVERLAY} $1)
+	test ! -e ${OVERLAY}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_overlay ${fs}
+	done
+}
+
+### main function ###
+main "$@"
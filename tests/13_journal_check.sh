@@ -0,0 +1,67 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+JOURNAL=journal.dat
+COPY=copy.img
+
+function modify_image () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq --journal ${JOURNAL} ${3:-} $1
+	expect \"/> \"
+	send \"create JOURNAL0.TXT\n\"
+	expect \"/> \"
+	send \"mkdir JOURNAL1\n\"
+	expect \"/> \"
+	send \"$2\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	sync
+}
+
+function test_journal () {
+	local hash=$(md5sum $1 | cut -d" " -f 1)
+
+	cp --sparse=always $1 ${COPY}
+
+	# Rollback by command line
+	modify_image ${COPY} "ls"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" != "${hash}"
+	./debugfatfs --rollback ${JOURNAL} ${COPY}
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Rollback by shell command
+	modify_image ${COPY} "rollback"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Records aren't aligned to device block with --direct
+	modify_image ${COPY} "rollback" "--direct"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Journal for another image must be rejected
+	if [ "$1" != "fat12.img" ]; then
+		cp --sparse=always fat12.img ${COPY}
+		./debugfatfs --rollback ${JOURNAL} ${COPY} && exit 1
+	fi
+
+	rm -f ${JOURNAL} ${COPY}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_journal ${fs}
+	done
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,80 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+SNAPSHOT=snapshot.dat
+COPY=copy.img
+
+function modify_image () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq ${3:-} $1
+	expect \"/> \"
+	send \"snapshot ${SNAPSHOT}\n\"
+	expect \"/> \"
+	send \"create SNAPSHOT.TXT\n\"
+	expect \"/> \"
+	send \"$2\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	sync
+}
+
+function test_snapshot () {
+	local hash=$(md5sum $1 | cut -d" " -f 1)
+
+	rm -f ${SNAPSHOT}
+	cp --sparse=always $1 ${COPY}
+
+	# Restore by shell command
+	modify_image ${COPY} "restore ${SNAPSHOT}"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Changes after snapshot remain in image
+	modify_image ${COPY} "ls"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" != "${hash}"
+
+	# Snapshot without reflink is removed at the end of session
+	if [ -e ${SNAPSHOT} ]; then
+		./debugfatfs --restore ${SNAPSHOT} ${COPY}
+		test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+	fi
+
+	# Changes after snapshot are written back with --direct or --durability
+	for opt in "--direct" "--durability=session"; do
+		rm -f ${SNAPSHOT}
+		cp --sparse=always $1 ${COPY}
+		modify_image ${COPY} "ls" "${opt}"
+		test "$(md5sum ${COPY} | cut -d" " -f 1)" != "${hash}"
+		if [ -e ${SNAPSHOT} ]; then
+			./debugfatfs --restore ${SNAPSHOT} ${COPY}
+			test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+		fi
+	done
+
+	# Snapshot is still available after sync at each command
+	rm -f ${SNAPSHOT}
+	cp --sparse=always $1 ${COPY}
+	modify_image ${COPY} "restore ${SNAPSHOT}" "--durability=command"
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	rm -f ${SNAPSHOT} ${COPY}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_snapshot ${fs}
+	done
+}
+
+### main function ###
+main "$@"
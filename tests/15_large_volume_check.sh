@@ -0,0 +1,102 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat32.img" "exfat.img")
+COPY=copy.img
+LARGE=large.img
+# exfat.img: FAT is located at sector 2048, and its length is 1088 sectors
+FAT_OFFSET=2048
+FAT_LENGTH=1088
+# FAT in large.img is located beyond 4 GiB
+LARGE_FAT_OFFSET=$((9 * 1024 * 1024))
+LARGE_SECTORS=$((20 * 1024 * 1024))
+
+# print 32bit/64bit value as little endian binary
+function le32 () {
+	printf "\\x$(printf %02x $(($1 & 0xff)))\\x$(printf %02x $((($1 >> 8) & 0xff)))"
+	printf "\\x$(printf %02x $((($1 >> 16) & 0xff)))\\x$(printf %02x $((($1 >> 24) & 0xff)))"
+}
+
+function le64 () {
+	le32 $(($1 & 0xffffffff))
+	le32 $(($1 >> 32))
+}
+
+function run_command () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq $1
+	expect \"/> \"
+	send \"$2\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	"
+	sync
+}
+
+# exfat.img whose FAT is moved to 4.5 GiB of 10 GiB volume
+function create_large_exfat () {
+	rm -f ${LARGE}
+	cp --sparse=always exfat.img ${LARGE}
+	truncate -s $((LARGE_SECTORS * 512)) ${LARGE}
+	dd if=exfat.img of=${LARGE} bs=512 skip=${FAT_OFFSET} seek=${LARGE_FAT_OFFSET} \
+		count=${FAT_LENGTH} conv=notrunc,sparse status=none
+	dd if=/dev/zero of=${LARGE} bs=512 seek=${FAT_OFFSET} count=${FAT_LENGTH} conv=notrunc status=none
+
+	(le64 ${LARGE_SECTORS}; le32 ${LARGE_FAT_OFFSET}) |
+		dd of=${LARGE} bs=1 seek=72 conv=notrunc status=none
+}
+
+# Cluster beyond 16bit index can be accessed
+function test_cluster_count () {
+	cp --sparse=always $1 ${COPY}
+
+	local out
+
+	out=$(./debugfatfs -q -c 70000 ${COPY})
+	grep -q "Cluster #70000" <<< "${out}"
+	out=$(run_command ${COPY} "alloc 70000")
+	grep -q "Alloc: cluster 70000" <<< "${out}"
+
+	rm -f ${COPY}
+}
+
+# FAT beyond 4 GiB can be read and written
+function test_fat_offset () {
+	create_large_exfat
+
+	local out
+
+	# Only FAT location and volume size are different
+	diff <(./debugfatfs -r -a exfat.img | grep -v "FAT offset\|Volume size") \
+		<(./debugfatfs -r -a ${LARGE} | grep -v "FAT offset\|Volume size")
+	run_command ${LARGE} "mkdir LARGEDIR" > /dev/null
+	out=$(run_command ${LARGE} "ls")
+	grep -q "LARGEDIR" <<< "${out}"
+	run_command ${LARGE} "fat 100 c8" > /dev/null
+	out=$(run_command ${LARGE} "fat 100")
+	grep -q "FAT entry 000000c8" <<< "${out}"
+
+	# FAT isn't accessed in the original location
+	cmp -n $((FAT_LENGTH * 512)) <(dd if=${LARGE} bs=512 skip=${FAT_OFFSET} count=${FAT_LENGTH} status=none) /dev/zero
+
+	rm -f ${LARGE}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_cluster_count ${fs}
+	done
+	test_fat_offset
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+# first sector of cluster heap, and sectors per cluster
+declare -A heaps=(
+	["fat12.img"]="48 8"
+	["fat16.img"]="544 2"
+	["fat32.img"]="8192 8"
+	["exfat.img"]="4096 64"
+)
+COPY=copy.img
+OUTPUT=output.txt
+# Cluster #1000 isn't used in all images
+FREE_CLUSTER=1000
+
+function discard_command () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq $1
+	expect \"/> \"
+	send \"discard\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	"
+	sync
+}
+
+# write garbage to free cluster
+function dirty_free_cluster () {
+	local heap=($2)
+
+	dd if=/dev/urandom of=$1 bs=512 seek=$((heap[0] + (FREE_CLUSTER - 2) * heap[1])) \
+		count=${heap[1]} conv=notrunc status=none
+}
+
+function free_cluster_is_zero () {
+	local out=$(./debugfatfs -r -q -c ${FREE_CLUSTER} $1)
+
+	test "$(sed -n 2p <<< "${out}" | cut -c 12-58 | tr -d ' 0')" = ""
+	test "$(sed -n 3p <<< "${out}")" = "*"
+}
+
+function test_discard () {
+	cp --sparse=always $1 ${COPY}
+	./debugfatfs -r -a ${COPY} > ${OUTPUT}
+
+	# Discard by command line
+	dirty_free_cluster ${COPY} "${heaps[$1]}"
+	free_cluster_is_zero ${COPY} && exit 1
+	./debugfatfs --discard-free ${COPY} > /dev/null
+	free_cluster_is_zero ${COPY}
+	diff ${OUTPUT} <(./debugfatfs -r -a ${COPY})
+
+	# Discard by shell command
+	dirty_free_cluster ${COPY} "${heaps[$1]}"
+	discard_command ${COPY} | grep "Discard:" > /dev/null
+	free_cluster_is_zero ${COPY}
+	diff ${OUTPUT} <(./debugfatfs -r -a ${COPY})
+
+	# Discard must not be applied to read-only session
+	./debugfatfs -r --discard-free ${COPY} && exit 1
+
+	rm -f ${COPY} ${OUTPUT}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_discard ${fs}
+	done
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+# first sector of cluster heap, and sectors per cluster
+declare -A heaps=(
+	["fat12.img"]="48 8"
+	["fat16.img"]="544 2"
+	["fat32.img"]="8192 8"
+	["exfat.img"]="4096 64"
+)
+COPY=copy.img
+# Cluster #1000- and #1100- aren't used in all images
+FREE_CLUSTER=1000
+USED_CLUSTER=1100
+# Region is larger than block size of host filesystem
+ZERO_SECTORS=16
+
+function alloc_clusters () {
+	local cmds=""
+
+	for clu in $(seq $2 $(($2 + $3 - 1))); do
+		cmds+="send \"alloc ${clu}\n\"
+	expect \"/> \"
+	"
+	done
+
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq $1
+	expect \"/> \"
+	${cmds}send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	sync
+}
+
+# write zero to clusters, so that they occupy blocks of image
+function write_zero () {
+	local heap=($2)
+
+	dd if=/dev/zero of=$1 bs=512 seek=$((heap[0] + ($3 - 2) * heap[1])) \
+		count=$(($4 * heap[1])) conv=notrunc status=none
+	sync
+}
+
+function blocks () {
+	stat -c %b $1
+}
+
+function test_sparsify () {
+	local heap=(${heaps[$1]})
+	local num=$(((ZERO_SECTORS + heap[1] - 1) / heap[1]))
+	local hash blocks_zero blocks_free
+
+	cp --sparse=always $1 ${COPY}
+	alloc_clusters ${COPY} ${USED_CLUSTER} ${num}
+	write_zero ${COPY} "${heaps[$1]}" ${FREE_CLUSTER} ${num}
+	write_zero ${COPY} "${heaps[$1]}" ${USED_CLUSTER} ${num}
+	hash=$(md5sum ${COPY} | cut -d" " -f 1)
+	blocks_zero=$(blocks ${COPY})
+
+	# Free clusters are punched
+	./debugfatfs --sparsify ${COPY} > /dev/null
+	sync
+	blocks_free=$(blocks ${COPY})
+	test ${blocks_free} -lt ${blocks_zero}
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Used clusters which are entirely zero are also punched
+	./debugfatfs --sparsify=zero ${COPY} > /dev/null
+	sync
+	test $(blocks ${COPY}) -lt ${blocks_free}
+	test "$(md5sum ${COPY} | cut -d" " -f 1)" = "${hash}"
+
+	# Block device and read-only session can't be sparsified
+	./debugfatfs -r --sparsify ${COPY} && exit 1
+
+	rm -f ${COPY}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_sparsify ${fs}
+	done
+}
+
+### main function ###
+main "$@"
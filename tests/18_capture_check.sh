@@ -0,0 +1,56 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+CAPTURE=capture.dat
+BLANK=blank.img
+
+function blocks () {
+	stat -c %b $1
+}
+
+function test_capture () {
+	local hash=$(md5sum $1 | cut -d" " -f 1)
+
+	rm -f ${CAPTURE}
+	./debugfatfs -q --capture ${CAPTURE} $1 > /dev/null
+	test "$(md5sum $1 | cut -d" " -f 1)" = "${hash}"
+
+	# Capture doesn't have file data
+	sync
+	test $(($(blocks ${CAPTURE}) * 16)) -lt $(blocks $1)
+
+	# All directories can be traversed on blank volume with capture
+	truncate -s $(stat -c %s $1) ${BLANK}
+	diff <(./debugfatfs -r -a $1) <(./debugfatfs -r -a --overlay ${CAPTURE} ${BLANK})
+
+	# Capture in interactive mode is the same
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq -r $1
+	expect \"/> \"
+	send \"capture ${CAPTURE}.1\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	cmp ${CAPTURE} ${CAPTURE}.1
+
+	rm -f ${CAPTURE} ${CAPTURE}.1 ${BLANK}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_capture ${fs}
+	done
+}
+
+### main function ###
+main "$@"
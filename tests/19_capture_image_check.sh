@@ -0,0 +1,71 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+CAPTURE=capture.dat
+COPY=copy.img
+EXPAND=expand.img
+# Cluster #1000 isn't used in all images
+FREE_CLUSTER=1000
+
+function create_file () {
+	expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq $2
+	expect \"/> \"
+	send \"create $1\n\"
+	expect \"/> \"
+	send \"exit\n\"
+	expect eof
+	exit
+	" > /dev/null
+	sync
+}
+
+function test_capture_image () {
+	local hash=$(md5sum $1 | cut -d" " -f 1)
+	local out
+
+	rm -f ${CAPTURE}
+	./debugfatfs -q --capture ${CAPTURE} $1 > /dev/null
+	cp --sparse=always $1 ${COPY}
+
+	# Capture is opened as the original image
+	diff <(./debugfatfs -r -a $1) <(./debugfatfs -r -a ${CAPTURE})
+	diff <(./debugfatfs -r -c 2 $1) <(./debugfatfs -r -c 2 ${CAPTURE})
+
+	# Data which isn't captured is filled with pattern
+	out=$(./debugfatfs -r -c ${FREE_CLUSTER} ${CAPTURE})
+	grep -q -- "--NOT-CAPTURED--" <<< "${out}"
+
+	# Changes are written to capture
+	create_file CAPTURE.TXT ${CAPTURE}
+	create_file CAPTURE.TXT ${COPY}
+	diff <(./debugfatfs -r -a ${COPY}) <(./debugfatfs -r -a ${CAPTURE})
+	test "$(md5sum $1 | cut -d" " -f 1)" = "${hash}"
+
+	# Capture is expanded to sparse image of the original size
+	./debugfatfs --expand ${EXPAND} ${CAPTURE}
+	test $(stat -c %s ${EXPAND}) -eq $(stat -c %s $1)
+	diff <(./debugfatfs -r -a ${COPY}) <(./debugfatfs -r -a ${EXPAND})
+
+	# Only capture can be expanded
+	./debugfatfs --expand ${EXPAND} $1 && exit 1
+
+	rm -f ${CAPTURE} ${COPY} ${EXPAND}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_capture_image ${fs}
+	done
+}
+
+### main function ###
+main "$@"
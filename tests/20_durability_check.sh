@@ -0,0 +1,77 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+POLICIES=("none" "session" "command" "write")
+COPY=copy.img
+FILES=3
+
+# print the number of syncs in session
+function create_files () {
+	local cmds=""
+	local out
+
+	for i in $(seq ${FILES}); do
+		cmds+="send \"create SYNC${i}.TXT\n\"
+	expect \"/> \"
+	"
+	done
+
+	out=$(expect -c "
+	set timeout 5
+	spawn ./debugfatfs -iq --stats --durability=$2 $1
+	expect \"/> \"
+	${cmds}send \"exit\n\"
+	expect eof
+	exit
+	")
+	sync
+	# Output through pty ends with CRLF
+	tr -d "\r" <<< "${out}" | grep "^sync" | tail -n 1 | tr -s " " | cut -d" " -f 2
+}
+
+function test_durability () {
+	local expected=""
+	local syncs
+
+	for policy in ${POLICIES[@]}; do
+		cp --sparse=always $1 ${COPY}
+		syncs=$(create_files ${COPY} ${policy})
+
+		# Each boundary issues only one sync
+		case ${policy} in
+			none)
+				test ${syncs} -eq 0 ;;
+			session)
+				test ${syncs} -eq 1 ;;
+			command)
+				test ${syncs} -eq ${FILES} ;;
+			write)
+				test ${syncs} -ge ${FILES} ;;
+		esac
+
+		# Policy doesn't change the result
+		test -z "${expected}" && expected=$(./debugfatfs -r -a ${COPY})
+		test "$(./debugfatfs -r -a ${COPY})" = "${expected}"
+	done
+
+	# Unknown policy is rejected
+	./debugfatfs --durability=always $1 2> /dev/null && exit 1
+
+	rm -f ${COPY}
+}
+
+function main() {
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_durability ${fs}
+	done
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,55 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+LIST=list.txt
+OUTPUT=output.txt
+OUTDIR=outdir
+
+function test_batch () {
+	local i
+
+	printf "%s\n" "${IMAGES[@]}" > ${LIST}
+	for fs in ${IMAGES[@]}; do
+		echo "==> ${fs} <=="
+		./debugfatfs -a ${fs}
+	done > ${OUTPUT}.expected
+
+	# Merged stream keeps the order of list
+	for jobs in 1 2 4; do
+		./debugfatfs --batch ${LIST} --jobs ${jobs} -a > ${OUTPUT}
+		diff ${OUTPUT}.expected ${OUTPUT}
+	done
+	./debugfatfs --batch ${LIST} -a -o ${OUTPUT}
+	diff ${OUTPUT}.expected ${OUTPUT}
+
+	# Per-image output in directory
+	rm -rf ${OUTDIR}
+	mkdir ${OUTDIR}
+	./debugfatfs --batch ${LIST} -a -o ${OUTDIR}
+	for i in ${!IMAGES[@]}; do
+		diff <(./debugfatfs -a ${IMAGES[$i]}) ${OUTDIR}/${i}-${IMAGES[$i]}.txt
+	done
+
+	# Image which failed to analyze is reported
+	printf "%s\n" "fat12.img" "missing.img" > ${LIST}
+	./debugfatfs --batch ${LIST} > ${OUTPUT} && exit 1
+	grep -q "==> missing.img: failed <==" ${OUTPUT}
+
+	# Interactive mode can't be used
+	./debugfatfs --batch ${LIST} -i > /dev/null && exit 1
+
+	rm -rf ${LIST} ${OUTPUT} ${OUTPUT}.expected ${OUTDIR}
+}
+
+function main() {
+	init_image
+	test_batch
+}
+
+### main function ###
+main "$@"
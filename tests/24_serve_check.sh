@@ -0,0 +1,118 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+SOCKET=serve.sock
+EXPECTED=expected.txt
+SERVER_OUT=server.txt
+CLIENTS=8
+
+# Client sends framed requests ("!II" = length, status)
+CLIENT='
+import socket, struct, sys
+
+def connect():
+    s = socket.socket(socket.AF_UNIX)
+    s.connect(sys.argv[1])
+    return s
+
+def recv(s, n):
+    data = b""
+    while len(data) < n:
+        d = s.recv(n - len(data))
+        assert d, "connection is closed"
+        data += d
+    return data
+
+def send(s, cmd):
+    b = cmd.encode()
+    s.sendall(struct.pack("!II", len(b), 0) + b)
+
+def response(s):
+    n, status = struct.unpack("!II", recv(s, 8))
+    return status, recv(s, n).decode()
+
+def request(s, cmd):
+    send(s, cmd)
+    return response(s)
+
+clients = [connect() for i in range(int(sys.argv[3]))]
+
+# Each client has its own current directory
+root = request(clients[0], "ls")
+assert " 00 " in root[1], root
+assert request(clients[0], "cd /00")[0] == 0
+for c in clients[1:]:
+    assert request(c, "ls") == root
+assert " DIR " in request(clients[0], "ls")[1]
+
+# Output is the same as command line
+with open(sys.argv[2]) as f:
+    assert request(clients[1], "cluster 2") == (0, f.read())
+assert "command not found" in request(clients[1], "nosuch")[1]
+assert "too many arguments" in request(clients[1], "cd / /")[1]
+assert "iostat" in request(clients[1], "help")[1]
+
+# Several requests at once
+send(clients[2], "ls")
+send(clients[2], "ls")
+assert response(clients[2]) == root
+assert response(clients[2]) == root
+
+# Session is closed by exit
+assert request(clients[3], "exit")[0] == 1
+assert clients[3].recv(1) == b""
+
+# Client which never reads responses never stalls the others
+clients[4].setblocking(False)
+try:
+    while True:
+        send(clients[4], "cluster 2")
+except BlockingIOError:
+    pass
+clients[5].settimeout(5)
+assert request(clients[5], "ls") == root
+'
+
+function test_serve () {
+	local pid
+
+	rm -f ${SOCKET}
+	./debugfatfs -q -c 2 $1 > ${EXPECTED}
+	./debugfatfs --serve ${SOCKET} $1 > ${SERVER_OUT} &
+	pid=$!
+	for i in $(seq 50); do
+		test -S ${SOCKET} && break
+		sleep 0.1
+	done
+
+	python3 -c "${CLIENT}" ${SOCKET} ${EXPECTED} ${CLIENTS}
+
+	# Server is stopped by signal
+	kill -TERM ${pid}
+	wait ${pid}
+	test ! -e ${SOCKET}
+
+	# Output of commands is sent to client only
+	test ! -s ${SERVER_OUT}
+
+	rm -f ${EXPECTED} ${SERVER_OUT}
+}
+
+function main() {
+	# Client is written in python
+	command -v python3 > /dev/null || exit 77
+
+	init_image
+
+	for fs in ${IMAGES[@]}; do
+		test_serve ${fs}
+	done
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+set -eu -o pipefail
+trap 'echo "ERROR: l.$LINENO, exit status = $?" >&2; exit 1' ERR
+
+source tests/common.sh
+
+IMAGES=("fat12.img" "fat16.img" "fat32.img" "exfat.img")
+COPY=copy.img
+
+function main() {
+	init_image
+
+	# The same image can be opened as another volume
+	cp --sparse=always ${IMAGES[0]} ${COPY}
+
+	# Each volume is analyzed by its own thread in one process
+	./tests/volume_check ${IMAGES[@]} ${COPY}
+
+	for fs in ${IMAGES[@]} ${COPY}; do
+		diff <(./debugfatfs -r -a ${fs}) ${fs}.lib
+		rm -f ${fs}.lib
+	done
+	rm -f ${COPY}
+}
+
+### main function ###
+main "$@"
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (C) 2021 LeavaTail
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "volume.h"
+
+#define OUTPUT_SUFFIX  ".lib"
+#define ROOT_FILES     1024
+
+struct worker {
+	pthread_t thread;
+	struct volume *vol;
+	FILE *out;
+	int ret;
+};
+
+/**
+ * analyze - Print filesystem information of one volume (same as -a)
+ * @arg:     worker
+ *
+ * @return   NULL
+ */
+static void *analyze(void *arg)
+{
+	int i, num;
+	struct worker *w = arg;
+	struct directory dirs[ROOT_FILES];
+
+	if (volume_statfs(w->vol) < 0 || volume_info(w->vol) < 0)
+		w->ret = -1;
+
+	/* Root directory can be read without any output */
+	if ((num = volume_readdir(w->vol, dirs, ROOT_FILES, volume_root(w->vol))) <= 0)
+		w->ret = -1;
+	for (i = 0; i < num; i++)
+		free(dirs[i].name);
+
+	volume_select(NULL);
+	return NULL;
+}
+
+/**
+ * main   - Analyze each image by its own thread in one process
+ * @argc:   argument count
+ * @argv:   images (output is written to IMAGE.lib)
+ */
+int main(int argc, char *argv[])
+{
+	int i, ret = EXIT_SUCCESS;
+	char path[PATH_MAX];
+	struct worker *w;
+	struct volume_options opt = {0};
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s IMAGE...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!(w = calloc(argc - 1, sizeof(struct worker))))
+		return EXIT_FAILURE;
+
+	/* All volumes are opened by one thread */
+	for (i = 0; i < argc - 1; i++) {
+		snprintf(path, sizeof(path), "%s" OUTPUT_SUFFIX, argv[i + 1]);
+		if (!(opt.output = w[i].out = fopen(path, "w"))) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		if (!(w[i].vol = volume_open(argv[i + 1], OPTION_READONLY | OPTION_ALL, &opt)) ||
+				volume_load(w[i].vol)) {
+			fprintf(stderr, "%s: failed to load\n", argv[i + 1]);
+			return EXIT_FAILURE;
+		}
+	}
+	volume_select(NULL);
+
+	for (i = 0; i < argc - 1; i++)
+		pthread_create(&w[i].thread, NULL, analyze, &w[i]);
+
+	for (i = 0; i < argc - 1; i++) {
+		pthread_join(w[i].thread, NULL);
+		if (w[i].ret)
+			ret = EXIT_FAILURE;
+		volume_close(w[i].vol);
+		fclose(w[i].out);
+	}
+
+	free(w);
+	return ret;
+}